@@ -0,0 +1,70 @@
+// Append throughput of arena_da_append() for large dynamic arrays.
+//
+// Two scenarios are measured:
+// - "top":         the array is the only thing allocated from the arena, so
+//                  growth steps extend the block in place while it fits its
+//                  region. A block that spills gets a region with room to
+//                  double once more, so past REGION_DEFAULT_CAPACITY every
+//                  other step is in place.
+// - "interleaved": another allocation is made between growth steps, so the
+//                  block is never at the top and arena_realloc() has to copy
+//                  on every step.
+// Besides the time, the bytes arena_realloc() copied are reported.
+#define ARENA_IMPLEMENTATION
+#include "arena.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_ITEMS (1000 * 1000)
+#define BENCH_ROUNDS 20
+
+typedef struct {
+  uint32_t *items;
+  size_t count;
+  size_t capacity;
+} Numbers;
+
+static double now_secs(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static double bench_append(bool interleaved, size_t *checksum,
+                           size_t *copied) {
+  Arena a = {0};
+  double best = 0.0;
+  for (int round = 0; round < BENCH_ROUNDS; ++round) {
+    arena_reset(&a);
+    Numbers numbers = {0};
+    double start = now_secs();
+    for (uint32_t i = 0; i < BENCH_ITEMS; ++i) {
+      if (interleaved && numbers.count == numbers.capacity)
+        arena_alloc(&a, sizeof(uintptr_t));
+      arena_da_append(&a, &numbers, i);
+    }
+    double elapsed = now_secs() - start;
+    *checksum += numbers.items[numbers.count - 1];
+    if (round == 0 || elapsed < best)
+      best = elapsed;
+  }
+  *copied = a.stats.bytes_copied / BENCH_ROUNDS;
+  arena_free(&a);
+  return best;
+}
+
+int main(void) {
+  size_t checksum = 0;
+  const char *names[] = {"top", "interleaved"};
+  for (int i = 0; i < 2; ++i) {
+    size_t copied = 0;
+    double secs = bench_append(i == 1, &checksum, &copied);
+    printf("%-12s %8.3f ms  %8.1f M appends/s  %8.2f MB copied\n", names[i],
+           secs * 1e3, BENCH_ITEMS / secs * 1e-6, copied / 1e6);
+  }
+  printf("checksum: %zu\n", checksum);
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include "corpus.h"
+#include "gen.h"
+
+// The expression main() renders
+static Node *build_main(void) {
+  return node_if(
+      node_gt(node_mult(node_x(), node_y()), node_number(0)),
+      node_triple(node_x(), node_y(), node_number(1)),
+      node_triple(node_mod(node_x(), node_y()), node_mod(node_x(), node_y()),
+                  node_mod(node_x(), node_y())));
+}
+
+static Node *build_shallow(void) {
+  return node_triple(node_x(), node_y(), node_mult(node_x(), node_y()));
+}
+
+// A single long chain: x*0.99 + y*0.01, nested 256 times
+static Node *build_deep(void) {
+  Node *n = node_x();
+  for (int i = 0; i < 256; ++i) {
+    n = node_add(node_mult(n, node_number(0.99f)),
+                 node_mult(node_y(), node_number(0.01f)));
+  }
+  return node_triple(n, node_y(), node_number(0.5f));
+}
+
+// The depth the generator sometimes reaches, deep enough to hurt a recursive
+// evaluator: x*0.999 + y*0.001, nested 2000 times
+static Node *build_very_deep(void) {
+  Node *n = node_x();
+  for (int i = 0; i < 2000; ++i) {
+    n = node_add(node_mult(n, node_number(0.999f)),
+                 node_mult(node_y(), node_number(0.001f)));
+  }
+  return node_triple(n, node_y(), node_number(0.5f));
+}
+
+static Node *build_conditional_number(int depth, float bias) {
+  if (depth == 0)
+    return node_number(bias);
+  Node *cond = (depth % 2) ? node_gt(node_x(), node_number(bias))
+                           : node_gt(node_mult(node_x(), node_y()),
+                                     node_number(-bias));
+  return node_if(cond, build_conditional_number(depth - 1, bias * 0.5f),
+                 build_conditional_number(depth - 1, -bias * 0.5f));
+}
+
+static Node *build_conditional(void) {
+  return node_triple(build_conditional_number(6, 0.5f),
+                     build_conditional_number(5, -0.25f),
+                     build_conditional_number(4, 0.75f));
+}
+
+static Node *build_mod_number(int depth) {
+  if (depth == 0)
+    return node_mod(node_x(), node_add(node_y(), node_number(1e-3f)));
+  return node_mod(node_add(build_mod_number(depth - 1), node_x()),
+                  node_add(node_mult(node_y(), node_y()), node_number(0.1f)));
+}
+
+static Node *build_mod(void) {
+  return node_triple(build_mod_number(4), build_mod_number(3),
+                     build_mod_number(2));
+}
+
+static Node *build_gen_1(void) { return gen_tree(1, 6); }
+static Node *build_gen_2(void) { return gen_tree(2, 8); }
+static Node *build_gen_3(void) { return gen_tree(3, 10); }
+
+const Corpus_Entry corpus[] = {
+    {"main", "conditional", build_main, false},
+    {"shallow", "shallow", build_shallow, false},
+    {"deep-256", "deep", build_deep, false},
+    {"deep-2000", "deep", build_very_deep, true},
+    {"nested-if", "conditional", build_conditional, false},
+    {"mod-chain", "mod", build_mod, false},
+    {"gen-1-d6", "generated", build_gen_1, false},
+    {"gen-2-d8", "generated", build_gen_2, false},
+    {"gen-3-d10", "generated", build_gen_3, false},
+};
+
+const size_t corpus_count = sizeof(corpus) / sizeof(corpus[0]);
@@ -0,0 +1,17 @@
+#ifndef CORPUS_H_
+#define CORPUS_H_
+
+#include "node.h"
+
+// Representative expressions for benchmarking the renderer.
+typedef struct {
+  const char *name;
+  const char *category; // shallow, deep, conditional, mod, generated
+  Node *(*build)(void);
+  bool large; // too slow to render at full size, skipped there
+} Corpus_Entry;
+
+extern const Corpus_Entry corpus[];
+extern const size_t corpus_count;
+
+#endif // CORPUS_H_
@@ -0,0 +1,115 @@
+// Re-render times of render_incremental() after small edits.
+//
+// A generated tree is rendered once with render_pixels() for reference and
+// once incrementally, which fills the Plane_Cache. Then a leaf picked by a
+// random walk from the root is edited in place and the tree rendered again,
+// a few times over; every image is compared with render_pixels() of the
+// edited tree.
+#define NOB_STRIP_PREFIX
+#include "nob.h"
+
+#include "gen.h"
+#include "incremental.h"
+#include "node.h"
+#include "render.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_WIDTH 480
+#define BENCH_HEIGHT 360
+#define BENCH_DEPTH 9
+#define BENCH_EDITS 8
+
+static double now_secs(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t bench_random(uint64_t *state) {
+  *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+  return *state >> 33;
+}
+
+// Walks from the root to a leaf and changes it: numbers move by 0.25, x and
+// y swap places.
+static void edit_leaf(Node *tree, uint64_t *state) {
+  Node *node = tree;
+  Node *children[3];
+  size_t n;
+  while ((n = node_children(node, children)) > 0)
+    node = children[bench_random(state) % n];
+  switch (node->kind) {
+  case NK_NUMBER:
+    node->as.number += 0.25f;
+    break;
+  case NK_X:
+    node->kind = NK_Y;
+    break;
+  case NK_Y:
+    node->kind = NK_X;
+    break;
+  default:
+    break;
+  }
+}
+
+int main(void) {
+  size_t count = (size_t)BENCH_WIDTH * BENCH_HEIGHT;
+  Framebuffer want = {.pixels = malloc(count * sizeof(RGBA32)),
+                      .width = BENCH_WIDTH,
+                      .height = BENCH_HEIGHT};
+  Framebuffer got = {.pixels = malloc(count * sizeof(RGBA32)),
+                     .width = BENCH_WIDTH,
+                     .height = BENCH_HEIGHT};
+  NOB_ASSERT(want.pixels != NULL && got.pixels != NULL);
+  Render_Options opts = {0};
+  Plane_Cache cache = {0};
+  Node *tree = gen_tree(7, BENCH_DEPTH);
+  size_t nodes = node_count(tree);
+  bool ok = true;
+
+  double start = now_secs();
+  if (!render_pixels(tree, &want, &opts))
+    return 1;
+  double full = now_secs() - start;
+
+  start = now_secs();
+  if (!render_incremental(tree, &got, &opts, &cache))
+    return 1;
+  double cold = now_secs() - start;
+  ok = memcmp(want.pixels, got.pixels, count * sizeof(RGBA32)) == 0;
+  printf("%zu nodes, %dx%d\n", nodes, BENCH_WIDTH, BENCH_HEIGHT);
+  printf("render_pixels:       %8.1f ms\n", full * 1e3);
+  printf("incremental, cold:   %8.1f ms, %.1f MB of planes kept %s\n",
+         cold * 1e3, cache.bytes / 1e6, ok ? "identical" : "MISMATCH");
+
+  uint64_t state = 42;
+  for (int i = 0; i < BENCH_EDITS; ++i) {
+    edit_leaf(tree, &state);
+    start = now_secs();
+    if (!render_incremental(tree, &got, &opts, &cache))
+      return 1;
+    double elapsed = now_secs() - start;
+    if (!render_pixels(tree, &want, &opts))
+      return 1;
+    bool same = memcmp(want.pixels, got.pixels, count * sizeof(RGBA32)) == 0;
+    ok = ok && same;
+    printf("after a leaf edit:   %8.1f ms, %5zu nodes evaluated, %3zu "
+           "subtrees reused %s\n",
+           elapsed * 1e3, cache.evaluated, cache.reused,
+           same ? "identical" : "MISMATCH");
+  }
+
+  start = now_secs();
+  if (!render_incremental(tree, &got, &opts, &cache))
+    return 1;
+  printf("unchanged:           %8.1f ms\n", (now_secs() - start) * 1e3);
+
+  plane_cache_free(&cache);
+  free(want.pixels);
+  free(got.pixels);
+  return ok ? 0 : 1;
+}
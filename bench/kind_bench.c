@@ -0,0 +1,256 @@
+// Measures the cost of every Node_Kind in every evaluator backend and fits the
+// cost model of src/cost.h from the measurements.
+//
+// For each kind a chain of that operation is rendered at a few lengths; the
+// slope between the shortest and the longest chain is the microbenchmark
+// result. Those renders, renders of the smallest trees and of random trees
+// (to mix the kinds the way real expressions do) are the samples for the
+// non-negative least squares fit, which is validated against the benchmark
+// corpus. The range of the validation errors is saved with the model.
+//
+// Usage: kind-bench [--backend NAME] [--save-dir DIR]
+#define NOB_STRIP_PREFIX
+
+#include "corpus.h"
+#include "cost.h"
+#include "gen.h"
+#include "nob.h"
+#include "render.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_WIDTH 128
+#define BENCH_HEIGHT 96
+#define BENCH_REPS 3
+#define BENCH_RANDOM_TREES 24
+
+static const int chain_lengths[] = {4, 16, 64, 256};
+#define CHAIN_LENGTHS_COUNT (sizeof(chain_lengths) / sizeof(chain_lengths[0]))
+
+typedef Node *(*Chain_Step)(Node *n);
+
+static Node *step_x(Node *n) { return node_add(n, node_x()); }
+static Node *step_y(Node *n) { return node_add(n, node_y()); }
+static Node *step_t(Node *n) { return node_add(n, node_t()); }
+static Node *step_number(Node *n) { return node_add(n, node_number(0.5f)); }
+static Node *step_add(Node *n) { return node_add(n, node_number(0.01f)); }
+static Node *step_mult(Node *n) { return node_mult(n, node_number(0.99f)); }
+static Node *step_mod(Node *n) { return node_mod(n, node_number(0.7f)); }
+static Node *step_sin(Node *n) { return node_sin(n); }
+static Node *step_cos(Node *n) { return node_cos(n); }
+static Node *step_exp(Node *n) {
+  return node_exp(node_mult(n, node_number(-0.5f)));
+}
+static Node *step_sqrt(Node *n) { return node_sqrt(node_abs(n)); }
+static Node *step_abs(Node *n) { return node_abs(n); }
+static Node *step_atan2(Node *n) { return node_atan2(n, node_y()); }
+static Node *step_min(Node *n) { return node_min(n, node_number(0.9f)); }
+static Node *step_max(Node *n) { return node_max(n, node_number(-0.9f)); }
+static Node *step_boolean(Node *n) {
+  return node_if(node_boolean(true), n, node_number(0.25f));
+}
+static Node *step_gt(Node *n) {
+  return node_if(node_gt(node_x(), node_number(0)), n, node_number(0.25f));
+}
+// An if needs a boolean condition, so on its own the cost of if can't be
+// told apart from the cost of its condition. Nesting a second if in the
+// condition gives a chain with a different if/boolean ratio.
+static Node *step_if(Node *n) {
+  Node *cond =
+      node_if(node_boolean(true), node_boolean(true), node_boolean(false));
+  return node_if(cond, n, node_number(0.25f));
+}
+
+// NK_TRIPLE has no chain of its own: every tree has exactly one at the root,
+// so its cost is indistinguishable from the per-pixel overhead.
+typedef struct {
+  const char *name;
+  Node_Kind kind;
+  Chain_Step step;
+} Chain;
+
+static const Chain chains[] = {
+    {"x", NK_X, step_x},
+    {"y", NK_Y, step_y},
+    {"t", NK_T, step_t},
+    {"number", NK_NUMBER, step_number},
+    {"add", NK_ADD, step_add},
+    {"mult", NK_MULT, step_mult},
+    {"mod", NK_MOD, step_mod},
+    {"sin", NK_SIN, step_sin},
+    {"cos", NK_COS, step_cos},
+    {"exp", NK_EXP, step_exp},
+    {"sqrt", NK_SQRT, step_sqrt},
+    {"abs", NK_ABS, step_abs},
+    {"atan2", NK_ATAN2, step_atan2},
+    {"min", NK_MIN, step_min},
+    {"max", NK_MAX, step_max},
+    {"boolean", NK_BOOL, step_boolean},
+    {"gt", NK_GT, step_gt},
+    {"if", NK_IF, step_if},
+};
+#define CHAINS_COUNT (sizeof(chains) / sizeof(chains[0]))
+
+static Node *base_numbers(void) {
+  return node_triple(node_number(0), node_number(0), node_number(0));
+}
+static Node *base_xy(void) {
+  return node_triple(node_x(), node_y(), node_number(0.5f));
+}
+static Node *base_yx(void) { return node_triple(node_y(), node_x(), node_x()); }
+
+static Node *(*const base_trees[])(void) = {base_numbers, base_xy, base_yx};
+#define BASE_TREES_COUNT (sizeof(base_trees) / sizeof(base_trees[0]))
+
+static double now_secs(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static Framebuffer fb = {.width = BENCH_WIDTH, .height = BENCH_HEIGHT};
+
+// Best of BENCH_REPS single-threaded renders, in ns per pixel
+static bool measure(Node *f, Backend backend, double *ns_per_pixel) {
+  Render_Options opts = {.backend = backend, .threads = 1};
+  double best = 0.0;
+  for (int i = 0; i < BENCH_REPS; ++i) {
+    double start = now_secs();
+    if (!render_pixels(f, &fb, &opts))
+      return false;
+    double secs = now_secs() - start;
+    if (i == 0 || secs < best)
+      best = secs;
+  }
+  *ns_per_pixel = best * 1e9 / (fb.width * fb.height);
+  return true;
+}
+
+static bool bench_backend(Backend backend, const char *save_dir) {
+  printf("backend %s\n", backend_name(backend));
+  printf("  %-8s %12s\n", "kind", "ns/px/step");
+
+  Cost_Sample samples[CHAINS_COUNT * CHAIN_LENGTHS_COUNT + BENCH_RANDOM_TREES +
+                      BASE_TREES_COUNT] = {0};
+  size_t samples_count = 0;
+  for (size_t c = 0; c < CHAINS_COUNT; ++c) {
+    double first = 0.0, last = 0.0;
+    for (size_t l = 0; l < CHAIN_LENGTHS_COUNT; ++l) {
+      Node *n = node_number(0);
+      for (int i = 0; i < chain_lengths[l]; ++i)
+        n = chains[c].step(n);
+      Node *f = node_triple(n, node_number(0), node_number(0));
+
+      Cost_Sample *s = &samples[samples_count++];
+      node_histogram(f, s->hist);
+      if (!measure(f, backend, &s->ns_per_pixel))
+        return false;
+      if (l == 0)
+        first = s->ns_per_pixel;
+      last = s->ns_per_pixel;
+    }
+    double steps = chain_lengths[CHAIN_LENGTHS_COUNT - 1] - chain_lengths[0];
+    printf("  %-8s %12.3f\n", chains[c].name, (last - first) / steps);
+  }
+
+  // The smallest trees pin down the cost of a pixel, which every chain
+  // carries along with the cost of its steps
+  for (size_t i = 0; i < BASE_TREES_COUNT; ++i) {
+    Node *f = base_trees[i]();
+    Cost_Sample *s = &samples[samples_count++];
+    node_histogram(f, s->hist);
+    if (!measure(f, backend, &s->ns_per_pixel))
+      return false;
+  }
+
+  // The corpus uses seeds 1..3, keep these disjoint from it
+  for (int i = 0; i < BENCH_RANDOM_TREES; ++i) {
+    Node *f = gen_tree(1000 + i, 3 + i % 8);
+    Cost_Sample *s = &samples[samples_count++];
+    node_histogram(f, s->hist);
+    if (!measure(f, backend, &s->ns_per_pixel))
+      return false;
+  }
+
+  Cost_Model model = {.backend = backend};
+  if (!cost_model_fit(&model, samples, samples_count)) {
+    nob_log(ERROR, "Could not fit the cost model for %s",
+            backend_name(backend));
+    return false;
+  }
+  printf("  fitted model (ns per node per pixel):\n");
+  printf("    %-10s %10.3f\n", "per_pixel", model.per_pixel);
+  for (size_t k = 0; k < COUNT_NK; ++k)
+    printf("    %-10s %10.3f\n", node_kind_name(k), model.per_kind[k]);
+
+  printf("  validation on the corpus:\n");
+  printf("    %-12s %12s %12s %8s\n", "expr", "measured ms", "predicted ms",
+         "error");
+  model.error_low = model.error_high = 0.0;
+  for (size_t i = 0; i < corpus_count; ++i) {
+    Node *f = corpus[i].build();
+    double measured;
+    if (!measure(f, backend, &measured))
+      return false;
+    double pixels = (double)fb.width * fb.height;
+    double predicted = cost_predict_secs(&model, f, fb.width, fb.height, 1);
+    measured = measured * 1e-9 * pixels;
+    double error = (predicted - measured) / measured;
+    printf("    %-12s %12.3f %12.3f %7.1f%%\n", corpus[i].name, measured * 1e3,
+           predicted * 1e3, error * 100.0);
+    if (error < model.error_low)
+      model.error_low = error;
+    if (error > model.error_high)
+      model.error_high = error;
+  }
+  printf("  error range: %+.1f%% .. %+.1f%%\n", model.error_low * 100.0,
+         model.error_high * 100.0);
+
+  if (save_dir) {
+    const char *path =
+        temp_sprintf("%s/cost-%s.txt", save_dir, backend_name(backend));
+    if (!cost_model_save(&model, path))
+      return false;
+    nob_log(INFO, "Saved the cost model to %s", path);
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const char *program = shift(argv, argc);
+  const char *save_dir = NULL;
+  bool all_backends = true;
+  Backend only_backend = BACKEND_EVAL;
+
+  while (argc > 0) {
+    const char *flag = shift(argv, argc);
+    if (strcmp(flag, "--save-dir") == 0 && argc > 0) {
+      save_dir = shift(argv, argc);
+    } else if (strcmp(flag, "--backend") == 0 && argc > 0) {
+      const char *name = shift(argv, argc);
+      if (!backend_by_name(name, &only_backend)) {
+        nob_log(ERROR, "Unknown backend %s", name);
+        return 1;
+      }
+      all_backends = false;
+    } else {
+      fprintf(stderr, "Usage: %s [--backend NAME] [--save-dir DIR]\n",
+              program);
+      return 1;
+    }
+  }
+
+  fb.pixels = malloc(sizeof(RGBA32) * fb.width * fb.height);
+  NOB_ASSERT(fb.pixels != NULL);
+  for (Backend b = 0; b < COUNT_BACKENDS; ++b) {
+    if (!all_backends && b != only_backend)
+      continue;
+    if (!bench_backend(b, save_dir))
+      return 1;
+  }
+  free(fb.pixels);
+  return 0;
+}
@@ -0,0 +1,116 @@
+// Several Randomart contexts rendering at the same time.
+//
+// Every thread owns a context, generates its own tree in it, renders it with
+// one worker into a buffer with padding at the end of the rows, in two halves
+// placed with a viewport, and encodes the PNG to memory. The same trees are
+// then rendered one after the other with render_pixels() and
+// image_encode_png(); pixels and files have to match.
+#define NOB_STRIP_PREFIX
+#include "nob.h"
+
+#include "gen.h"
+#include "image.h"
+#include "randomart.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_CONTEXTS 4
+#define BENCH_WIDTH 320
+#define BENCH_HEIGHT 240
+#define BENCH_PADDING 16 // pixels at the end of every row
+#define BENCH_DEPTH 8
+
+typedef struct {
+  pthread_t thread;
+  uint64_t seed;
+  RGBA32 *pixels; // BENCH_WIDTH + BENCH_PADDING pixels per row
+  String_Builder png;
+  bool ok;
+} Bench_Context;
+
+static double now_secs(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void append_png(void *user, void *data, int size) {
+  da_append_many((String_Builder *)user, (const char *)data, (size_t)size);
+}
+
+static void *bench_context(void *arg) {
+  Bench_Context *c = arg;
+  Randomart ra = {.opts = {.threads = 1}};
+  Node *tree = randomart_generate(&ra, c->seed, BENCH_DEPTH);
+  size_t stride = (BENCH_WIDTH + BENCH_PADDING) * sizeof(RGBA32);
+  int top = BENCH_HEIGHT / 2;
+  Render_Viewport halves[2] = {
+      {.y = 0, .width = BENCH_WIDTH, .height = BENCH_HEIGHT},
+      {.y = top, .width = BENCH_WIDTH, .height = BENCH_HEIGHT},
+  };
+  RGBA32 *bottom = c->pixels + (size_t)top * (BENCH_WIDTH + BENCH_PADDING);
+  c->ok = randomart_render_into(&ra, tree, c->pixels, BENCH_WIDTH, top, stride,
+                                &halves[0]) &&
+          randomart_render_into(&ra, tree, bottom, BENCH_WIDTH,
+                                BENCH_HEIGHT - top, stride, &halves[1]) &&
+          randomart_write_png(c->pixels, BENCH_WIDTH, BENCH_HEIGHT, stride,
+                              append_png, &c->png);
+  randomart_free(&ra);
+  return NULL;
+}
+
+int main(void) {
+  Bench_Context contexts[BENCH_CONTEXTS] = {0};
+  size_t padded = (size_t)(BENCH_WIDTH + BENCH_PADDING) * BENCH_HEIGHT;
+  double start = now_secs();
+  for (int i = 0; i < BENCH_CONTEXTS; ++i) {
+    contexts[i].seed = 100 + i;
+    contexts[i].pixels = malloc(padded * sizeof(RGBA32));
+    NOB_ASSERT(contexts[i].pixels != NULL);
+    if (pthread_create(&contexts[i].thread, NULL, bench_context,
+                       &contexts[i]) != 0)
+      return 1;
+  }
+  for (int i = 0; i < BENCH_CONTEXTS; ++i)
+    pthread_join(contexts[i].thread, NULL);
+  double together = now_secs() - start;
+
+  size_t count = (size_t)BENCH_WIDTH * BENCH_HEIGHT;
+  Framebuffer fb = {.pixels = malloc(count * sizeof(RGBA32)),
+                    .width = BENCH_WIDTH,
+                    .height = BENCH_HEIGHT};
+  NOB_ASSERT(fb.pixels != NULL);
+  Render_Options opts = {.threads = 1};
+  bool ok = true;
+  double alone = 0.0;
+  for (int i = 0; i < BENCH_CONTEXTS; ++i) {
+    Bench_Context *c = &contexts[i];
+    Node *tree = gen_tree(c->seed, BENCH_DEPTH);
+    start = now_secs();
+    bool rendered = render_pixels(tree, &fb, &opts);
+    size_t size = 0;
+    unsigned char *png = rendered ? image_encode_png(&fb, &size) : NULL;
+    alone += now_secs() - start;
+    bool same = c->ok && png != NULL;
+    for (int y = 0; same && y < BENCH_HEIGHT; ++y)
+      same = memcmp(framebuffer_row(&fb, y),
+                    c->pixels + (size_t)y * (BENCH_WIDTH + BENCH_PADDING),
+                    BENCH_WIDTH * sizeof(RGBA32)) == 0;
+    same = same && size == c->png.count &&
+           memcmp(png, c->png.items, size) == 0;
+    printf("context %d: %zu nodes, %zu bytes of PNG %s\n", i,
+           node_count(tree), c->png.count, same ? "identical" : "MISMATCH");
+    ok = ok && same;
+    free(png);
+    free(c->pixels);
+    free(c->png.items);
+    arena_reset(&node_arena);
+  }
+  printf("%d contexts at once: %8.1f ms, one after the other: %8.1f ms\n",
+         BENCH_CONTEXTS, together * 1e3, alone * 1e3);
+  free(fb.pixels);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+// Memory of a long mutation search, with nodes in node_slab and in
+// node_arena.
+//
+// Every generation mutates the current tree with gen_mutate() and keeps the
+// mutant unless it has grown past BENCH_MAX_NODES; the tree that loses is
+// dropped with node_release(). With the slab the pages held stay flat once
+// the search has warmed up, while node_arena only ever grows.
+#define NOB_STRIP_PREFIX
+#include "nob.h"
+
+#include "gen.h"
+#include "node.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_DEPTH 6
+#define BENCH_MUTATION_DEPTH 3
+#define BENCH_MAX_NODES 2000
+#define BENCH_GENERATIONS 200000
+#define BENCH_REPORT_EVERY 40000
+
+static double now_secs(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static size_t slab_live(const Slab *slab) {
+  size_t live = 0;
+  for (size_t c = 0; c < SLAB_CLASS_COUNT; ++c)
+    live += slab->stats.live[c];
+  return live;
+}
+
+// Returns the seconds the search took
+static double bench_search(Slab *slab) {
+  node_slab = slab;
+  Node *tree = gen_tree(1, BENCH_DEPTH);
+  double start = now_secs();
+  for (uint64_t g = 1; g <= BENCH_GENERATIONS; ++g) {
+    Node *mutant = gen_mutate(tree, g, BENCH_MUTATION_DEPTH);
+    if (node_count(mutant) <= BENCH_MAX_NODES) {
+      node_release(tree);
+      tree = mutant;
+    } else {
+      node_release(mutant);
+    }
+    if (g % BENCH_REPORT_EVERY == 0) {
+      if (slab)
+        printf("  %7" PRIu64 " generations: %4zu nodes, %6zu live, %4zu "
+               "pages (%zu KB)\n",
+               g, node_count(tree), slab_live(slab), slab->stats.pages,
+               slab->stats.pages * SLAB_PAGE_SIZE / 1024);
+      else
+        printf("  %7" PRIu64 " generations: %4zu nodes, %8zu KB allocated\n",
+               g, node_count(tree), node_arena.stats.bytes / 1024);
+    }
+  }
+  double secs = now_secs() - start;
+  node_release(tree);
+  node_slab = NULL;
+  return secs;
+}
+
+int main(void) {
+  Slab slab = {0};
+  printf("slab:\n");
+  double slab_secs = bench_search(&slab);
+  bool flat = slab_live(&slab) == 0;
+  slab_release(&slab);
+  printf("arena:\n");
+  double arena_secs = bench_search(NULL);
+  printf("%d generations: slab %8.1f ms, arena %8.1f ms\n", BENCH_GENERATIONS,
+         slab_secs * 1e3, arena_secs * 1e3);
+  printf("every slab node given back: %s\n", flat ? "yes" : "NO");
+  return flat ? 0 : 1;
+}
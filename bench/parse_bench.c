@@ -0,0 +1,139 @@
+// Throughput of parse_expr() on large generated expressions.
+//
+// Each tree from gen_tree() is printed with node_fprint(), parsed back and
+// printed again; the two texts have to match, so this doubles as a check
+// that the syntax round-trips. The same tree is then saved in the binary
+// format of bintree.h to compare loading it, and converting it back to
+// nodes, with parsing the text.
+#define NOB_STRIP_PREFIX
+#include "nob.h"
+
+#include "bintree.h"
+#include "gen.h"
+#include "node.h"
+#include "parse.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ROUNDS 5
+#define BENCH_BIN_PATH "parse-bench.rart"
+
+static double now_secs(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static bool print_to(Node *node, String_Builder *sb) {
+  FILE *f = tmpfile();
+  if (f == NULL)
+    return false;
+  node_fprint(f, node);
+  long size = ftell(f);
+  rewind(f);
+  if (sb->capacity < (size_t)size) {
+    sb->capacity = (size_t)size;
+    sb->items = realloc(sb->items, sb->capacity);
+    NOB_ASSERT(sb->items != NULL);
+  }
+  sb->count = fread(sb->items, 1, (size_t)size, f);
+  fclose(f);
+  return sb->count == (size_t)size;
+}
+
+// Maps the file and validates the tree, then turns it into nodes. Checks
+// that the nodes print like the text and evaluate like the tree.
+static bool bench_binary(Node *tree, const String_Builder *text,
+                         String_Builder *again) {
+  if (!bintree_write_file(BENCH_BIN_PATH, &tree, 1))
+    return false;
+  double load = 0.0, convert = 0.0;
+  Node *converted = NULL;
+  size_t size = 0;
+  bool ok = true;
+  for (int round = 0; ok && round < BENCH_ROUNDS; ++round) {
+    Arena_Mark mark = arena_snapshot(&node_arena);
+    double start = now_secs();
+    Bintree_File file;
+    Bintree bin;
+    ok = bintree_open(&file, BENCH_BIN_PATH) && bintree_get(&file, 0, &bin);
+    double loaded = now_secs();
+    if (!ok)
+      break;
+    converted = bintree_to_node(&bin);
+    double elapsed = now_secs() - loaded;
+    if (round == 0 || loaded - start < load)
+      load = loaded - start;
+    if (round == 0 || elapsed < convert)
+      convert = elapsed;
+    size = file.size;
+
+    if (round + 1 == BENCH_ROUNDS) {
+      float *scratch = malloc(bintree_scratch_size(&bin) * sizeof(float));
+      NOB_ASSERT(scratch != NULL);
+      for (int k = 0; ok && k < 16; ++k) {
+        float x = k / 8.0f - 1.0f, y = 1.0f - k / 8.0f;
+        Color want, got;
+        if (!eval_func(tree, x, y, 0.5f, &want))
+          break; // the generator made a tree that does not type check
+        bintree_eval(&bin, x, y, 0.5f, scratch, &got);
+        ok = memcmp(&want, &got, sizeof(want)) == 0;
+      }
+      free(scratch);
+    } else {
+      arena_rewind(&node_arena, mark);
+    }
+    bintree_close(&file);
+  }
+  remove(BENCH_BIN_PATH);
+  if (!ok || !print_to(converted, again))
+    return false;
+  bool same = text->count == again->count &&
+              memcmp(text->items, again->items, text->count) == 0;
+  printf("  binary: %8.2f MB %8.2f ms load %8.2f ms to nodes %s\n",
+         size / 1e6, load * 1e3, convert * 1e3,
+         same ? "round-trips" : "MISMATCH");
+  return same;
+}
+
+int main(void) {
+  const int depths[] = {12, 16, 18};
+  String_Builder text = {0}, again = {0};
+  bool ok = true;
+  for (size_t i = 0; i < ARRAY_LEN(depths); ++i) {
+    Node *tree = gen_tree(42 + i, depths[i]);
+    if (!print_to(tree, &text))
+      return 1;
+
+    double best = 0.0;
+    Node *parsed = NULL;
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+      Arena_Mark mark = arena_snapshot(&node_arena);
+      double start = now_secs();
+      parsed = parse_expr("<bench>", sb_to_sv(text));
+      double elapsed = now_secs() - start;
+      if (parsed == NULL)
+        return 1;
+      if (round == 0 || elapsed < best)
+        best = elapsed;
+      if (round + 1 < BENCH_ROUNDS)
+        arena_rewind(&node_arena, mark);
+    }
+
+    if (!print_to(parsed, &again))
+      return 1;
+    bool same = text.count == again.count &&
+                memcmp(text.items, again.items, text.count) == 0;
+    ok = ok && same;
+    printf("depth %2d: %8zu nodes %8.2f MB %8.2f ms %8.1f MB/s %s\n",
+           depths[i], node_count(tree), text.count / 1e6, best * 1e3,
+           text.count / best * 1e-6, same ? "round-trips" : "MISMATCH");
+    ok = bench_binary(tree, &text, &again) && ok;
+    arena_reset(&node_arena);
+  }
+  free(text.items);
+  free(again.items);
+  return ok ? 0 : 1;
+}
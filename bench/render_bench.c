@@ -0,0 +1,272 @@
+// Renders every expression of the corpus at several resolutions with every
+// evaluator backend and reports render throughput, per-node cost, peak RSS
+// and PNG encode time.
+//
+// Usage: render-bench [--json] [--quick] [--reps N] [--backend NAME]
+//                     [--trace FILE]
+#define NOB_STRIP_PREFIX
+
+#include "corpus.h"
+#include "image.h"
+#include "nob.h"
+#include "render.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+typedef struct {
+  int width, height;
+} Resolution;
+
+static const Resolution resolutions[] = {
+    {160, 120},
+    {480, 360},
+    {1440, 1080},
+};
+#define RESOLUTIONS_COUNT (sizeof(resolutions) / sizeof(resolutions[0]))
+
+typedef struct {
+  const Corpus_Entry *entry;
+  Backend backend;
+  Resolution res;
+  size_t nodes;
+  double render_secs;
+  double encode_secs;
+  size_t png_bytes;
+  long peak_rss_kb; // -1 when unknown
+} Result;
+
+static double now_secs(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// On Linux the peak RSS of the process can be reset between cases by writing
+// 5 to /proc/self/clear_refs. Elsewhere it is the high-water mark of the
+// whole run so far.
+static void peak_rss_reset(void) {
+#ifdef __linux__
+  int fd = open("/proc/self/clear_refs", O_WRONLY);
+  if (fd >= 0) {
+    if (write(fd, "5", 1) < 0) {
+      // Not fatal, the reading will just be the process peak
+    }
+    close(fd);
+  }
+#endif
+}
+
+static long peak_rss_kb(void) {
+#if defined(__linux__)
+  FILE *f = fopen("/proc/self/status", "r");
+  if (f == NULL)
+    return -1;
+  char line[256];
+  long kb = -1;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "VmHWM: %ld kB", &kb) == 1)
+      break;
+  }
+  fclose(f);
+  return kb;
+#elif defined(_WIN32)
+  return -1;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return -1;
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+#endif
+}
+
+static bool run_case(Result *r, int reps) {
+  Trace_Span span = trace_begin("build tree");
+  Node *f = r->entry->build();
+  trace_end(span);
+  r->nodes = node_count(f);
+
+  Framebuffer fb = {
+      .width = r->res.width,
+      .height = r->res.height,
+      .pixels = malloc(sizeof(RGBA32) * r->res.width * r->res.height),
+  };
+  NOB_ASSERT(fb.pixels != NULL);
+  Render_Options opts = {.backend = r->backend};
+
+  peak_rss_reset();
+  r->render_secs = 0.0;
+  for (int i = 0; i < reps; ++i) {
+    double start = now_secs();
+    if (!render_pixels(f, &fb, &opts)) {
+      free(fb.pixels);
+      return false;
+    }
+    double secs = now_secs() - start;
+    if (i == 0 || secs < r->render_secs)
+      r->render_secs = secs;
+  }
+
+  r->encode_secs = 0.0;
+  for (int i = 0; i < reps; ++i) {
+    double start = now_secs();
+    unsigned char *png = image_encode_png(&fb, &r->png_bytes);
+    double secs = now_secs() - start;
+    if (png == NULL) {
+      free(fb.pixels);
+      return false;
+    }
+    free(png);
+    if (i == 0 || secs < r->encode_secs)
+      r->encode_secs = secs;
+  }
+  r->peak_rss_kb = peak_rss_kb();
+
+  free(fb.pixels);
+  return true;
+}
+
+static double pixels_of(const Result *r) {
+  return (double)r->res.width * r->res.height;
+}
+
+static void print_human_header(void) {
+  printf("%-10s %-12s %-12s %10s %6s %10s %12s %10s %10s %10s\n", "backend",
+         "expr", "category", "resolution", "nodes", "render ms", "Mpixels/s",
+         "ns/px/node", "encode ms", "peak MiB");
+}
+
+static void print_human(const Result *r) {
+  char res[32];
+  snprintf(res, sizeof(res), "%dx%d", r->res.width, r->res.height);
+  char rss[32] = "n/a";
+  if (r->peak_rss_kb >= 0)
+    snprintf(rss, sizeof(rss), "%.1f", r->peak_rss_kb / 1024.0);
+  printf("%-10s %-12s %-12s %10s %6zu %10.2f %12.2f %10.3f %10.2f %10s\n",
+         backend_name(r->backend), r->entry->name, r->entry->category, res,
+         r->nodes, r->render_secs * 1e3,
+         pixels_of(r) / r->render_secs * 1e-6,
+         r->render_secs * 1e9 / (pixels_of(r) * r->nodes),
+         r->encode_secs * 1e3, rss);
+}
+
+static void print_json(const Result *r, bool first) {
+  printf("%s\n    {\"backend\": \"%s\", \"expr\": \"%s\", \"category\": \"%s\", "
+         "\"width\": %d, \"height\": %d, \"nodes\": %zu, "
+         "\"render_secs\": %.9f, \"pixels_per_sec\": %.1f, "
+         "\"ns_per_pixel_node\": %.6f, \"encode_secs\": %.9f, "
+         "\"png_bytes\": %zu, \"peak_rss_kb\": ",
+         first ? "" : ",", backend_name(r->backend), r->entry->name,
+         r->entry->category, r->res.width, r->res.height, r->nodes,
+         r->render_secs, pixels_of(r) / r->render_secs,
+         r->render_secs * 1e9 / (pixels_of(r) * r->nodes), r->encode_secs,
+         r->png_bytes);
+  if (r->peak_rss_kb >= 0)
+    printf("%ld}", r->peak_rss_kb);
+  else
+    printf("null}");
+}
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [--json] [--quick] [--reps N] [--backend NAME] "
+          "[--trace FILE]\n"
+          "  --json          print results as JSON\n"
+          "  --quick         skip the largest resolution\n"
+          "  --reps N        renders per case, the fastest is kept (default "
+          "3)\n"
+          "  --trace FILE    write a Chrome trace-event timeline to FILE\n"
+          "  --backend NAME  only run one backend:",
+          program);
+  for (Backend b = 0; b < COUNT_BACKENDS; ++b)
+    fprintf(stderr, " %s", backend_name(b));
+  fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv) {
+  const char *program = shift(argv, argc);
+  bool json = false;
+  bool quick = false;
+  int reps = 3;
+  bool all_backends = true;
+  Backend only_backend = BACKEND_EVAL;
+  const char *trace_path = NULL;
+
+  while (argc > 0) {
+    const char *flag = shift(argv, argc);
+    if (strcmp(flag, "--json") == 0) {
+      json = true;
+    } else if (strcmp(flag, "--quick") == 0) {
+      quick = true;
+    } else if (strcmp(flag, "--reps") == 0 && argc > 0) {
+      reps = atoi(shift(argv, argc));
+      if (reps < 1)
+        reps = 1;
+    } else if (strcmp(flag, "--backend") == 0 && argc > 0) {
+      const char *name = shift(argv, argc);
+      if (!backend_by_name(name, &only_backend)) {
+        nob_log(ERROR, "Unknown backend %s", name);
+        usage(program);
+        return 1;
+      }
+      all_backends = false;
+    } else if (strcmp(flag, "--trace") == 0 && argc > 0) {
+      trace_path = shift(argv, argc);
+    } else {
+      usage(program);
+      return 1;
+    }
+  }
+
+  if (trace_path)
+    trace_start(trace_path);
+
+  size_t resolutions_count = RESOLUTIONS_COUNT - (quick ? 1 : 0);
+  if (json)
+    printf("{\n  \"threads\": %d,\n  \"reps\": %d,\n  \"results\": [",
+           cpu_count(), reps);
+  else
+    print_human_header();
+
+  bool first = true;
+  for (Backend b = 0; b < COUNT_BACKENDS; ++b) {
+    if (!all_backends && b != only_backend)
+      continue;
+    for (size_t i = 0; i < corpus_count; ++i) {
+      for (size_t j = 0; j < resolutions_count; ++j) {
+        if (corpus[i].large && j == RESOLUTIONS_COUNT - 1)
+          continue;
+        Result r = {.entry = &corpus[i], .backend = b, .res = resolutions[j]};
+        if (!run_case(&r, reps)) {
+          nob_log(ERROR, "Could not render %s", corpus[i].name);
+          return 1;
+        }
+        if (json)
+          print_json(&r, first);
+        else
+          print_human(&r);
+        fflush(stdout);
+        first = false;
+      }
+    }
+  }
+
+  if (json)
+    printf("\n  ]\n}\n");
+  if (trace_path && !trace_finish())
+    return 1;
+  return 0;
+}
@@ -0,0 +1,142 @@
+// Tiled renders against whole ones.
+//
+// Every tree is rendered whole with each set of options, then again as a
+// grid of tiles of uneven sizes, each tile placed with a Render_Viewport and
+// written straight into its part of a second image through the row stride.
+// The two images have to be identical, for the plain, dithered,
+// anti-aliased, symmetric, zoomed, progressive and incremental renders.
+#define NOB_STRIP_PREFIX
+#include "nob.h"
+
+#include "gen.h"
+#include "incremental.h"
+#include "node.h"
+#include "parse.h"
+#include "render.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SIDE 240 // square, so that the swap symmetry applies
+#define BENCH_DEPTH 7
+
+// Tile edges, in 1/8 of the image: uneven on purpose
+static const int bench_cuts[] = {0, 1, 4, 5, 8};
+
+typedef enum {
+  BENCH_PIXELS,
+  BENCH_PROGRESSIVE,
+  BENCH_INCREMENTAL,
+} Bench_Renderer;
+
+typedef struct {
+  const char *name;
+  Bench_Renderer renderer;
+  Render_Options opts;
+} Bench_Case;
+
+static const Bench_Case bench_cases[] = {
+    {"plain", BENCH_PIXELS, {0}},
+    {"dither", BENCH_PIXELS, {.dither = true}},
+    {"aa 8", BENCH_PIXELS, {.aa_samples = 8}},
+    {"symmetry", BENCH_PIXELS, {.symmetry = SYMMETRY_PROVEN}},
+    {"zoom", BENCH_PIXELS,
+     {.viewport = {.center_x = 0.25f, .center_y = -0.5f, .scale = 0.125f}}},
+    {"zoom symmetry", BENCH_PIXELS,
+     {.symmetry = SYMMETRY_PROVEN, .viewport = {.scale = 3.0f}}},
+    {"progressive", BENCH_PROGRESSIVE, {.dither = true}},
+    {"incremental", BENCH_INCREMENTAL, {0}},
+};
+
+static double now_secs(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static bool bench_render(Node *f, Framebuffer *fb, const Bench_Case *c,
+                         const Render_Options *opts) {
+  switch (c->renderer) {
+  case BENCH_PROGRESSIVE:
+    return render_progressive(f, fb, opts, NULL, NULL);
+  case BENCH_INCREMENTAL: {
+    Plane_Cache cache = {0};
+    bool ok = render_incremental(f, fb, opts, &cache);
+    plane_cache_free(&cache);
+    return ok;
+  }
+  default:
+    return render_pixels(f, fb, opts);
+  }
+}
+
+// Renders the grid of tiles into tiled, returns the seconds it took
+static double bench_tiles(Node *f, Framebuffer *tiled, const Bench_Case *c,
+                          bool *ok) {
+  double start = now_secs();
+  size_t cuts = ARRAY_LEN(bench_cuts);
+  for (size_t ty = 0; *ok && ty + 1 < cuts; ++ty) {
+    for (size_t tx = 0; *ok && tx + 1 < cuts; ++tx) {
+      int x0 = bench_cuts[tx] * BENCH_SIDE / 8;
+      int x1 = bench_cuts[tx + 1] * BENCH_SIDE / 8;
+      int y0 = bench_cuts[ty] * BENCH_SIDE / 8;
+      int y1 = bench_cuts[ty + 1] * BENCH_SIDE / 8;
+      Framebuffer tile = {.pixels = tiled->pixels + (size_t)y0 * BENCH_SIDE +
+                                    x0,
+                          .width = x1 - x0,
+                          .height = y1 - y0,
+                          .stride = BENCH_SIDE};
+      Render_Options opts = c->opts;
+      opts.viewport.x = x0;
+      opts.viewport.y = y0;
+      opts.viewport.width = BENCH_SIDE;
+      opts.viewport.height = BENCH_SIDE;
+      *ok = bench_render(f, &tile, c, &opts);
+    }
+  }
+  return now_secs() - start;
+}
+
+int main(void) {
+  size_t count = (size_t)BENCH_SIDE * BENCH_SIDE;
+  Framebuffer whole = {.pixels = malloc(count * sizeof(RGBA32)),
+                       .width = BENCH_SIDE,
+                       .height = BENCH_SIDE};
+  Framebuffer tiled = whole;
+  tiled.pixels = malloc(count * sizeof(RGBA32));
+  NOB_ASSERT(whole.pixels != NULL && tiled.pixels != NULL);
+
+  // Symmetric under both mirrors and the swap
+  const char *symmetric = "triple(add(abs(x), abs(y)), mult(mult(x, x), "
+                          "mult(y, y)), cos(add(mult(x, y), mult(y, x))))";
+  Node *trees[] = {
+      gen_tree(3, BENCH_DEPTH),
+      gen_tree(11, BENCH_DEPTH),
+      parse_expr("<symmetric>", sv_from_cstr(symmetric)),
+  };
+  bool ok = true;
+  for (size_t i = 0; i < ARRAY_LEN(trees); ++i) {
+    if (trees[i] == NULL)
+      return 1;
+    printf("tree %zu: %zu nodes\n", i, node_count(trees[i]));
+    for (size_t k = 0; k < ARRAY_LEN(bench_cases); ++k) {
+      const Bench_Case *c = &bench_cases[k];
+      double start = now_secs();
+      if (!bench_render(trees[i], &whole, c, &c->opts))
+        return 1;
+      double single = now_secs() - start;
+      memset(tiled.pixels, 0, count * sizeof(RGBA32));
+      bool rendered = true;
+      double tiles = bench_tiles(trees[i], &tiled, c, &rendered);
+      bool same = rendered && memcmp(whole.pixels, tiled.pixels,
+                                     count * sizeof(RGBA32)) == 0;
+      ok = ok && same;
+      printf("  %-14s whole %8.1f ms, 16 tiles %8.1f ms %s\n", c->name,
+             single * 1e3, tiles * 1e3, same ? "identical" : "MISMATCH");
+    }
+  }
+  free(whole.pixels);
+  free(tiled.pixels);
+  return ok ? 0 : 1;
+}
@@ -22,6 +22,7 @@
 #ifndef ARENA_H_
 #define ARENA_H_
 
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
@@ -54,8 +55,33 @@ struct Region {
   uintptr_t data[];
 };
 
+// Lock-free stacks of free regions shared between arenas (typically one arena
+// per worker thread). Arenas attached to a pool take their regions from it
+// before falling back to new_region() and give them back on arena_free(), so
+// short-lived workers don't hit the backend allocator in steady state.
+//
+// Regions of REGION_DEFAULT_CAPACITY, nearly all of them, are popped one at a
+// time with a CAS on a head tagged with a generation counter against ABA, so
+// workers starting together each get one. Larger regions go to a second
+// stack that is searched for one that fits.
+typedef struct {
+  _Atomic(uint64_t) head;      // regions of REGION_DEFAULT_CAPACITY, tagged
+  _Atomic(Region *) oversized; // the others
+} Region_Pool;
+
+typedef struct {
+  size_t allocs;            // arena_alloc() calls
+  size_t bytes;             // bytes requested by those calls
+  size_t regions_new;       // regions obtained from new_region()
+  size_t regions_recycled;  // regions obtained from the pool
+  size_t regions_oversized; // allocations larger than REGION_DEFAULT_CAPACITY
+  size_t bytes_copied;      // moved by arena_realloc() to grow a block
+} Arena_Stats;
+
 typedef struct {
   Region *begin, *end;
+  Region_Pool *pool; // optional
+  Arena_Stats stats;
 } Arena;
 
 typedef struct {
@@ -82,6 +108,10 @@ void arena_rewind(Arena *a, Arena_Mark m);
 void arena_free(Arena *a);
 void arena_trim(Arena *a);
 
+Region *region_pool_acquire(Region_Pool *p, size_t capacity);
+void region_pool_release(Region_Pool *p, Region *first, Region *last);
+void region_pool_free(Region_Pool *p);
+
 #define ARENA_DA_INIT_CAP 256
 
 #ifdef __cplusplus
@@ -198,21 +228,149 @@ void free_region(Region *r) {
 #error "Unknown Arena backend"
 #endif
 
-// TODO: add debug statistic collection mode for arena
-// Should collect things like:
-// - How many times new_region was called
-// - How many times existing region was skipped
-// - How many times allocation exceeded REGION_DEFAULT_CAPACITY
+// The generation counter of the default stack lives in the bits of the head
+// above the pointer: the top 16 bits of a 64-bit address, which user space
+// does not use, or the upper half of the word on 32-bit targets.
+#if UINTPTR_MAX > 0xFFFFFFFFu
+#define ARENA__TAG_SHIFT 48
+#else
+#define ARENA__TAG_SHIFT 32
+#endif
+
+static inline Region *arena__untag(uint64_t head) {
+  return (Region *)(uintptr_t)(head &
+                               ((UINT64_C(1) << ARENA__TAG_SHIFT) - 1));
+}
+
+// r as the next head after head, one generation later
+static inline uint64_t arena__tag(Region *r, uint64_t head) {
+  return ((head >> ARENA__TAG_SHIFT) + 1) << ARENA__TAG_SHIFT |
+         (uint64_t)(uintptr_t)r;
+}
+
+// Default regions are popped with a CAS, made ABA-safe by the generation
+// counter: a region popped and pushed back in between changes the tag.
+// Regions are only freed by region_pool_free(), so reading r->next of a
+// region another thread just took is harmless; its CAS fails. Oversized
+// requests detach the whole oversized stack with an exchange, keep the first
+// region that fits and push the rest back.
+Region *region_pool_acquire(Region_Pool *p, size_t capacity) {
+  if (capacity <= REGION_DEFAULT_CAPACITY) {
+    uint64_t head = atomic_load(&p->head);
+    Region *r;
+    do {
+      r = arena__untag(head);
+      if (r == NULL)
+        return NULL;
+    } while (!atomic_compare_exchange_weak(&p->head, &head,
+                                           arena__tag(r->next, head)));
+    r->next = NULL;
+    r->count = 0;
+    return r;
+  }
+
+  Region *list = atomic_exchange(&p->oversized, NULL);
+  if (list == NULL)
+    return NULL;
+
+  Region *found = NULL;
+  Region *rest = NULL, *rest_last = NULL;
+  while (list) {
+    Region *r = list;
+    list = list->next;
+    if (found == NULL && r->capacity >= capacity) {
+      found = r;
+      continue;
+    }
+    r->next = rest;
+    rest = r;
+    if (rest_last == NULL)
+      rest_last = r;
+  }
+
+  if (rest)
+    region_pool_release(p, rest, rest_last);
+  if (found) {
+    found->next = NULL;
+    found->count = 0;
+  }
+  return found;
+}
+
+// Pushes the chain first..last (linked through Region.next) onto the pool,
+// each region on the stack of its capacity.
+void region_pool_release(Region_Pool *p, Region *first, Region *last) {
+  Region *defaults = NULL, *defaults_last = NULL;
+  Region *others = NULL, *others_last = NULL;
+  Region *end = last->next;
+  for (Region *r = first, *next; r != end; r = next) {
+    next = r->next;
+    if (r->capacity == REGION_DEFAULT_CAPACITY) {
+      r->next = defaults;
+      defaults = r;
+      if (defaults_last == NULL)
+        defaults_last = r;
+    } else {
+      r->next = others;
+      others = r;
+      if (others_last == NULL)
+        others_last = r;
+    }
+  }
+
+  if (defaults) {
+    uint64_t head = atomic_load(&p->head);
+    do {
+      defaults_last->next = arena__untag(head);
+    } while (!atomic_compare_exchange_weak(&p->head, &head,
+                                           arena__tag(defaults, head)));
+  }
+  if (others) {
+    Region *head = atomic_load(&p->oversized);
+    do {
+      others_last->next = head;
+    } while (!atomic_compare_exchange_weak(&p->oversized, &head, others));
+  }
+}
+
+static void arena__free_regions(Region *r) {
+  while (r) {
+    Region *r0 = r;
+    r = r->next;
+    free_region(r0);
+  }
+}
+
+void region_pool_free(Region_Pool *p) {
+  arena__free_regions(arena__untag(atomic_exchange(&p->head, 0)));
+  arena__free_regions(atomic_exchange(&p->oversized, NULL));
+}
+
+static Region *arena__new_region(Arena *a, size_t size) {
+  size_t capacity = REGION_DEFAULT_CAPACITY;
+  if (capacity < size) {
+    capacity = size;
+    a->stats.regions_oversized += 1;
+  }
+  if (a->pool) {
+    Region *r = region_pool_acquire(a->pool, capacity);
+    if (r) {
+      a->stats.regions_recycled += 1;
+      return r;
+    }
+  }
+  a->stats.regions_new += 1;
+  return new_region(capacity);
+}
 
 void *arena_alloc(Arena *a, size_t size_bytes) {
   size_t size = (size_bytes + sizeof(uintptr_t) - 1) / sizeof(uintptr_t);
+  a->stats.allocs += 1;
+  a->stats.bytes += size_bytes;
 
   if (a->end == NULL) {
     ARENA_ASSERT(a->begin == NULL);
-    size_t capacity = REGION_DEFAULT_CAPACITY;
-    if (capacity < size)
-      capacity = size;
-    a->end = new_region(capacity);
+    a->end = arena__new_region(a, size);
     a->begin = a->end;
   }
 
@@ -222,10 +380,7 @@ void *arena_alloc(Arena *a, size_t size_bytes) {
 
   if (a->end->count + size > a->end->capacity) {
     ARENA_ASSERT(a->end->next == NULL);
-    size_t capacity = REGION_DEFAULT_CAPACITY;
-    if (capacity < size)
-      capacity = size;
-    a->end->next = new_region(capacity);
+    a->end->next = arena__new_region(a, size);
     a->end = a->end->next;
   }
 
@@ -237,12 +392,37 @@ void *arena_alloc(Arena *a, size_t size_bytes) {
 void *arena_realloc(Arena *a, void *oldptr, size_t oldsz, size_t newsz) {
   if (newsz <= oldsz)
     return oldptr;
-  void *newptr = arena_alloc(a, newsz);
-  char *newptr_char = (char *)newptr;
-  char *oldptr_char = (char *)oldptr;
-  for (size_t i = 0; i < oldsz; ++i) {
-    newptr_char[i] = oldptr_char[i];
+
+  // If oldptr is the most recent allocation of the current region and the
+  // region still has room, just bump the region's count. This makes
+  // arena_da_append() grow in place instead of copying on every doubling.
+  size_t newwords = (newsz + sizeof(uintptr_t) - 1) / sizeof(uintptr_t);
+  if (oldptr != NULL && a->end != NULL) {
+    size_t oldwords = (oldsz + sizeof(uintptr_t) - 1) / sizeof(uintptr_t);
+    uintptr_t *top = &a->end->data[a->end->count];
+    if ((uintptr_t *)oldptr + oldwords == top &&
+        a->end->count - oldwords + newwords <= a->end->capacity) {
+      a->end->count += newwords - oldwords;
+      return oldptr;
+    }
+  }
+
+  void *newptr;
+  if (oldptr != NULL && newwords * 2 > REGION_DEFAULT_CAPACITY) {
+    // A growing block that spills is moved to a region with room to double
+    // once more, and the room is given back to the region: the next growth
+    // step finds the block at the top and extends it in place. Without it,
+    // blocks past REGION_DEFAULT_CAPACITY would get regions of exactly their
+    // size and be copied on every growth step.
+    newptr = arena_alloc(a, newwords * 2 * sizeof(uintptr_t));
+    a->end->count -= newwords;
+    a->stats.bytes -= newwords * 2 * sizeof(uintptr_t) - newsz;
+  } else {
+    newptr = arena_alloc(a, newsz);
   }
+  if (oldsz > 0)
+    memcpy(newptr, oldptr, oldsz);
+  a->stats.bytes_copied += oldsz;
   return newptr;
 }
 
@@ -312,6 +492,16 @@ void arena_rewind(Arena *a, Arena_Mark m) {
 }
 
 void arena_free(Arena *a) {
+  if (a->pool && a->begin) {
+    Region *last = a->begin;
+    while (last->next)
+      last = last->next;
+    region_pool_release(a->pool, a->begin, last);
+    a->begin = NULL;
+    a->end = NULL;
+    return;
+  }
+
   Region *r = a->begin;
   while (r) {
     Region *r0 = r;
@@ -324,6 +514,14 @@ void arena_free(Arena *a) {
 
 void arena_trim(Arena *a) {
   Region *r = a->end->next;
+  if (a->pool && r) {
+    Region *last = r;
+    while (last->next)
+      last = last->next;
+    region_pool_release(a->pool, r, last);
+    a->end->next = NULL;
+    return;
+  }
   while (r) {
     Region *r0 = r;
     r = r->next;
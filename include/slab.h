@@ -0,0 +1,129 @@
+// Fixed-size object allocator with per-size-class free lists.
+//
+// Unlike arena.h, individual objects can be given back with slab_free() and
+// are reused by the next slab_alloc() of the same size class, so workloads
+// that keep replacing objects run in constant memory. Objects are carved out
+// of SLAB_PAGE_SIZE pages which are only returned to the system by
+// slab_release(), all at once.
+//
+// Both slab_alloc() and slab_free() are O(1). slab_free() needs the size the
+// object was allocated with, like C23 free_sized().
+//
+// Not thread safe: use one Slab per thread.
+
+#ifndef SLAB_H_
+#define SLAB_H_
+
+#include <stddef.h>
+
+#ifndef SLAB_ASSERT
+#include <assert.h>
+#define SLAB_ASSERT assert
+#endif
+
+#define SLAB_GRANULARITY 16
+#define SLAB_CLASS_COUNT 16 // objects up to 16*16 = 256 bytes
+#define SLAB_PAGE_SIZE (64 * 1024)
+
+typedef struct Slab_Page Slab_Page;
+typedef struct Slab_Free Slab_Free;
+
+struct Slab_Free {
+  Slab_Free *next;
+};
+
+typedef struct {
+  size_t pages;                   // pages currently held
+  size_t live[SLAB_CLASS_COUNT];  // objects handed out and not freed
+  size_t reused[SLAB_CLASS_COUNT]; // allocations served from a free list
+} Slab_Stats;
+
+typedef struct {
+  Slab_Free *free[SLAB_CLASS_COUNT];
+  Slab_Page *pages;
+  char *bump, *bump_end; // unused tail of the newest page
+  Slab_Stats stats;
+} Slab;
+
+void *slab_alloc(Slab *s, size_t size);
+void slab_free(Slab *s, void *ptr, size_t size);
+void slab_release(Slab *s);
+
+#endif // SLAB_H_
+
+#ifdef SLAB_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+struct Slab_Page {
+  Slab_Page *next;
+  _Alignas(SLAB_GRANULARITY) char data[];
+};
+
+static size_t slab__class(size_t size) {
+  SLAB_ASSERT(size > 0 && size <= SLAB_GRANULARITY * SLAB_CLASS_COUNT);
+  return (size + SLAB_GRANULARITY - 1) / SLAB_GRANULARITY - 1;
+}
+
+void *slab_alloc(Slab *s, size_t size) {
+  size_t c = slab__class(size);
+
+  Slab_Free *f = s->free[c];
+  if (f) {
+    s->free[c] = f->next;
+    s->stats.live[c] += 1;
+    s->stats.reused[c] += 1;
+    return f;
+  }
+
+  size_t bytes = (c + 1) * SLAB_GRANULARITY;
+  if (s->bump == NULL || (size_t)(s->bump_end - s->bump) < bytes) {
+    // The leftover tail of the old page is smaller than this object. Split
+    // it into the largest classes that fit so it isn't lost.
+    while (s->bump && s->bump_end - s->bump >= SLAB_GRANULARITY) {
+      size_t left = (size_t)(s->bump_end - s->bump) / SLAB_GRANULARITY;
+      size_t lc = (left > SLAB_CLASS_COUNT ? SLAB_CLASS_COUNT : left) - 1;
+      Slab_Free *tail = (Slab_Free *)s->bump;
+      tail->next = s->free[lc];
+      s->free[lc] = tail;
+      s->bump += (lc + 1) * SLAB_GRANULARITY;
+    }
+
+    Slab_Page *page = malloc(sizeof(Slab_Page) + SLAB_PAGE_SIZE);
+    SLAB_ASSERT(page != NULL);
+    page->next = s->pages;
+    s->pages = page;
+    s->bump = page->data;
+    s->bump_end = page->data + SLAB_PAGE_SIZE;
+    s->stats.pages += 1;
+  }
+
+  void *result = s->bump;
+  s->bump += bytes;
+  s->stats.live[c] += 1;
+  return result;
+}
+
+void slab_free(Slab *s, void *ptr, size_t size) {
+  if (ptr == NULL)
+    return;
+  size_t c = slab__class(size);
+  Slab_Free *f = ptr;
+  f->next = s->free[c];
+  s->free[c] = f;
+  SLAB_ASSERT(s->stats.live[c] > 0);
+  s->stats.live[c] -= 1;
+}
+
+void slab_release(Slab *s) {
+  Slab_Page *page = s->pages;
+  while (page) {
+    Slab_Page *next = page->next;
+    free(page);
+    page = next;
+  }
+  memset(s, 0, sizeof(*s));
+}
+
+#endif // SLAB_IMPLEMENTATION
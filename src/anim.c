@@ -0,0 +1,372 @@
+#define NOB_STRIP_PREFIX
+
+#include "anim.h"
+#include "image.h"
+#include "nob.h"
+#include "quantize.h"
+#include "render.h"
+#include "trace.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ANIM_DEFAULT_BATCH 8
+#define ANIM_DEFAULT_CACHE_MB 256
+#define ANIM_NO_SLOT SIZE_MAX
+
+static Region_Pool region_pool = {0};
+
+typedef enum {
+  ANIM_KEEP,  // a constant or t itself, used as is
+  ANIM_HOIST, // t-invariant subtree, evaluated once per pixel
+  ANIM_COPY,  // depends on t, copied with the values of its operands
+} Anim_Op;
+
+typedef struct {
+  Anim_Op op;
+  Node *expr;
+  size_t operands[3]; // indices of earlier entries, for ANIM_COPY
+  size_t slot;        // in the values of a pixel in the cache, or ANIM_NO_SLOT
+} Anim_Entry;
+
+// The tree in postorder, with every t-invariant subtree collapsed into one
+// ANIM_HOIST entry. The last entry is the root.
+typedef struct {
+  Anim_Entry *items;
+  size_t count;
+  size_t capacity;
+  size_t slots; // hoisted entries other than x and y
+} Anim_Plan;
+
+// A hoisted value kept from the first batch for the next ones: a number, a
+// bool or a triple of them
+typedef struct {
+  uint8_t kind;     // NK_NUMBER, NK_BOOL, NK_TRIPLE or ANIM_UNCACHED
+  uint8_t kinds[3]; // of the members of a triple
+  float v[3];
+} Anim_Value;
+
+#define ANIM_UNCACHED 0xff // anything else, evaluated again
+
+typedef struct {
+  const Anim_Options *opts;
+  const Anim_Plan *plan;
+  Framebuffer *fbs; // one per frame of the batch
+  int first_frame;
+  int batch_frames;
+  // plan->slots values per pixel, row by row, NULL when they do not fit in
+  // the budget; filled in by the first batch and read by the next ones
+  Anim_Value *cache;
+  bool cache_filled;
+  atomic_int next_row;
+  atomic_int next_frame;
+  atomic_bool failed;
+} Anim_Job;
+
+// Appends the entries of the subtree at node and returns whether it depends
+// on t. *index is the entry of node itself.
+static bool anim_plan(Anim_Plan *plan, Node *node, size_t *index) {
+  size_t start = plan->count;
+  Anim_Entry entry = {.op = ANIM_COPY, .expr = node};
+  Node *children[3];
+  size_t n = node_children(node, children);
+  bool depends = node->kind == NK_T;
+  for (size_t i = 0; i < n; ++i) {
+    if (anim_plan(plan, children[i], &entry.operands[i]))
+      depends = true;
+  }
+
+  entry.slot = ANIM_NO_SLOT;
+  if (node->kind == NK_X || node->kind == NK_Y) {
+    entry.op = ANIM_HOIST;
+  } else if (n == 0) {
+    entry.op = ANIM_KEEP;
+  } else if (!depends) {
+    // The subtrees were appended before it was known that node is hoisted
+    for (size_t i = start; i < plan->count; ++i) {
+      if (plan->items[i].slot != ANIM_NO_SLOT)
+        plan->slots -= 1;
+    }
+    plan->count = start;
+    entry.op = ANIM_HOIST;
+    entry.slot = plan->slots++;
+  }
+  da_append(plan, entry);
+  *index = plan->count - 1;
+  return depends;
+}
+
+static float anim_t(const Anim_Options *opts, int frame) {
+  return opts->t0 + (opts->t1 - opts->t0) * frame / opts->frames;
+}
+
+static bool anim_scalar(Node *node, uint8_t *kind, float *v) {
+  *kind = (uint8_t)node->kind;
+  if (node->kind == NK_NUMBER)
+    *v = node->as.number;
+  else if (node->kind == NK_BOOL)
+    *v = node->as.boolean ? 1.0f : 0.0f;
+  else
+    return false;
+  return true;
+}
+
+static void anim_store(Anim_Value *value, Node *node) {
+  bool ok;
+  if (node->kind == NK_TRIPLE) {
+    Node *members[3];
+    node_children(node, members);
+    ok = true;
+    for (int k = 0; k < 3; ++k)
+      ok = ok && anim_scalar(members[k], &value->kinds[k], &value->v[k]);
+    value->kind = NK_TRIPLE;
+  } else {
+    ok = anim_scalar(node, &value->kind, &value->v[0]);
+  }
+  if (!ok)
+    value->kind = ANIM_UNCACHED;
+}
+
+// The node eval() gave for a value anim_store() kept
+static Node *anim_load(const Anim_Value *value, const Node *expr) {
+  Node *members[3];
+  int count = value->kind == NK_TRIPLE ? 3 : 1;
+  for (int k = 0; k < count; ++k) {
+    uint8_t kind = count == 3 ? value->kinds[k] : value->kind;
+    members[k] =
+        kind == NK_BOOL
+            ? node_boolean_loc(expr->file, expr->line, value->v[k] != 0.0f)
+            : node_number_loc(expr->file, expr->line, value->v[k]);
+  }
+  if (count == 1)
+    return members[0];
+  return node_triple_loc(expr->file, expr->line, members[0], members[1],
+                         members[2]);
+}
+
+// Fills values with the entries of the plan at pixel (x, y); the last one is
+// the residual tree, in which only the parts depending on t are left. With
+// cached set, the hoisted values of the pixel are stored there, or read from
+// there when filled is.
+static bool anim_residual(const Anim_Plan *plan, Node **values, float x,
+                          float y, Anim_Value *cached, bool filled) {
+  for (size_t i = 0; i < plan->count; ++i) {
+    const Anim_Entry *e = &plan->items[i];
+    switch (e->op) {
+    case ANIM_KEEP:
+      values[i] = e->expr;
+      break;
+    case ANIM_HOIST: {
+      Anim_Value *value =
+          cached && e->slot != ANIM_NO_SLOT ? &cached[e->slot] : NULL;
+      if (value && filled && value->kind != ANIM_UNCACHED) {
+        values[i] = anim_load(value, e->expr);
+        break;
+      }
+      values[i] = eval(e->expr, x, y, 0.0f);
+      if (values[i] == NULL)
+        return false;
+      if (value && !filled)
+        anim_store(value, values[i]);
+      break;
+    }
+    case ANIM_COPY: {
+      Node *copy = arena_alloc(scratch_arena, sizeof(Node));
+      *copy = *e->expr;
+      copy->refs = 0;
+      Node *children[3];
+      size_t n = node_children(copy, children);
+      for (size_t j = 0; j < n; ++j)
+        children[j] = values[e->operands[j]];
+      node_set_children(copy, children);
+      values[i] = copy;
+      break;
+    }
+    }
+  }
+  return true;
+}
+
+// planes holds the red, green and blue rows of every frame of the batch
+static bool anim_row(Anim_Job *job, int y, float *planes, Node **values) {
+  const Anim_Options *opts = job->opts;
+  int width = opts->width;
+  // The whole image of the default viewport, as render_pixels() maps it
+  Render_Viewport view = {.width = width, .height = opts->height, .scale = 1};
+  float ny = viewport_y(&view, (float)y);
+  for (int x = 0; x < width; ++x) {
+    float nx = viewport_x(&view, (float)x);
+    Arena_Mark pixel_mark = arena_snapshot(scratch_arena);
+    Anim_Value *cached =
+        job->cache ? job->cache + ((size_t)y * width + x) * job->plan->slots
+                   : NULL;
+    if (!anim_residual(job->plan, values, nx, ny, cached, job->cache_filled))
+      return false;
+    Node *residual = values[job->plan->count - 1];
+    Arena_Mark frame_mark = arena_snapshot(scratch_arena);
+    for (int i = 0; i < job->batch_frames; ++i) {
+      Color c;
+      float t = anim_t(opts, job->first_frame + i);
+      if (!eval_func(residual, nx, ny, t, &c))
+        return false;
+      arena_rewind(scratch_arena, frame_mark);
+      float *row = planes + (size_t)i * 3 * width;
+      row[x] = c.r;
+      row[width + x] = c.g;
+      row[2 * width + x] = c.b;
+    }
+    arena_rewind(scratch_arena, pixel_mark);
+  }
+
+  for (int i = 0; i < job->batch_frames; ++i) {
+    float *row = planes + (size_t)i * 3 * width;
+    quantize_row(row, row + width, row + 2 * width,
+                 framebuffer_row(&job->fbs[i], y), width, 0, y, opts->dither);
+  }
+  return true;
+}
+
+static void *anim_render_worker(void *arg) {
+  Anim_Job *job = arg;
+  Arena arena = {.pool = &region_pool};
+  scratch_arena = &arena;
+  // Allocated before any per-pixel snapshot, so rewinding keeps them
+  float *planes = arena_alloc(&arena, (size_t)job->batch_frames * 3 *
+                                          job->opts->width * sizeof(float));
+  Node **values = arena_alloc(&arena, job->plan->count * sizeof(Node *));
+  trace_thread_name("animation worker");
+
+  while (!atomic_load(&job->failed)) {
+    int y = atomic_fetch_add(&job->next_row, 1);
+    if (y >= job->opts->height)
+      break;
+    Trace_Span span = trace_begin("animate row");
+    bool ok = anim_row(job, y, planes, values);
+    trace_end_arg(span, "y", y);
+    if (!ok) {
+      atomic_store(&job->failed, true);
+      break;
+    }
+  }
+
+  scratch_arena = NULL;
+  arena_free(&arena);
+  return NULL;
+}
+
+static void *anim_encode_worker(void *arg) {
+  Anim_Job *job = arg;
+  char path[4096];
+  while (!atomic_load(&job->failed)) {
+    int i = atomic_fetch_add(&job->next_frame, 1);
+    if (i >= job->batch_frames)
+      break;
+    snprintf(path, sizeof(path), job->opts->pattern, job->first_frame + i);
+    if (!image_write_png(&job->fbs[i], path))
+      atomic_store(&job->failed, true);
+  }
+  return NULL;
+}
+
+static bool anim_run(void *(*worker)(void *), Anim_Job *job, int threads) {
+  pthread_t *handles = calloc(threads, sizeof(*handles));
+  NOB_ASSERT(handles != NULL);
+  int started = 0;
+  for (; started < threads; ++started) {
+    if (pthread_create(&handles[started], NULL, worker, job) != 0) {
+      nob_log(ERROR, "Could not create animation worker %d", started);
+      atomic_store(&job->failed, true);
+      break;
+    }
+  }
+  for (int i = 0; i < started; ++i)
+    pthread_join(handles[i], NULL);
+  free(handles);
+  return started > 0 && !atomic_load(&job->failed);
+}
+
+bool render_animation(Node *f, const Anim_Options *opts) {
+  NOB_ASSERT(opts->frames > 0 && opts->width > 0 && opts->height > 0);
+  Trace_Span span = trace_begin("render_animation");
+#ifdef RANDOMART_PROFILE
+  nob_log(WARNING, "The profiler does not cover animations, no report");
+#endif
+  int batch = opts->batch > 0 ? opts->batch : ANIM_DEFAULT_BATCH;
+  if (batch > opts->frames)
+    batch = opts->frames;
+  int threads = opts->threads > 0 ? opts->threads : cpu_count();
+
+  Anim_Plan plan = {0};
+  size_t root;
+  anim_plan(&plan, f, &root);
+  size_t hoisted = 0, per_frame = 0;
+  for (size_t i = 0; i < plan.count; ++i) {
+    if (plan.items[i].op == ANIM_HOIST)
+      hoisted += node_count(plan.items[i].expr);
+    else
+      per_frame += 1;
+  }
+
+  // Without room for the hoisted values of every pixel, each batch
+  // evaluates them again
+  Anim_Value *cache = NULL;
+  size_t cache_bytes = (size_t)opts->width * opts->height * plan.slots *
+                       sizeof(Anim_Value);
+  size_t budget_mb = opts->cache_mb > 0 ? opts->cache_mb
+                                        : ANIM_DEFAULT_CACHE_MB;
+  if (batch < opts->frames && plan.slots > 0 &&
+      cache_bytes <= (budget_mb << 20)) {
+    cache = malloc(cache_bytes);
+    NOB_ASSERT(cache != NULL);
+  }
+  if (cache || batch == opts->frames)
+    nob_log(INFO,
+            "Animation: %zu nodes evaluated once per pixel, %zu per frame",
+            hoisted, per_frame);
+  else
+    nob_log(INFO,
+            "Animation: %zu nodes evaluated once per pixel per batch of %d "
+            "frames (%zu MB to keep them over %zu MB), %zu per frame",
+            hoisted, batch, (cache_bytes + (1 << 20) - 1) >> 20, budget_mb,
+            per_frame);
+
+  Framebuffer *fbs = calloc(batch, sizeof(*fbs));
+  NOB_ASSERT(fbs != NULL);
+  for (int i = 0; i < batch; ++i) {
+    fbs[i].width = opts->width;
+    fbs[i].height = opts->height;
+    fbs[i].pixels =
+        malloc((size_t)opts->width * opts->height * sizeof(RGBA32));
+    NOB_ASSERT(fbs[i].pixels != NULL);
+  }
+
+  bool ok = true;
+  for (int first = 0; ok && first < opts->frames; first += batch) {
+    Anim_Job job = {
+        .opts = opts,
+        .plan = &plan,
+        .fbs = fbs,
+        .first_frame = first,
+        .batch_frames = opts->frames - first < batch ? opts->frames - first
+                                                     : batch,
+        .cache = cache,
+        .cache_filled = first > 0,
+    };
+    ok = anim_run(anim_render_worker, &job, threads);
+    if (ok && opts->stream) {
+      for (int i = 0; ok && i < job.batch_frames; ++i)
+        ok = stream_push(opts->stream, &fbs[i]);
+    } else if (ok) {
+      ok = anim_run(anim_encode_worker, &job, threads);
+    }
+  }
+
+  for (int i = 0; i < batch; ++i)
+    free(fbs[i].pixels);
+  free(fbs);
+  free(cache);
+  free(plan.items);
+  trace_end(span);
+  return ok;
+}
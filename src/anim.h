@@ -0,0 +1,32 @@
+#ifndef ANIM_H_
+#define ANIM_H_
+
+#include "node.h"
+#include "stream.h"
+#include <stdbool.h>
+
+// Renders a sequence of frames of an expression over NK_T and writes them as
+// numbered PNG files, or pushes them in order to a Stream.
+//
+// Everything in the tree that does not depend on t is hoisted out of the frame
+// loop: for every pixel the maximal t-invariant subtrees are evaluated once,
+// their results are substituted into a copy of the rest of the tree, and only
+// that residual tree is evaluated per frame. The first batch of frames keeps
+// those results for every pixel, 16 bytes per subtree, for the next batches;
+// when that does not fit in cache_mb each batch evaluates them again. Workers
+// share the rows of a batch, then encode the batch in parallel.
+typedef struct {
+  int frames;          // frame i is rendered at t0 + (t1 - t0) * i / frames
+  float t0, t1;        // t1 is excluded so that a 0..1 loop repeats cleanly
+  int width, height;
+  int threads;         // 0 means one worker per CPU
+  int batch;           // frames rendered together, 0 for the default of 8
+  size_t cache_mb;     // for the hoisted values, 0 for the default of 256
+  bool dither;         // see quantize_row()
+  const char *pattern; // printf() pattern of the output paths, with one %d
+  Stream *stream;      // when set, frames go there instead of PNG files
+} Anim_Options;
+
+bool render_animation(Node *f, const Anim_Options *opts);
+
+#endif // ANIM_H_
@@ -0,0 +1,793 @@
+#define NOB_STRIP_PREFIX
+
+#include "bintree.h"
+#include "fastmath.h"
+#include "arena.h"
+#include "profile.h"
+#include <inttypes.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define BINTREE_MAGIC "RART"
+#define BINTREE_HEADER_SIZE 16
+#define BINTREE_INDEX_ENTRY_SIZE 16
+
+#define BINTREE_KIND_MASK 0x1f
+#define BINTREE_TYPE_SHIFT 5
+#define BINTREE_SAVE 0x80
+
+typedef enum {
+  TYPE_NUMBER,
+  TYPE_BOOL,
+  TYPE_TRIPLE,
+} Bintree_Type;
+
+static const size_t type_width[] = {
+    [TYPE_NUMBER] = 1,
+    [TYPE_BOOL] = 1,
+    [TYPE_TRIPLE] = 3,
+};
+
+static const char *type_names[] = {
+    [TYPE_NUMBER] = "number",
+    [TYPE_BOOL] = "boolean",
+    [TYPE_TRIPLE] = "triple",
+};
+
+static void put_u32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; ++i)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void put_u64(uint8_t *p, uint64_t v) {
+  for (int i = 0; i < 8; ++i)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+  return (uint64_t)get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+static float get_f32(const uint8_t *p) {
+  uint32_t bits = get_u32(p);
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// The operand types of every kind and the type of its value. if has the
+// type of its branches, which is not known from the kind alone.
+static bool kind_signature(Node_Kind kind, size_t *arity,
+                           Bintree_Type operands[3], Bintree_Type *result) {
+  *result = TYPE_NUMBER;
+  switch (kind) {
+  case NK_X:
+  case NK_Y:
+  case NK_T:
+  case NK_NUMBER:
+    *arity = 0;
+    return true;
+  case NK_BOOL:
+    *arity = 0;
+    *result = TYPE_BOOL;
+    return true;
+  case NK_SIN:
+  case NK_COS:
+  case NK_EXP:
+  case NK_SQRT:
+  case NK_ABS:
+    *arity = 1;
+    operands[0] = TYPE_NUMBER;
+    return true;
+  case NK_ADD:
+  case NK_MULT:
+  case NK_MOD:
+  case NK_ATAN2:
+  case NK_MIN:
+  case NK_MAX:
+  case NK_GT:
+    *arity = 2;
+    operands[0] = operands[1] = TYPE_NUMBER;
+    if (kind == NK_GT)
+      *result = TYPE_BOOL;
+    return true;
+  case NK_TRIPLE:
+    *arity = 3;
+    operands[0] = operands[1] = operands[2] = TYPE_NUMBER;
+    *result = TYPE_TRIPLE;
+    return true;
+  case NK_IF:
+    *arity = 3;
+    operands[0] = TYPE_BOOL;
+    return true;
+  }
+  return false;
+}
+
+// Shared subtrees: how often each node is used, and once written, the slot
+// its value is saved in
+typedef struct {
+  Node *node;
+  uint32_t uses;
+  int32_t slot; // -1 until written
+  Bintree_Type type;
+} Use_Entry;
+
+typedef struct {
+  Use_Entry *items; // open addressing hash table keyed by node
+  size_t count;
+  size_t capacity;
+} Use_Table;
+
+static Use_Entry *use_entry(Use_Table *t, Node *node) {
+  if ((t->count + 1) * 2 > t->capacity) {
+    Use_Table old = *t;
+    t->capacity = old.capacity ? old.capacity * 2 : 256;
+    t->items = calloc(t->capacity, sizeof(*t->items));
+    NOB_ASSERT(t->items != NULL);
+    t->count = 0;
+    for (size_t i = 0; i < old.capacity; ++i) {
+      if (old.items[i].node)
+        *use_entry(t, old.items[i].node) = old.items[i];
+    }
+    free(old.items);
+  }
+  uint64_t h = (uint64_t)(uintptr_t)node * 0x9e3779b97f4a7c15ull;
+  size_t i = (size_t)(h >> 32) & (t->capacity - 1);
+  while (t->items[i].node != node) {
+    if (t->items[i].node == NULL) {
+      t->items[i] = (Use_Entry){.node = node, .slot = -1};
+      t->count += 1;
+      break;
+    }
+    i = (i + 1) & (t->capacity - 1);
+  }
+  return &t->items[i];
+}
+
+static void count_uses(Use_Table *uses, Arena *arena, Node *tree) {
+  struct {
+    Node **items;
+    size_t count;
+    size_t capacity;
+  } todo = {0};
+  arena_da_append(arena, &todo, tree);
+  while (todo.count > 0) {
+    Node *node = todo.items[--todo.count];
+    if (use_entry(uses, node)->uses++ > 0)
+      continue;
+    Node *children[3];
+    size_t n = node_children(node, children);
+    for (size_t i = 0; i < n; ++i)
+      arena_da_append(arena, &todo, children[i]);
+  }
+}
+
+static void put_varint(String_Builder *out, uint64_t v) {
+  do {
+    uint8_t byte = v & 0x7f;
+    v >>= 7;
+    da_append(out, (char)(byte | (v ? 0x80 : 0)));
+  } while (v);
+}
+
+bool bintree_encode(Node *tree, bool share, String_Builder *out) {
+  Arena arena = {0};
+  Use_Table uses = {0};
+  if (share)
+    count_uses(&uses, &arena, tree);
+  struct {
+    Eval_Frame *items;
+    size_t count;
+    size_t capacity;
+  } frames = {0};
+  struct {
+    Bintree_Type *items;
+    size_t count;
+    size_t capacity;
+  } types = {0};
+  int32_t slots = 0;
+  bool ok = true;
+
+  arena_da_append(&arena, &frames, ((Eval_Frame){.expr = tree}));
+  while (ok && frames.count > 0) {
+    Eval_Frame *top = &frames.items[frames.count - 1];
+    Node *node = top->expr;
+    Use_Entry *use = share ? use_entry(&uses, node) : NULL;
+    if (top->next == 0 && use && use->slot >= 0) {
+      da_append(out, (char)(BINTREE_REF | use->type << BINTREE_TYPE_SHIFT));
+      put_varint(out, (uint64_t)use->slot);
+      arena_da_append(&arena, &types, use->type);
+      frames.count -= 1;
+      continue;
+    }
+    Node *children[3];
+    size_t n = node_children(node, children);
+    if (top->next < n) {
+      Eval_Frame frame = {.expr = children[top->next++]};
+      arena_da_append(&arena, &frames, frame);
+      continue;
+    }
+
+    size_t arity = 0;
+    Bintree_Type want[3] = {0}, type = TYPE_NUMBER;
+    if (!kind_signature(node->kind, &arity, want, &type))
+      UNREACHABLE("kind_signature");
+    Bintree_Type *got = types.items + types.count - arity;
+    if (node->kind == NK_IF) {
+      want[1] = want[2] = type = got[1];
+    }
+    for (size_t i = 0; i < arity; ++i) {
+      if (got[i] != want[i]) {
+        nob_log(ERROR, "%s:%d: operand %zu of %s is a %s, expected a %s",
+                node->file, node->line, i + 1, node_kind_name(node->kind),
+                type_names[got[i]], type_names[want[i]]);
+        ok = false;
+      }
+    }
+    types.count -= arity;
+    arena_da_append(&arena, &types, type);
+
+    uint8_t byte = (uint8_t)(node->kind | type << BINTREE_TYPE_SHIFT);
+    if (use && use->uses > 1) {
+      byte |= BINTREE_SAVE;
+      use->slot = slots++;
+      use->type = type;
+    }
+    da_append(out, (char)byte);
+    if (node->kind == NK_NUMBER) {
+      uint32_t bits;
+      memcpy(&bits, &node->as.number, sizeof(bits));
+      uint8_t le[4];
+      put_u32(le, bits);
+      da_append_many(out, (char *)le, sizeof(le));
+    } else if (node->kind == NK_BOOL) {
+      da_append(out, (char)node->as.boolean);
+    }
+    frames.count -= 1;
+  }
+  if (ok && types.items[0] != TYPE_TRIPLE) {
+    nob_log(ERROR, "%s:%d: the tree is a %s, expected a triple", tree->file,
+            tree->line, type_names[types.items[0]]);
+    ok = false;
+  }
+
+  free(uses.items);
+  arena_free(&arena);
+  return ok;
+}
+
+bool bintree_write_file(const char *path, Node *const *trees, size_t count) {
+  String_Builder code = {0};
+  String_Builder file = {0};
+  size_t index_size = count * BINTREE_INDEX_ENTRY_SIZE;
+  uint8_t *index = malloc(index_size ? index_size : 1);
+  NOB_ASSERT(index != NULL);
+  bool ok = true;
+  for (size_t i = 0; ok && i < count; ++i) {
+    size_t start = code.count;
+    ok = bintree_encode(trees[i], true, &code);
+    put_u64(index + i * BINTREE_INDEX_ENTRY_SIZE,
+            BINTREE_HEADER_SIZE + index_size + start);
+    put_u64(index + i * BINTREE_INDEX_ENTRY_SIZE + 8, code.count - start);
+  }
+  if (ok) {
+    uint8_t header[BINTREE_HEADER_SIZE] = {0};
+    memcpy(header, BINTREE_MAGIC, 4);
+    header[4] = BINTREE_VERSION;
+    put_u32(header + 8, (uint32_t)count);
+    da_append_many(&file, (char *)header, sizeof(header));
+    da_append_many(&file, (char *)index, index_size);
+    da_append_many(&file, code.items, code.count);
+    ok = write_entire_file(path, file.items, file.count);
+  }
+  free(index);
+  free(code.items);
+  free(file.items);
+  return ok;
+}
+
+static bool read_varint(const uint8_t **p, const uint8_t *end, uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (*p >= end)
+      return false;
+    uint8_t byte = *(*p)++;
+    *v |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool bintree_load(const uint8_t *code, size_t size, Bintree *t) {
+  *t = (Bintree){.code = code, .size = size};
+  struct {
+    uint8_t *items;
+    size_t count;
+    size_t capacity;
+  } types = {0}, saved = {0};
+  size_t depth = 0;
+  const uint8_t *p = code, *end = code + size;
+  // Static strings, since this can run on any thread
+  const char *error = NULL;
+  size_t offset = 0;
+
+  while (p < end && error == NULL) {
+    offset = p - code;
+    uint8_t byte = *p++;
+    unsigned kind = byte & BINTREE_KIND_MASK;
+    unsigned type = (byte >> BINTREE_TYPE_SHIFT) & 3;
+    if (type > TYPE_TRIPLE) {
+      error = "bad type";
+      break;
+    }
+    if (kind == BINTREE_REF) {
+      uint64_t slot;
+      if (!read_varint(&p, end, &slot) || slot >= saved.count ||
+          saved.items[slot] != type) {
+        error = "bad reference";
+        break;
+      }
+    } else {
+      size_t arity;
+      Bintree_Type want[3], result;
+      if (kind >= COUNT_NK ||
+          !kind_signature((Node_Kind)kind, &arity, want, &result)) {
+        error = "unknown kind";
+        break;
+      }
+      if (kind == NK_IF)
+        want[1] = want[2] = result = type;
+      if (types.count < arity) {
+        error = "missing operands";
+        break;
+      }
+      for (size_t i = 0; i < arity; ++i) {
+        if (types.items[types.count - arity + i] != want[i])
+          error = "operand of the wrong type";
+        depth -= type_width[want[i]];
+      }
+      if (result != type)
+        error = "wrong type";
+      types.count -= arity;
+      size_t payload = kind == NK_NUMBER ? 4 : kind == NK_BOOL ? 1 : 0;
+      if ((size_t)(end - p) < payload)
+        error = "truncated record";
+      p += payload;
+    }
+    if (error)
+      break;
+    da_append(&types, (uint8_t)type);
+    depth += type_width[type];
+    if (depth > t->max_stack)
+      t->max_stack = depth;
+    if (byte & BINTREE_SAVE)
+      da_append(&saved, (uint8_t)type);
+    t->nodes += 1;
+  }
+  if (error == NULL && (types.count != 1 || types.items[0] != TYPE_TRIPLE)) {
+    error = "the records do not form one triple";
+    offset = size;
+  }
+  t->saves = saved.count;
+  free(types.items);
+  free(saved.items);
+  if (error) {
+    nob_log(ERROR, "Invalid binary tree: %s at byte %zu", error, offset);
+    return false;
+  }
+  return true;
+}
+
+bool bintree_is_file(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return false;
+  char magic[4];
+  bool is = fread(magic, 1, 4, f) == 4 && memcmp(magic, BINTREE_MAGIC, 4) == 0;
+  fclose(f);
+  return is;
+}
+
+// Checks the header of f->data and sets f->count
+static bool bintree_read_header(Bintree_File *f, const char *name) {
+  if (f->size < BINTREE_HEADER_SIZE ||
+      memcmp(f->data, BINTREE_MAGIC, 4) != 0) {
+    nob_log(ERROR, "%s is not a binary tree file", name);
+    return false;
+  }
+  unsigned version = f->data[4] | f->data[5] << 8;
+  if (version != BINTREE_VERSION) {
+    nob_log(ERROR, "%s: unsupported version %u", name, version);
+    return false;
+  }
+  f->count = get_u32(f->data + 8);
+  if ((f->size - BINTREE_HEADER_SIZE) / BINTREE_INDEX_ENTRY_SIZE < f->count) {
+    nob_log(ERROR, "%s: truncated index", name);
+    return false;
+  }
+  return true;
+}
+
+bool bintree_open(Bintree_File *f, const char *path) {
+  *f = (Bintree_File){0};
+#ifdef _WIN32
+  String_Builder sb = {0};
+  if (!read_entire_file(path, &sb))
+    return false;
+  f->data = (const uint8_t *)sb.items;
+  f->size = sb.count;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    nob_log(ERROR, "Could not open %s: %s", path, strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    nob_log(ERROR, "Could not read %s", path);
+    close(fd);
+    return false;
+  }
+  void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    nob_log(ERROR, "Could not map %s: %s", path, strerror(errno));
+    return false;
+  }
+  f->data = data;
+  f->size = (size_t)st.st_size;
+  f->mapped = true;
+#endif
+
+  if (!bintree_read_header(f, path)) {
+    bintree_close(f);
+    return false;
+  }
+  return true;
+}
+
+bool bintree_read(Bintree_File *f, const uint8_t *data, size_t size) {
+  *f = (Bintree_File){.data = data, .size = size};
+  return bintree_read_header(f, "<memory>");
+}
+
+void bintree_close(Bintree_File *f) {
+#ifndef _WIN32
+  if (f->mapped) {
+    munmap((void *)f->data, f->size);
+    *f = (Bintree_File){0};
+    return;
+  }
+#endif
+  free((void *)f->data);
+  *f = (Bintree_File){0};
+}
+
+bool bintree_get(const Bintree_File *f, size_t index, Bintree *t) {
+  if (index >= f->count) {
+    nob_log(ERROR, "Tree %zu out of range, the file has %u", index, f->count);
+    return false;
+  }
+  const uint8_t *entry =
+      f->data + BINTREE_HEADER_SIZE + index * BINTREE_INDEX_ENTRY_SIZE;
+  uint64_t offset = get_u64(entry);
+  uint64_t size = get_u64(entry + 8);
+  if (offset > f->size || size > f->size - offset) {
+    nob_log(ERROR, "Tree %zu lies outside of the file", index);
+    return false;
+  }
+  return bintree_load(f->data + offset, (size_t)size, t);
+}
+
+#ifdef RANDOMART_PROFILE
+// Floats of the value stack and of the reused values. Profiling builds keep
+// one u64 start time per value on the stack after them, 8 byte aligned.
+static size_t bintree_values_size(const Bintree *t) {
+  return (t->max_stack + 3 * t->saves + 1) & ~(size_t)1;
+}
+
+// Operands a record pops from the stack
+static size_t record_arity(unsigned kind) {
+  size_t arity = 0;
+  Bintree_Type want[3], result;
+  if (kind != BINTREE_REF)
+    kind_signature((Node_Kind)kind, &arity, want, &result);
+  return arity;
+}
+#endif
+
+size_t bintree_scratch_size(const Bintree *t) {
+#ifdef RANDOMART_PROFILE
+  return bintree_values_size(t) + 2 * t->max_stack;
+#else
+  return t->max_stack + 3 * t->saves;
+#endif
+}
+
+void bintree_eval(const Bintree *t, float x, float y, float time,
+                  float *scratch, Color *c) {
+  float *sp = scratch; // one past the top of the stack
+  float *saved = scratch + t->max_stack;
+  size_t saves = 0;
+  const uint8_t *p = t->code, *end = t->code + t->size;
+#ifdef RANDOMART_PROFILE
+  // Counted and timed like eval(), per record: the subtree of a record
+  // starts with the subtree of its first operand
+  Profile_Table *profile = profile_table;
+  bool timed = profile && profile->sampling;
+  uint64_t *starts = (uint64_t *)(scratch + bintree_values_size(t));
+  size_t values = 0;
+#endif
+  while (p < end) {
+#ifdef RANDOMART_PROFILE
+    size_t offset = (size_t)(p - t->code);
+    size_t arity = profile ? record_arity(*p & BINTREE_KIND_MASK) : 0;
+    uint64_t start = 0;
+    if (timed)
+      start = arity > 0 ? starts[values - arity] : profile_cycles();
+#endif
+    uint8_t byte = *p++;
+    size_t width = type_width[(byte >> BINTREE_TYPE_SHIFT) & 3];
+    switch (byte & BINTREE_KIND_MASK) {
+    case NK_X:
+      *sp++ = x;
+      break;
+    case NK_Y:
+      *sp++ = y;
+      break;
+    case NK_T:
+      *sp++ = time;
+      break;
+    case NK_NUMBER:
+      *sp++ = get_f32(p);
+      p += 4;
+      break;
+    case NK_BOOL:
+      *sp++ = *p++ ? 1.0f : 0.0f;
+      break;
+    case NK_ADD:
+      sp[-2] = sp[-2] + sp[-1];
+      sp -= 1;
+      break;
+    case NK_MULT:
+      sp[-2] = sp[-2] * sp[-1];
+      sp -= 1;
+      break;
+    case NK_MOD:
+      sp[-2] = math_fmodf(sp[-2], sp[-1]);
+      sp -= 1;
+      break;
+    case NK_GT:
+      sp[-2] = sp[-2] > sp[-1] ? 1.0f : 0.0f;
+      sp -= 1;
+      break;
+    case NK_ATAN2:
+      sp[-2] = math_atan2f(sp[-2], sp[-1]);
+      sp -= 1;
+      break;
+    case NK_MIN:
+      sp[-2] = math_minf(sp[-2], sp[-1]);
+      sp -= 1;
+      break;
+    case NK_MAX:
+      sp[-2] = math_maxf(sp[-2], sp[-1]);
+      sp -= 1;
+      break;
+    case NK_SIN:
+      sp[-1] = math_sinf(sp[-1]);
+      break;
+    case NK_COS:
+      sp[-1] = math_cosf(sp[-1]);
+      break;
+    case NK_EXP:
+      sp[-1] = math_expf(sp[-1]);
+      break;
+    case NK_SQRT:
+      sp[-1] = math_sqrtf(sp[-1]);
+      break;
+    case NK_ABS:
+      sp[-1] = fabsf(sp[-1]);
+      break;
+    case NK_TRIPLE:
+      break; // the three numbers are already in place
+    case NK_IF: {
+      float *cond = sp - 1 - 2 * width;
+      const float *chosen = *cond != 0.0f ? cond + 1 : cond + 1 + width;
+      memmove(cond, chosen, width * sizeof(float));
+      sp = cond + width;
+      break;
+    }
+    case BINTREE_REF: {
+      uint64_t slot;
+      read_varint(&p, end, &slot);
+      memcpy(sp, saved + 3 * slot, width * sizeof(float));
+      sp += width;
+      break;
+    }
+    }
+    if (byte & BINTREE_SAVE)
+      memcpy(saved + 3 * saves++, sp - width, width * sizeof(float));
+#ifdef RANDOMART_PROFILE
+    if (profile) {
+      Profile_Entry *e = profile_entry(profile, profile_record_key(offset));
+      e->count += 1;
+      values -= arity;
+      if (timed) {
+        e->cycles += profile_cycles() - start;
+        e->samples += 1;
+        starts[values] = start;
+      }
+      values += 1;
+    }
+#endif
+  }
+  c->r = scratch[0];
+  c->g = scratch[1];
+  c->b = scratch[2];
+}
+
+Node *bintree_to_node(const Bintree *t) {
+  Node **stack = malloc((t->nodes + 1) * sizeof(Node *));
+  Node **saved = malloc((t->saves + 1) * sizeof(Node *));
+  NOB_ASSERT(stack != NULL && saved != NULL);
+  size_t count = 0, saves = 0;
+  int record = 0;
+  const uint8_t *p = t->code, *end = t->code + t->size;
+  while (p < end) {
+    uint8_t byte = *p++;
+    unsigned kind = byte & BINTREE_KIND_MASK;
+    record += 1;
+    Node *node;
+    if (kind == BINTREE_REF) {
+      uint64_t slot;
+      read_varint(&p, end, &slot);
+      node = saved[slot];
+    } else if (kind == NK_NUMBER) {
+      node = node_number_loc("<binary>", record, get_f32(p));
+      p += 4;
+    } else if (kind == NK_BOOL) {
+      node = node_boolean_loc("<binary>", record, *p++ != 0);
+    } else {
+      node = node_loc("<binary>", record, (Node_Kind)kind);
+      size_t arity = 0;
+      Bintree_Type want[3], result;
+      kind_signature((Node_Kind)kind, &arity, want, &result);
+      count -= arity;
+      node_set_children(node, stack + count);
+    }
+    stack[count++] = node;
+    if (byte & BINTREE_SAVE)
+      saved[saves++] = node;
+  }
+  Node *root = stack[0];
+  free(stack);
+  free(saved);
+  return root;
+}
+
+#ifdef RANDOMART_PROFILE
+typedef struct {
+  size_t offset;
+  unsigned kind; // BINTREE_REF for references
+  size_t operands[3];
+  size_t arity;
+  double self; // estimated cycles over the whole render
+  uint64_t count;
+} Bintree_Profile_Record;
+
+static const char *record_kind_name(unsigned kind) {
+  return kind == BINTREE_REF ? "ref" : node_kind_name((Node_Kind)kind);
+}
+
+static void bintree_profile_folded(const Bintree_Profile_Record *records,
+                                   size_t i, String_Builder *path) {
+  const Bintree_Profile_Record *r = &records[i];
+  size_t mark = path->count;
+  if (mark > 0)
+    da_append(path, ';');
+  sb_append_cstr(path,
+                 temp_sprintf("%s@%zu", record_kind_name(r->kind), r->offset));
+  if (r->self >= 1.0)
+    fprintf(stderr, "%.*s %.0f\n", (int)path->count, path->items, r->self);
+  for (size_t k = 0; k < r->arity; ++k)
+    bintree_profile_folded(records, r->operands[k], path);
+  path->count = mark;
+}
+
+void bintree_profile_report(const Bintree *t, const Profile_Table *profile) {
+  size_t temp = temp_save();
+  Bintree_Profile_Record *records = calloc(t->nodes, sizeof(*records));
+  size_t *stack = malloc(t->nodes * sizeof(*stack));
+  NOB_ASSERT(records != NULL && stack != NULL);
+
+  // The operands of every record, by replaying the stack of the evaluation
+  size_t count = 0, depth = 0;
+  const uint8_t *p = t->code, *end = t->code + t->size;
+  while (p < end && count < t->nodes) {
+    Bintree_Profile_Record *r = &records[count];
+    r->offset = (size_t)(p - t->code);
+    r->kind = *p & BINTREE_KIND_MASK;
+    r->arity = record_arity(r->kind);
+    p += 1;
+    if (r->kind == BINTREE_REF) {
+      uint64_t slot;
+      read_varint(&p, end, &slot);
+    } else {
+      p += r->kind == NK_NUMBER ? 4 : r->kind == NK_BOOL ? 1 : 0;
+    }
+    depth -= r->arity;
+    memcpy(r->operands, stack + depth, r->arity * sizeof(size_t));
+    stack[depth++] = count++;
+  }
+
+  // Self cost: cycles of the subtree minus the ones of the operands, scaled
+  // from the timed pixels to all of them
+  double total = 0.0;
+  double self_by_kind[BINTREE_REF + 1] = {0};
+  uint64_t count_by_kind[BINTREE_REF + 1] = {0};
+  for (size_t i = 0; i < count; ++i) {
+    Bintree_Profile_Record *r = &records[i];
+    Profile_Entry *e = profile_find(profile, profile_record_key(r->offset));
+    if (e == NULL)
+      continue;
+    r->count = e->count;
+    if (e->samples > 0) {
+      double self = (double)e->cycles;
+      for (size_t k = 0; k < r->arity; ++k) {
+        Profile_Entry *o = profile_find(
+            profile, profile_record_key(records[r->operands[k]].offset));
+        if (o)
+          self -= (double)o->cycles;
+      }
+      r->self = self > 0.0 ? self * (double)e->count / (double)e->samples : 0;
+      if (i + 1 == count)
+        total = (double)e->cycles * (double)e->count / (double)e->samples;
+    }
+    self_by_kind[r->kind] += r->self;
+    count_by_kind[r->kind] += r->count;
+  }
+
+  uint64_t pixels = profile->pixels ? profile->pixels : 1;
+  fprintf(stderr,
+          "# bin profile: %" PRIu64 " pixels, one in %d timed, %s\n",
+          profile->pixels, PROFILE_SAMPLE_PERIOD, PROFILE_CYCLES_UNIT);
+  fprintf(stderr, "# folded stacks, records as kind@byte offset\n");
+  String_Builder path = {0};
+  if (count > 0)
+    bintree_profile_folded(records, count - 1, &path);
+
+  fprintf(stderr, "# kinds\n");
+  fprintf(stderr, "# %-8s %12s %12s %8s\n", "kind", "evals/pixel",
+          "self/pixel", "self %");
+  for (unsigned kind = 0; kind <= BINTREE_REF; ++kind) {
+    if (count_by_kind[kind] == 0)
+      continue;
+    fprintf(stderr, "# %-8s %12.2f %12.1f %7.1f%%\n", record_kind_name(kind),
+            (double)count_by_kind[kind] / pixels, self_by_kind[kind] / pixels,
+            total > 0.0 ? self_by_kind[kind] / total * 100.0 : 0.0);
+  }
+  fprintf(stderr, "# total: %.1f %s/pixel\n", total / pixels,
+          PROFILE_CYCLES_UNIT);
+
+  free(path.items);
+  free(stack);
+  free(records);
+  temp_rewind(temp);
+}
+#endif // RANDOMART_PROFILE
@@ -0,0 +1,78 @@
+#ifndef BINTREE_H_
+#define BINTREE_H_
+
+// Compact binary format for Node trees, meant to be mapped into memory and
+// evaluated where it lies.
+//
+// A tree is its nodes in postorder, one record each: a byte holding the kind
+// (bits 0-4), the type of the value (bits 5-6: number, boolean or triple) and
+// a flag that the value is reused later (bit 7), followed by a little-endian
+// float for numbers or a byte for booleans. Subtrees that occur more than
+// once in the Node graph are written once and then referred to by a
+// BINTREE_REF record with a LEB128 slot number. Types are checked when a
+// tree is loaded, so bintree_eval() is a plain loop over a stack of floats.
+//
+// A file is a 16 byte header ("RART", u16 version, u16 flags, u32 count,
+// u32 reserved), an index of count (u64 offset, u64 size) pairs and the
+// trees. All integers are little-endian.
+
+#include "nob.h"
+#include "node.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BINTREE_VERSION 1
+#define BINTREE_REF 31 // record kind of references to reused subtrees
+
+typedef struct {
+  const uint8_t *code;
+  size_t size;
+  size_t nodes;     // records, references included
+  size_t max_stack; // floats
+  size_t saves;     // reused values
+} Bintree;
+
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+  uint32_t count;
+  bool mapped; // data comes from mmap() rather than malloc()
+} Bintree_File;
+
+// Appends the records of tree to out. With share unset, shared subtrees are
+// written out at every use. Fails on trees that do not evaluate to a triple
+// or mix types, e.g. an if with a number in one branch and a triple in the
+// other.
+bool bintree_encode(Node *tree, bool share, Nob_String_Builder *out);
+bool bintree_write_file(const char *path, Node *const *trees, size_t count);
+
+// Checks the records and fills t, which points into code
+bool bintree_load(const uint8_t *code, size_t size, Bintree *t);
+
+bool bintree_open(Bintree_File *f, const char *path);
+void bintree_close(Bintree_File *f);
+// Reads a file that is already in memory. f points into data, which stays
+// with the caller: do not bintree_close() it.
+bool bintree_read(Bintree_File *f, const uint8_t *data, size_t size);
+bool bintree_get(const Bintree_File *f, size_t index, Bintree *t);
+// Whether the file at path starts with the magic of the format
+bool bintree_is_file(const char *path);
+
+// Floats of scratch space bintree_eval() needs
+size_t bintree_scratch_size(const Bintree *t);
+// Same results as eval_func(), with both branches of every if evaluated
+void bintree_eval(const Bintree *t, float x, float y, float time,
+                  float *scratch, Color *c);
+
+// Rebuilds the Node tree, with the reused subtrees shared again
+Node *bintree_to_node(const Bintree *t);
+
+#ifdef RANDOMART_PROFILE
+#include "profile.h"
+// The report of profile_report() for a render with the bin backend, whose
+// table is keyed by profile_record_key()
+void bintree_profile_report(const Bintree *t, const Profile_Table *profile);
+#endif
+
+#endif // BINTREE_H_
@@ -0,0 +1,200 @@
+#define NOB_STRIP_PREFIX
+
+#include "cache.h"
+#include "nob.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Part of every key; bump it when the encoded PNG of the same render changes
+#define CACHE_VERSION 2
+
+static uint64_t cache_mix(uint64_t h, uint64_t v) {
+  h = (h ^ v) * 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 31;
+  h *= 0x94d049bb133111ebull;
+  return h ^ (h >> 29);
+}
+
+uint64_t cache_key(Node *f, int width, int height, const Render_Options *opts) {
+  Render_Options defaults = {0};
+  if (opts == NULL)
+    opts = &defaults;
+  uint32_t t_bits;
+  memcpy(&t_bits, &opts->t, sizeof(t_bits));
+  // The backend and the number of threads do not change the image
+  bool aa = opts->aa_samples > 1;
+  uint64_t h = cache_mix(CACHE_VERSION, node_hash(f));
+  h = cache_mix(h, (uint64_t)width << 32 | (uint32_t)height);
+  h = cache_mix(h, t_bits);
+  h = cache_mix(h, opts->dither);
+  h = cache_mix(h, aa ? (uint64_t)opts->aa_samples : 0);
+  h = cache_mix(h, aa ? opts->aa_budget : 0);
+  h = cache_mix(h, opts->symmetry);
+  // Only mixed in when it is not the default, keys of older entries stay
+  Render_Viewport view = viewport_resolve(&opts->viewport, width, height);
+  if (!viewport_whole(&view, width, height) || view.center_x != 0.0f ||
+      view.center_y != 0.0f || view.scale != 1.0f) {
+    uint32_t bits[3];
+    memcpy(&bits[0], &view.center_x, sizeof(float));
+    memcpy(&bits[1], &view.center_y, sizeof(float));
+    memcpy(&bits[2], &view.scale, sizeof(float));
+    h = cache_mix(h, (uint64_t)(uint32_t)view.x << 32 | (uint32_t)view.y);
+    h = cache_mix(h, (uint64_t)(uint32_t)view.width << 32 |
+                         (uint32_t)view.height);
+    h = cache_mix(h, (uint64_t)bits[0] << 32 | bits[1]);
+    h = cache_mix(h, bits[2]);
+  }
+  return h;
+}
+
+static const char *cache_entry_path(const Render_Cache *cache, uint64_t key) {
+  return temp_sprintf("%s/%016" PRIx64 ".png", cache->dir, key);
+}
+
+// Copies from into to inside the kernel when it can
+static bool cache_copy(const char *from, const char *to) {
+#ifdef __linux__
+  int in = open(from, O_RDONLY);
+  if (in < 0) {
+    nob_log(ERROR, "Could not open %s: %s", from, strerror(errno));
+    return false;
+  }
+  int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0) {
+    nob_log(ERROR, "Could not open %s: %s", to, strerror(errno));
+    close(in);
+    return false;
+  }
+  struct stat st;
+  bool ok = fstat(in, &st) == 0;
+  size_t left = ok ? (size_t)st.st_size : 0;
+  bool fallback = false;
+  while (ok && left > 0 && !fallback) {
+    ssize_t n = copy_file_range(in, NULL, out, NULL, left, 0);
+    if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+                  errno == EOPNOTSUPP)) {
+      fallback = true; // both offsets are still where the last copy ended
+    } else if (n <= 0) {
+      ok = false;
+    } else {
+      left -= (size_t)n;
+    }
+  }
+  while (ok && fallback && left > 0) {
+    char buf[64 * 1024];
+    ssize_t n = read(in, buf, sizeof(buf));
+    ok = n > 0 && write(out, buf, (size_t)n) == n;
+    if (ok)
+      left -= (size_t)n;
+  }
+  if (!ok)
+    nob_log(ERROR, "Could not copy %s to %s: %s", from, to, strerror(errno));
+  close(in);
+  if (close(out) != 0)
+    ok = false;
+  return ok;
+#else
+  return copy_file(from, to);
+#endif
+}
+
+bool cache_fetch(const Render_Cache *cache, uint64_t key, const char *path) {
+  size_t mark = temp_save();
+  const char *entry = cache_entry_path(cache, key);
+  struct stat st;
+  bool hit = stat(entry, &st) == 0 && cache_copy(entry, path);
+  if (hit)
+    utime(entry, NULL); // most recently used
+  temp_rewind(mark);
+  return hit;
+}
+
+typedef struct {
+  const char *path;
+  uint64_t size;
+  time_t used;
+} Cache_Entry;
+
+static int cache_entry_compare(const void *a, const void *b) {
+  const Cache_Entry *x = a, *y = b;
+  if (x->used != y->used)
+    return x->used < y->used ? -1 : 1;
+  return strcmp(x->path, y->path);
+}
+
+// Removes the least recently used entries other than keep until the rest
+// fit in max_bytes
+static void cache_evict(const Render_Cache *cache, const char *keep) {
+  File_Paths names = {0};
+  if (!read_entire_dir(cache->dir, &names))
+    return;
+  struct {
+    Cache_Entry *items;
+    size_t count;
+    size_t capacity;
+  } entries = {0};
+  uint64_t total = 0;
+  for (size_t i = 0; i < names.count; ++i) {
+    const char *name = names.items[i];
+    size_t len = strlen(name);
+    // Only what cache_entry_path() names, not the files of other programs
+    if (len != 16 + 4 || strcmp(name + 16, ".png") != 0)
+      continue;
+    const char *path = temp_sprintf("%s/%s", cache->dir, name);
+    struct stat st;
+    if (stat(path, &st) != 0)
+      continue;
+    Cache_Entry e = {path, (uint64_t)st.st_size, st.st_mtime};
+    da_append(&entries, e);
+    total += e.size;
+  }
+
+  if (total > cache->max_bytes) {
+    qsort(entries.items, entries.count, sizeof(*entries.items),
+          cache_entry_compare);
+    size_t evicted = 0;
+    uint64_t freed = 0;
+    for (size_t i = 0; i < entries.count && total > cache->max_bytes; ++i) {
+      Cache_Entry *e = &entries.items[i];
+      if (strcmp(e->path, keep) == 0 || remove(e->path) != 0)
+        continue;
+      total -= e->size;
+      freed += e->size;
+      evicted += 1;
+    }
+    nob_log(INFO, "Cache: evicted %zu entries, %" PRIu64 " bytes", evicted,
+            freed);
+  }
+  free(entries.items);
+  free(names.items);
+}
+
+bool cache_store(const Render_Cache *cache, uint64_t key, const char *path) {
+  size_t mark = temp_save();
+  bool ok = mkdir_if_not_exists(cache->dir);
+  const char *entry = cache_entry_path(cache, key);
+  // Renamed into place, so that other processes never see half an entry
+  const char *tmp = temp_sprintf("%s.%d.tmp", entry, (int)getpid());
+  ok = ok && cache_copy(path, tmp);
+  if (ok && !rename(tmp, entry)) {
+    remove(tmp);
+    ok = false;
+  }
+  if (ok && cache->max_bytes > 0)
+    cache_evict(cache, entry);
+  temp_rewind(mark);
+  return ok;
+}
@@ -0,0 +1,32 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+// Content-addressed cache of rendered PNGs. An entry is named after a hash of
+// the structure of the expression and of every setting that changes the
+// encoded image, so an expression built again, parsed from a file or loaded
+// from a binary tree finds the image rendered from it before.
+//
+// Hits are copied out with copy_file_range() where the system has it. They
+// are not hard links: image_write_png() rewrites an existing file in place,
+// which would change the cached copy as well. Every hit or store touches the
+// entry, and stores evict the least recently used entries once the directory
+// holds more than max_bytes of them.
+
+#include "node.h"
+#include "render.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  const char *dir;    // created when the first entry is stored
+  uint64_t max_bytes; // 0 for no limit
+} Render_Cache;
+
+uint64_t cache_key(Node *f, int width, int height, const Render_Options *opts);
+
+// Copies the entry of key to path. False on a miss.
+bool cache_fetch(const Render_Cache *cache, uint64_t key, const char *path);
+// Saves a copy of the PNG at path as the entry of key.
+bool cache_store(const Render_Cache *cache, uint64_t key, const char *path);
+
+#endif // CACHE_H_
@@ -0,0 +1,257 @@
+#define NOB_STRIP_PREFIX
+
+#include "cost.h"
+#include "nob.h"
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COST_PARAMS (COUNT_NK + 1) // per_pixel + one per kind
+
+// Solves the n x n system in the top left corner of a * x = b in place with
+// partial pivoting
+static bool solve(double a[COST_PARAMS][COST_PARAMS], double b[COST_PARAMS],
+                  double x[COST_PARAMS], size_t n) {
+  for (size_t col = 0; col < n; ++col) {
+    size_t pivot = col;
+    for (size_t row = col + 1; row < n; ++row) {
+      if (fabs(a[row][col]) > fabs(a[pivot][col]))
+        pivot = row;
+    }
+    if (fabs(a[pivot][col]) < 1e-12)
+      return false;
+    if (pivot != col) {
+      for (size_t k = 0; k < n; ++k) {
+        double t = a[col][k];
+        a[col][k] = a[pivot][k];
+        a[pivot][k] = t;
+      }
+      double t = b[col];
+      b[col] = b[pivot];
+      b[pivot] = t;
+    }
+    for (size_t row = col + 1; row < n; ++row) {
+      double f = a[row][col] / a[col][col];
+      for (size_t k = col; k < n; ++k)
+        a[row][k] -= f * a[col][k];
+      b[row] -= f * b[col];
+    }
+  }
+  for (size_t i = n; i-- > 0;) {
+    double sum = b[i];
+    for (size_t k = i + 1; k < n; ++k)
+      sum -= a[i][k] * x[k];
+    x[i] = sum / a[i][i];
+  }
+  return true;
+}
+
+// Least squares solution of the normal equations ata * x = atb under x >= 0,
+// with the active set method of Lawson and Hanson. Coefficients are moved
+// into the passive set P one at a time, the one whose gradient promises the
+// largest decrease first, and the unconstrained problem is solved on P; when
+// that solution leaves the feasible region, x moves towards it as far as it
+// stays feasible and the coefficients that hit zero leave P again.
+static bool nnls(double ata[COST_PARAMS][COST_PARAMS],
+                 const double atb[COST_PARAMS], double x[COST_PARAMS]) {
+  size_t n = COST_PARAMS;
+  bool passive[COST_PARAMS] = {0};
+  double scale = 0.0;
+  for (size_t i = 0; i < n; ++i) {
+    x[i] = 0.0;
+    if (fabs(atb[i]) > scale)
+      scale = fabs(atb[i]);
+  }
+  double tolerance = scale * 1e-12;
+
+  for (size_t iter = 0; iter < 3 * n; ++iter) {
+    // Gradient w = atb - ata * x, over the coefficients held at zero
+    size_t best = n;
+    double best_w = tolerance;
+    for (size_t i = 0; i < n; ++i) {
+      if (passive[i])
+        continue;
+      double w = atb[i];
+      for (size_t j = 0; j < n; ++j)
+        w -= ata[i][j] * x[j];
+      if (w > best_w) {
+        best_w = w;
+        best = i;
+      }
+    }
+    if (best == n)
+      return true;
+    passive[best] = true;
+
+    for (;;) {
+      size_t index[COST_PARAMS];
+      size_t count = 0;
+      for (size_t i = 0; i < n; ++i)
+        if (passive[i])
+          index[count++] = i;
+      double a[COST_PARAMS][COST_PARAMS], b[COST_PARAMS], y[COST_PARAMS];
+      for (size_t i = 0; i < count; ++i) {
+        for (size_t j = 0; j < count; ++j)
+          a[i][j] = ata[index[i]][index[j]];
+        b[i] = atb[index[i]];
+      }
+      if (!solve(a, b, y, count))
+        return false;
+
+      double z[COST_PARAMS] = {0};
+      bool feasible = true;
+      for (size_t i = 0; i < count; ++i) {
+        z[index[i]] = y[i];
+        if (y[i] <= 0.0)
+          feasible = false;
+      }
+      if (feasible) {
+        memcpy(x, z, sizeof(z));
+        break;
+      }
+
+      double alpha = 1.0;
+      for (size_t i = 0; i < n; ++i) {
+        if (passive[i] && z[i] <= 0.0 && x[i] - z[i] > 0.0 &&
+            x[i] / (x[i] - z[i]) < alpha)
+          alpha = x[i] / (x[i] - z[i]);
+      }
+      for (size_t i = 0; i < n; ++i) {
+        x[i] += alpha * (z[i] - x[i]);
+        if (passive[i] && x[i] <= tolerance) {
+          x[i] = 0.0;
+          passive[i] = false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool cost_model_fit(Cost_Model *m, const Cost_Sample *samples, size_t count) {
+  // Normal equations (A^T A + lambda I) x = A^T b. The small ridge term keeps
+  // the system solvable for kinds that never appear in the samples.
+  double ata[COST_PARAMS][COST_PARAMS] = {0};
+  double atb[COST_PARAMS] = {0};
+  for (size_t s = 0; s < count; ++s) {
+    if (samples[s].ns_per_pixel <= 0.0)
+      continue;
+    // Every row is divided by the measurement, so that the fit minimizes
+    // relative errors: in absolute terms the longest chains would outweigh
+    // the small trees
+    double weight = 1.0 / samples[s].ns_per_pixel;
+    double row[COST_PARAMS];
+    row[0] = weight;
+    for (size_t k = 0; k < COUNT_NK; ++k)
+      row[k + 1] = (double)samples[s].hist[k] * weight;
+    for (size_t i = 0; i < COST_PARAMS; ++i) {
+      for (size_t j = 0; j < COST_PARAMS; ++j)
+        ata[i][j] += row[i] * row[j];
+      atb[i] += row[i];
+    }
+  }
+  for (size_t i = 0; i < COST_PARAMS; ++i)
+    ata[i][i] += 1e-6;
+
+  double x[COST_PARAMS];
+  if (!nnls(ata, atb, x))
+    return false;
+
+  m->per_pixel = x[0];
+  for (size_t k = 0; k < COUNT_NK; ++k)
+    m->per_kind[k] = x[k + 1];
+  return true;
+}
+
+double cost_predict_ns_per_pixel(const Cost_Model *m,
+                                 const size_t hist[COUNT_NK]) {
+  double ns = m->per_pixel;
+  for (size_t k = 0; k < COUNT_NK; ++k)
+    ns += m->per_kind[k] * (double)hist[k];
+  return ns;
+}
+
+double cost_predict_secs(const Cost_Model *m, Node *f, int width, int height,
+                         int threads) {
+  size_t hist[COUNT_NK] = {0};
+  node_histogram(f, hist);
+  if (threads <= 0)
+    threads = cpu_count();
+  // Rows are the unit of work, so there is no point counting more workers
+  if (threads > height)
+    threads = height;
+  return cost_predict_ns_per_pixel(m, hist) * 1e-9 * width * height / threads;
+}
+
+void cost_predict_range(const Cost_Model *m, double predicted, double *fastest,
+                        double *slowest) {
+  *fastest = predicted / (1.0 + m->error_high);
+  *slowest = predicted / (1.0 + m->error_low);
+}
+
+bool cost_model_save(const Cost_Model *m, const char *path) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    nob_log(ERROR, "Could not open %s: %s", path, strerror(errno));
+    return false;
+  }
+  fprintf(f, "backend %s\n", backend_name(m->backend));
+  fprintf(f, "per_pixel %.6f\n", m->per_pixel);
+  fprintf(f, "error_low %.6f\n", m->error_low);
+  fprintf(f, "error_high %.6f\n", m->error_high);
+  for (size_t k = 0; k < COUNT_NK; ++k)
+    fprintf(f, "%s %.6f\n", node_kind_name(k), m->per_kind[k]);
+  fclose(f);
+  return true;
+}
+
+bool cost_model_load(Cost_Model *m, const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    nob_log(ERROR, "Could not open %s: %s", path, strerror(errno));
+    return false;
+  }
+
+  memset(m, 0, sizeof(*m));
+  bool ok = true;
+  char name[64];
+  char value[64];
+  while (fscanf(f, "%63s %63s", name, value) == 2) {
+    if (strcmp(name, "backend") == 0) {
+      if (!backend_by_name(value, &m->backend)) {
+        nob_log(ERROR, "%s: unknown backend %s", path, value);
+        ok = false;
+      }
+      continue;
+    }
+    if (strcmp(name, "per_pixel") == 0) {
+      m->per_pixel = strtod(value, NULL);
+      continue;
+    }
+    if (strcmp(name, "error_low") == 0 || strcmp(name, "error_high") == 0) {
+      double error = strtod(value, NULL);
+      if (error <= -1.0) {
+        nob_log(ERROR, "%s: %s %s is out of range", path, name, value);
+        ok = false;
+      } else if (name[6] == 'l') {
+        m->error_low = error;
+      } else {
+        m->error_high = error;
+      }
+      continue;
+    }
+    size_t k = 0;
+    while (k < COUNT_NK && strcmp(node_kind_name(k), name) != 0)
+      k++;
+    if (k == COUNT_NK) {
+      nob_log(ERROR, "%s: unknown node kind %s", path, name);
+      ok = false;
+      continue;
+    }
+    m->per_kind[k] = strtod(value, NULL);
+  }
+  fclose(f);
+  return ok;
+}
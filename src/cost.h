@@ -0,0 +1,47 @@
+#ifndef COST_H_
+#define COST_H_
+
+#include "node.h"
+#include "render.h"
+#include <stdbool.h>
+
+// Linear model of the single-threaded render time of a tree:
+//
+//   ns per pixel = per_pixel + sum over kinds of per_kind[k] * count[k]
+//
+// where count[k] is the number of nodes of kind k in the tree. The
+// coefficients are fitted per backend by kind-bench from renders of
+// calibration trees and stored in a small text file, along with the range of
+// the relative errors, (predicted - measured) / measured, of the model on
+// the benchmark corpus. A render predicted to take p then took between
+// p / (1 + error_high) and p / (1 + error_low) on that corpus.
+typedef struct {
+  Backend backend;
+  double per_pixel;          // ns
+  double per_kind[COUNT_NK]; // ns per node per pixel
+  double error_low;          // the most negative relative error, > -1
+  double error_high;         // the most positive one
+} Cost_Model;
+
+typedef struct {
+  size_t hist[COUNT_NK];
+  double ns_per_pixel; // measured
+} Cost_Sample;
+
+// Non-negative least squares fit of the model to the samples, minimizing the
+// relative errors. Leaves the error range alone.
+bool cost_model_fit(Cost_Model *m, const Cost_Sample *samples, size_t count);
+
+double cost_predict_ns_per_pixel(const Cost_Model *m,
+                                 const size_t hist[COUNT_NK]);
+// Expected wall time of render_pixels() with the given number of workers
+double cost_predict_secs(const Cost_Model *m, Node *f, int width, int height,
+                         int threads);
+// The range of render times a prediction stands for, from the error range
+void cost_predict_range(const Cost_Model *m, double predicted, double *fastest,
+                        double *slowest);
+
+bool cost_model_save(const Cost_Model *m, const char *path);
+bool cost_model_load(Cost_Model *m, const char *path);
+
+#endif // COST_H_
@@ -0,0 +1,480 @@
+#define NOB_STRIP_PREFIX
+
+#include "daemon.h"
+#include "bintree.h"
+#include "image.h"
+#include "nob.h"
+#include "node.h"
+#include "parse.h"
+#include "render.h"
+#include "trace.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+
+bool daemon_run(const char *socket_path, const Daemon_Options *opts) {
+  (void)socket_path;
+  (void)opts;
+  nob_log(ERROR, "The render daemon needs Unix domain sockets");
+  return false;
+}
+
+#else
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DAEMON_DEFAULT_WORKERS 2
+#define DAEMON_DEFAULT_QUEUE 16
+#define DAEMON_HEADER_SIZE 16
+#define DAEMON_MAX_REQUEST ((uint32_t)64 << 20)
+#define DAEMON_MAX_PIXELS ((uint64_t)1 << 28)
+// What the accept loop reads of a request it turns away, at most, and for how
+// long in total
+#define DAEMON_DRAIN_MAX ((size_t)1 << 20)
+#define DAEMON_DRAIN_TIMEOUT_MS 100
+// Longest a read of the request or a write of the reply may wait on a client
+// before the worker drops it
+#define DAEMON_IO_TIMEOUT_MS 10000
+
+typedef struct {
+  int *fds; // ring of accepted connections
+  int capacity;
+  int head;
+  int count;
+  bool stopping;
+  int threads; // per render
+  // Statistics
+  int active;
+  int *serving; // connection of each worker, -1 between requests
+  size_t served;
+  size_t failed;
+  size_t rejected;
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+} Daemon;
+
+static volatile sig_atomic_t daemon_stop = 0;
+
+static void daemon_on_signal(int signal) {
+  (void)signal;
+  daemon_stop = 1;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; ++i)
+    p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+static bool read_full(int fd, void *data, size_t size) {
+  uint8_t *p = data;
+  while (size > 0) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= (size_t)n;
+  }
+  return true;
+}
+
+static bool write_full(int fd, const void *data, size_t size) {
+  const uint8_t *p = data;
+  while (size > 0) {
+    // A client that went away must not take the daemon down with SIGPIPE
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= (size_t)n;
+  }
+  return true;
+}
+
+static int daemon_queued(Daemon *d) {
+  pthread_mutex_lock(&d->mutex);
+  int queued = d->count;
+  pthread_mutex_unlock(&d->mutex);
+  return queued;
+}
+
+static bool daemon_respond(int fd, Daemon_Status status, int queued,
+                           const void *data, size_t size) {
+  uint8_t header[12];
+  put_u32(header, status);
+  put_u32(header + 4, (uint32_t)queued);
+  put_u32(header + 8, (uint32_t)size);
+  return write_full(fd, header, sizeof(header)) && write_full(fd, data, size);
+}
+
+static void daemon_error(Daemon *d, int fd, Daemon_Status status,
+                         const char *message) {
+  daemon_respond(fd, status, daemon_queued(d), message, strlen(message));
+}
+
+static void daemon_count(Daemon *d, size_t *counter) {
+  pthread_mutex_lock(&d->mutex);
+  *counter += 1;
+  pthread_mutex_unlock(&d->mutex);
+}
+
+// Answers a request that could not be rendered
+static void daemon_fail(Daemon *d, int fd, Daemon_Status status,
+                        const char *message) {
+  daemon_error(d, fd, status, message);
+  daemon_count(d, &d->failed);
+}
+
+static double daemon_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// read_full() that gives up at deadline, a daemon_now() time, however slowly
+// the data trickles in
+static bool read_until(int fd, void *data, size_t size, double deadline) {
+  uint8_t *p = data;
+  while (size > 0) {
+    double left = deadline - daemon_now();
+    if (left <= 0.0)
+      return false;
+    long us = (long)(left * 1e6) + 1;
+    struct timeval timeout = {.tv_sec = us / 1000000, .tv_usec = us % 1000000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= (size_t)n;
+  }
+  return true;
+}
+
+// Reads the request before the busy reply, since closing a socket with unread
+// data resets the connection before the client sees the reply. Bounded in
+// size and in total time, as the accept loop waits for it.
+static void daemon_reject(Daemon *d, int fd) {
+  double deadline = daemon_now() + DAEMON_DRAIN_TIMEOUT_MS * 1e-3;
+  uint8_t prefix[4];
+  if (read_until(fd, prefix, sizeof(prefix), deadline)) {
+    size_t left = get_u32(prefix);
+    uint8_t buffer[4096];
+    while (left > 0 && left <= DAEMON_DRAIN_MAX) {
+      size_t n = left < sizeof(buffer) ? left : sizeof(buffer);
+      if (!read_until(fd, buffer, n, deadline))
+        break;
+      left -= n;
+    }
+  }
+  daemon_error(d, fd, DAEMON_BUSY, "queue full");
+}
+
+// Things a worker keeps from one request to the next
+typedef struct {
+  Arena arena; // nodes of the tree
+  uint8_t *request;
+  size_t request_capacity;
+  RGBA32 *pixels;
+  size_t pixels_capacity;
+} Daemon_Worker;
+
+// Text is parsed into *f. A binary tree is left in the request, in *bin, for
+// render_bintree() to evaluate in place, and *f stays NULL.
+static bool daemon_tree(Daemon_Worker *w, Daemon_Kind kind,
+                        const uint8_t *source, size_t size, Node **f,
+                        Bintree *bin) {
+  *f = NULL;
+  if (kind == DAEMON_BINARY) {
+    Bintree_File file;
+    return bintree_read(&file, source, size) && bintree_get(&file, 0, bin);
+  }
+  scratch_arena = &w->arena;
+  *f = parse_expr("<request>", sv_from_parts((const char *)source, size));
+  scratch_arena = NULL;
+  return *f != NULL;
+}
+
+static void daemon_serve(Daemon *d, Daemon_Worker *w, int fd) {
+  uint8_t prefix[4];
+  if (!read_full(fd, prefix, sizeof(prefix))) {
+    daemon_count(d, &d->failed);
+    return;
+  }
+  uint32_t size = get_u32(prefix);
+  if (size < DAEMON_HEADER_SIZE || size > DAEMON_MAX_REQUEST) {
+    daemon_fail(d, fd, DAEMON_BAD_REQUEST, "bad request size");
+    return;
+  }
+  if (w->request_capacity < size) {
+    w->request = realloc(w->request, size);
+    NOB_ASSERT(w->request != NULL);
+    w->request_capacity = size;
+  }
+  if (!read_full(fd, w->request, size)) {
+    daemon_count(d, &d->failed);
+    return;
+  }
+
+  const uint8_t *h = w->request;
+  Daemon_Kind kind = h[0];
+  Daemon_Format format = h[1];
+  uint32_t width = get_u32(h + 4);
+  uint32_t height = get_u32(h + 8);
+  uint32_t t_bits = get_u32(h + 12);
+  float t;
+  memcpy(&t, &t_bits, sizeof(t));
+
+  if (kind == DAEMON_STATS) {
+    char stats[128];
+    pthread_mutex_lock(&d->mutex);
+    snprintf(stats, sizeof(stats),
+             "queued %d active %d served %zu failed %zu rejected %zu\n",
+             d->count, d->active, d->served, d->failed, d->rejected);
+    int queued = d->count;
+    pthread_mutex_unlock(&d->mutex);
+    daemon_respond(fd, DAEMON_OK, queued, stats, strlen(stats));
+    return;
+  }
+  if (kind > DAEMON_BINARY || format > DAEMON_RGBA) {
+    daemon_fail(d, fd, DAEMON_BAD_REQUEST, "bad kind or format");
+    return;
+  }
+  if (width == 0 || height == 0 ||
+      (uint64_t)width * height > DAEMON_MAX_PIXELS) {
+    daemon_fail(d, fd, DAEMON_BAD_REQUEST, "bad image size");
+    return;
+  }
+
+  double start = daemon_now();
+  Trace_Span span = trace_begin("daemon request");
+  Node *f;
+  Bintree bin;
+  if (!daemon_tree(w, kind, h + DAEMON_HEADER_SIZE, size - DAEMON_HEADER_SIZE,
+                   &f, &bin)) {
+    trace_end(span);
+    daemon_fail(d, fd, DAEMON_FAILED, "could not read the expression");
+    return;
+  }
+
+  size_t count = (size_t)width * height;
+  if (w->pixels_capacity < count) {
+    w->pixels = realloc(w->pixels, count * sizeof(RGBA32));
+    NOB_ASSERT(w->pixels != NULL);
+    w->pixels_capacity = count;
+  }
+  Framebuffer fb = {.pixels = w->pixels, .width = width, .height = height};
+  Render_Options opts = {.threads = d->threads, .t = t};
+  bool rendered =
+      f ? render_pixels(f, &fb, &opts) : render_bintree(&bin, &fb, &opts);
+  if (!rendered) {
+    trace_end(span);
+    daemon_fail(d, fd, DAEMON_FAILED, "could not render the expression");
+    return;
+  }
+
+  bool ok;
+  if (format == DAEMON_PNG) {
+    size_t png_size;
+    unsigned char *png = image_encode_png(&fb, &png_size);
+    ok = png != NULL &&
+         daemon_respond(fd, DAEMON_OK, daemon_queued(d), png, png_size);
+    free(png);
+  } else {
+    ok = daemon_respond(fd, DAEMON_OK, daemon_queued(d), fb.pixels,
+                        count * sizeof(RGBA32));
+  }
+  trace_end(span);
+  daemon_count(d, ok ? &d->served : &d->failed);
+  nob_log(INFO, "Rendered %ux%u %s in %.1f ms, %d waiting", width, height,
+          format == DAEMON_PNG ? "PNG" : "RGBA", (daemon_now() - start) * 1e3,
+          daemon_queued(d));
+}
+
+typedef struct {
+  pthread_t thread;
+  Daemon *d;
+  int index;
+} Daemon_Thread;
+
+// So that a client that stops reading or writing cannot hold a worker
+static void daemon_set_timeouts(int fd) {
+  struct timeval timeout = {.tv_sec = DAEMON_IO_TIMEOUT_MS / 1000,
+                            .tv_usec = DAEMON_IO_TIMEOUT_MS % 1000 * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+static void *daemon_worker(void *arg) {
+  Daemon_Thread *thread = arg;
+  Daemon *d = thread->d;
+  Daemon_Worker w = {0};
+  trace_thread_name("daemon worker");
+  for (;;) {
+    pthread_mutex_lock(&d->mutex);
+    while (d->count == 0 && !d->stopping)
+      pthread_cond_wait(&d->not_empty, &d->mutex);
+    if (d->count == 0) {
+      pthread_mutex_unlock(&d->mutex);
+      break;
+    }
+    int fd = d->fds[d->head];
+    d->head = (d->head + 1) % d->capacity;
+    d->count -= 1;
+    d->active += 1;
+    d->serving[thread->index] = fd;
+    pthread_mutex_unlock(&d->mutex);
+
+    daemon_set_timeouts(fd);
+    daemon_serve(d, &w, fd);
+    // Cleared before the fd is closed, so that daemon_run() never shuts down
+    // a descriptor that was reused
+    pthread_mutex_lock(&d->mutex);
+    d->active -= 1;
+    d->serving[thread->index] = -1;
+    pthread_mutex_unlock(&d->mutex);
+    close(fd);
+    // Keeps the regions for the next tree
+    arena_reset(&w.arena);
+  }
+  arena_free(&w.arena);
+  free(w.request);
+  free(w.pixels);
+  return NULL;
+}
+
+bool daemon_run(const char *socket_path, const Daemon_Options *opts) {
+  Daemon_Options defaults = {0};
+  if (opts == NULL)
+    opts = &defaults;
+  int workers_count =
+      opts->workers > 0 ? opts->workers : DAEMON_DEFAULT_WORKERS;
+  Daemon d = {
+      .capacity = opts->queue > 0 ? opts->queue : DAEMON_DEFAULT_QUEUE,
+      .threads = opts->threads > 0 ? opts->threads
+                                   : (cpu_count() + workers_count - 1) /
+                                         workers_count,
+  };
+
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    nob_log(ERROR, "Socket path too long: %s", socket_path);
+    return false;
+  }
+  strcpy(addr.sun_path, socket_path);
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    nob_log(ERROR, "Could not create a socket: %s", strerror(errno));
+    return false;
+  }
+  unlink(socket_path); // left behind by a daemon that was killed
+  if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(listener, d.capacity) < 0) {
+    nob_log(ERROR, "Could not listen on %s: %s", socket_path,
+            strerror(errno));
+    close(listener);
+    return false;
+  }
+
+  // Without SA_RESTART, so that accept() returns when a signal comes in
+  struct sigaction action = {.sa_handler = daemon_on_signal};
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  d.fds = malloc(d.capacity * sizeof(*d.fds));
+  NOB_ASSERT(d.fds != NULL);
+  d.serving = malloc(workers_count * sizeof(*d.serving));
+  NOB_ASSERT(d.serving != NULL);
+  pthread_mutex_init(&d.mutex, NULL);
+  pthread_cond_init(&d.not_empty, NULL);
+  Daemon_Thread *workers = calloc(workers_count, sizeof(*workers));
+  NOB_ASSERT(workers != NULL);
+  int started = 0;
+  for (; started < workers_count; ++started) {
+    workers[started].d = &d;
+    workers[started].index = started;
+    d.serving[started] = -1;
+    if (pthread_create(&workers[started].thread, NULL, daemon_worker,
+                       &workers[started]) != 0) {
+      nob_log(ERROR, "Could not create daemon worker %d", started);
+      break;
+    }
+  }
+  bool ok = started > 0;
+  if (ok)
+    nob_log(INFO,
+            "Listening on %s: %d workers, %d render threads each, queue of %d",
+            socket_path, started, d.threads, d.capacity);
+
+  while (ok && !daemon_stop) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      nob_log(ERROR, "Could not accept a connection: %s", strerror(errno));
+      ok = false;
+      break;
+    }
+    pthread_mutex_lock(&d.mutex);
+    if (d.count == d.capacity) {
+      d.rejected += 1;
+      pthread_mutex_unlock(&d.mutex);
+      daemon_reject(&d, fd);
+      close(fd);
+      continue;
+    }
+    d.fds[(d.head + d.count) % d.capacity] = fd;
+    d.count += 1;
+    pthread_cond_signal(&d.not_empty);
+    pthread_mutex_unlock(&d.mutex);
+  }
+
+  close(listener);
+  unlink(socket_path);
+  // Cuts off the queued and the active connections: their reads and writes
+  // fail at once, so every worker gets back to the queue and sees it empty
+  pthread_mutex_lock(&d.mutex);
+  d.stopping = true;
+  for (int i = 0; i < d.count; ++i)
+    shutdown(d.fds[(d.head + i) % d.capacity], SHUT_RDWR);
+  for (int i = 0; i < started; ++i) {
+    if (d.serving[i] >= 0)
+      shutdown(d.serving[i], SHUT_RDWR);
+  }
+  pthread_cond_broadcast(&d.not_empty);
+  pthread_mutex_unlock(&d.mutex);
+  for (int i = 0; i < started; ++i)
+    pthread_join(workers[i].thread, NULL);
+  nob_log(INFO, "Daemon stopped: %zu served, %zu failed, %zu rejected",
+          d.served, d.failed, d.rejected);
+
+  free(workers);
+  free(d.serving);
+  free(d.fds);
+  pthread_mutex_destroy(&d.mutex);
+  pthread_cond_destroy(&d.not_empty);
+  return ok;
+}
+
+#endif // _WIN32
@@ -0,0 +1,57 @@
+#ifndef DAEMON_H_
+#define DAEMON_H_
+
+// Render server on a Unix domain socket, for services that would otherwise
+// start ran-art once per image.
+//
+// A fixed pool of workers takes connections from a bounded queue. Each worker
+// keeps its node arena and framebuffer from one request to the next, so a
+// request costs the parse, the render and the encode only. When the queue is
+// full, new connections get a busy reply right away. A client that stalls a
+// read or a write for DAEMON_IO_TIMEOUT_MS loses its connection, and stopping
+// the daemon shuts down every connection it still holds.
+//
+// One request per connection, all integers little-endian:
+//
+//   request:  u32 size of the rest, u8 kind, u8 format, u16 reserved,
+//             u32 width, u32 height, f32 t, then size - 16 bytes of
+//             expression: text for DAEMON_TEXT, a file written by
+//             bintree_write_file() for DAEMON_BINARY (its first tree is
+//             rendered), nothing for DAEMON_STATS
+//   response: u32 status, u32 requests waiting in the queue, u32 size, then
+//             size bytes: the PNG file or the RGBA pixels, a line of
+//             statistics for DAEMON_STATS, or an error message
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+  DAEMON_TEXT,
+  DAEMON_BINARY,
+  DAEMON_STATS,
+} Daemon_Kind;
+
+typedef enum {
+  DAEMON_PNG,
+  DAEMON_RGBA,
+} Daemon_Format;
+
+typedef enum {
+  DAEMON_OK,
+  DAEMON_BAD_REQUEST,
+  DAEMON_FAILED, // the expression did not parse or render
+  DAEMON_BUSY,   // the queue is full, try again later
+} Daemon_Status;
+
+typedef struct {
+  int workers; // requests rendered at once, 0 for 2
+  int threads; // render threads per request, 0 for the CPUs per worker
+  int queue;   // connections waiting for a worker, 0 for 16
+} Daemon_Options;
+
+// Serves until SIGINT or SIGTERM, then shuts down the connections still
+// queued or being served, waits for the workers and removes the socket. Only
+// available on POSIX systems.
+bool daemon_run(const char *socket_path, const Daemon_Options *opts);
+
+#endif // DAEMON_H_
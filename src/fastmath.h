@@ -0,0 +1,217 @@
+#ifndef FASTMATH_H_
+#define FASTMATH_H_
+
+// Replacements for the libm functions on the evaluation hot path. They are
+// inline and branch-light so that loops over arrays of operands vectorize;
+// for mod that takes math_fmodf_many(), since fast_fmodf() branches to libm.
+// Configure with -DRANDOMART_STRICT_MATH=ON to call libm instead.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// fmodf(a, b) as a - trunc(a / b) * b. The quotient is taken in double and
+// a - n * b is exact in double, so once the truncated quotient is corrected
+// by at most one step the result is bit-identical to fmodf(), including the
+// sign of zero. That holds while fast_fmodf_exact(): for non-finite operands
+// and quotients of 2^29 or more, where n * b would no longer be exact in
+// double, fast__fmodf() gives garbage and fast_fmodf() calls fmodf().
+static inline int fast_fmodf_exact(float a, float b) {
+  double q = (double)a / (double)b;
+  return fabs(q) < 0x1p29 && fabsf(b) < INFINITY;
+}
+
+// Selects only, so that loops over it vectorize
+static inline float fast__fmodf(float a, float b) {
+  double q = (double)a / (double)b;
+  // Clamped so that the conversion is defined for any quotient, NaN included
+  q = q > -0x1p30 ? q : -0x1p30;
+  q = q < 0x1p30 ? q : 0x1p30;
+  double n = (double)(int32_t)q;
+  double r = (double)a - n * (double)b;
+  // q may have been rounded across an integer; move r back into (-|b|, |b|)
+  // with the sign of a.
+  double step = copysign((double)b, (double)a);
+  double over = fabs(r) >= fabs((double)b) ? r - step : r;
+  r = r * (double)a < 0.0 ? r + step : over;
+  return copysignf((float)r, a);
+}
+
+static inline float fast_fmodf(float a, float b) {
+  return fast_fmodf_exact(a, b) ? fast__fmodf(a, b) : fmodf(a, b);
+}
+
+// Polynomial approximations in the style of Cephes: reduce the argument with
+// a few exact multiply-subtracts, evaluate a short minimax polynomial and
+// rebuild the result with selects. There are no table lookups, libm calls or
+// data-dependent branches, so loops over them vectorize (given
+// -fno-trapping-math, see CMakeLists.txt). Measured accuracy:
+//
+//   fast_sinf, fast_cosf  |x| < 8192         abs error < 2e-7
+//                         |x| < 32768        abs error < 5e-7
+//   fast_expf             -87 < x < 88       rel error < 2e-7
+//   fast_atan2f           everywhere         abs error < 5e-6 rad
+//
+// Past those ranges sin and cos lose precision (the renderer's coordinates
+// are in [-1, 1]) and exp saturates at exp(-87) and exp(88). NaN propagates.
+
+// sin(x) for quadrant 0 of x = r + j * pi/2, |r| <= pi/4, and the other
+// quadrants through sin(r + pi/2) = cos(r) and so on.
+static inline float fast__sincosf(float x, int32_t quadrant_offset) {
+  const float two_over_pi = 0.636619772367581343f;
+  float jf = x * two_over_pi;
+  // Clamped so that the conversion is defined for any x, NaN included
+  jf = jf > -0x1p30f ? jf : -0x1p30f;
+  jf = jf < 0x1p30f ? jf : 0x1p30f;
+  int32_t j = (int32_t)(jf + copysignf(0.5f, jf));
+  float fj = (float)j;
+  // pi/2 split into three floats whose products with j are exact
+  float r = ((x - fj * 1.5703125f) - fj * 4.8375129699707031e-4f) -
+            fj * 7.5497899548918821e-8f;
+  float r2 = r * r;
+  float sin_r =
+      r + r * r2 *
+              (-1.6666654611e-1f +
+               r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+  float cos_r =
+      1.0f - 0.5f * r2 +
+      r2 * r2 *
+          (4.166664568298827e-2f +
+           r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+  int32_t quadrant = (j + quadrant_offset) & 3;
+  float v = (quadrant & 1) ? cos_r : sin_r;
+  return (quadrant & 2) ? -v : v;
+}
+
+static inline float fast_sinf(float x) { return fast__sincosf(x, 0); }
+
+static inline float fast_cosf(float x) { return fast__sincosf(x, 1); }
+
+static inline float fast_expf(float x) {
+  float xc = x > -87.0f ? x : -87.0f;
+  xc = xc < 88.0f ? xc : 88.0f;
+  // x = n * ln(2) + r with |r| <= ln(2) / 2, exp(x) = 2^n * exp(r)
+  float nf = xc * 1.44269504088896341f;
+  int32_t n = (int32_t)(nf + copysignf(0.5f, nf));
+  float r = (xc - (float)n * 0.693359375f) - (float)n * -2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.0f;
+  union {
+    uint32_t u;
+    float f;
+  } scale = {.u = (uint32_t)(n + 127) << 23};
+  p *= scale.f;
+  return x == x ? p : x;
+}
+
+static inline float fast_atan2f(float y, float x) {
+  float ax = fabsf(x);
+  float ay = fabsf(y);
+  float hi = ax > ay ? ax : ay;
+  float lo = ax > ay ? ay : ax;
+  float t = hi > 0.0f ? lo / hi : 0.0f;
+  // atan(t) on [0, 1], odd polynomial
+  float t2 = t * t;
+  float a =
+      t * (0.99997726f +
+           t2 * (-0.33262347f +
+                 t2 * (0.19354346f +
+                       t2 * (-0.11643287f +
+                             t2 * (0.05265332f + t2 * -0.01172120f)))));
+  if (ay > ax)
+    a = 1.57079632679489662f - a;
+  if (signbit(x))
+    a = 3.14159265358979324f - a;
+  return copysignf(a, y);
+}
+
+static inline float math_fmodf(float a, float b) {
+#ifdef RANDOMART_STRICT_MATH
+  return fmodf(a, b);
+#else
+  return fast_fmodf(a, b);
+#endif
+}
+
+// out[k] = math_fmodf(a[k], b[k]). The fast path runs over all of them in a
+// loop without branches, the rare operands it cannot handle are redone with
+// fmodf() afterwards.
+static inline void math_fmodf_many(float *out, const float *a, const float *b,
+                                   size_t n) {
+#ifdef RANDOMART_STRICT_MATH
+  for (size_t k = 0; k < n; ++k)
+    out[k] = fmodf(a[k], b[k]);
+#else
+  int inexact = 0;
+  for (size_t k = 0; k < n; ++k) {
+    out[k] = fast__fmodf(a[k], b[k]);
+    inexact |= !fast_fmodf_exact(a[k], b[k]);
+  }
+  if (inexact) {
+    for (size_t k = 0; k < n; ++k) {
+      if (!fast_fmodf_exact(a[k], b[k]))
+        out[k] = fmodf(a[k], b[k]);
+    }
+  }
+#endif
+}
+
+static inline float math_sinf(float x) {
+#ifdef RANDOMART_STRICT_MATH
+  return sinf(x);
+#else
+  return fast_sinf(x);
+#endif
+}
+
+static inline float math_cosf(float x) {
+#ifdef RANDOMART_STRICT_MATH
+  return cosf(x);
+#else
+  return fast_cosf(x);
+#endif
+}
+
+static inline float math_expf(float x) {
+#ifdef RANDOMART_STRICT_MATH
+  return expf(x);
+#else
+  return fast_expf(x);
+#endif
+}
+
+static inline float math_atan2f(float y, float x) {
+#ifdef RANDOMART_STRICT_MATH
+  return atan2f(y, x);
+#else
+  return fast_atan2f(y, x);
+#endif
+}
+
+// sqrtf() is correctly rounded and, without errno, a single instruction
+static inline float math_sqrtf(float x) { return sqrtf(x); }
+
+// Plain comparisons instead of fminf()/fmaxf(), which have to check for NaN
+// operands: these compile to minss/maxss.
+static inline float math_minf(float a, float b) {
+#ifdef RANDOMART_STRICT_MATH
+  return fminf(a, b);
+#else
+  return a < b ? a : b;
+#endif
+}
+
+static inline float math_maxf(float a, float b) {
+#ifdef RANDOMART_STRICT_MATH
+  return fmaxf(a, b);
+#else
+  return a > b ? a : b;
+#endif
+}
+
+#endif // FASTMATH_H_
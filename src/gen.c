@@ -0,0 +1,81 @@
+#include "gen.h"
+
+typedef struct {
+  uint64_t state;
+} Rng;
+
+// splitmix64
+static uint64_t rng_next(Rng *rng) {
+  uint64_t z = (rng->state += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+static float rng_float(Rng *rng) {
+  // [-1, 1)
+  return (float)(rng_next(rng) >> 40) / (float)(1 << 24) * 2.0f - 1.0f;
+}
+
+static Node *gen_number(Rng *rng, int depth);
+
+static Node *gen_boolean(Rng *rng, int depth) {
+  return node_gt(gen_number(rng, depth - 1), gen_number(rng, depth - 1));
+}
+
+static Node *gen_number(Rng *rng, int depth) {
+  if (depth <= 0) {
+    switch (rng_next(rng) % 3) {
+    case 0:
+      return node_x();
+    case 1:
+      return node_y();
+    default:
+      return node_number(rng_float(rng));
+    }
+  }
+
+  switch (rng_next(rng) % 5) {
+  case 0:
+    return node_add(gen_number(rng, depth - 1), gen_number(rng, depth - 1));
+  case 1:
+    return node_mult(gen_number(rng, depth - 1), gen_number(rng, depth - 1));
+  case 2:
+    return node_mod(gen_number(rng, depth - 1), gen_number(rng, depth - 1));
+  case 3:
+    return node_if(gen_boolean(rng, depth - 1), gen_number(rng, depth - 1),
+                   gen_number(rng, depth - 1));
+  default:
+    // Keep some shallow branches so trees aren't perfectly balanced
+    return gen_number(rng, depth / 2);
+  }
+}
+
+Node *gen_tree(uint64_t seed, int depth) {
+  Rng rng = {seed};
+  return node_triple(gen_number(&rng, depth), gen_number(&rng, depth),
+                     gen_number(&rng, depth));
+}
+
+static Node *gen_mutate_node(Rng *rng, Node *node, int depth) {
+  Node *children[3];
+  size_t count = node_children(node, children);
+  bool boolean = node->kind == NK_GT || node->kind == NK_BOOL;
+  if (node->kind != NK_TRIPLE && (count == 0 || rng_next(rng) % 3 == 0))
+    return boolean ? gen_boolean(rng, depth) : gen_number(rng, depth);
+
+  size_t pick = rng_next(rng) % count;
+  for (size_t i = 0; i < count; ++i)
+    if (i != pick)
+      node_retain(children[i]);
+  children[pick] = gen_mutate_node(rng, children[pick], depth);
+  Node *copy = node_loc(node->file, node->line, node->kind);
+  copy->as = node->as;
+  node_set_children(copy, children);
+  return copy;
+}
+
+Node *gen_mutate(Node *tree, uint64_t seed, int depth) {
+  Rng rng = {seed};
+  return gen_mutate_node(&rng, tree, depth);
+}
@@ -0,0 +1,19 @@
+#ifndef GEN_H_
+#define GEN_H_
+
+#include "node.h"
+#include <stdint.h>
+
+// Deterministic random expression generator. The same seed and depth always
+// produce the same tree: a triple of number expressions built from x, y,
+// constants, add, mult, mod and if/gt.
+Node *gen_tree(uint64_t seed, int depth);
+
+// Returns tree with one subtree, picked at random, replaced by a new random
+// one of the given depth. Only the path down to it is rebuilt: the rest of
+// tree is shared and node_retain()ed, so with node_slab set, node_release()
+// of whichever of the two trees is dropped gives back exactly the nodes only
+// it used. Mutation searches run in constant memory that way.
+Node *gen_mutate(Node *tree, uint64_t seed, int depth);
+
+#endif // GEN_H_
@@ -0,0 +1,359 @@
+// The PNG encoder is built from the internals of stb_image_write.h, so its
+// implementation lives in this translation unit.
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define NOB_STRIP_PREFIX
+
+#include "image.h"
+#include "nob.h"
+#include "stb_image_write.h"
+#include "trace.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Filters row y with the filter that minimizes the sum of absolute
+// differences, the same heuristic as stbi_write_png_to_mem(), into the filter
+// type and the filtered bytes of row.
+static void png_filter_row(unsigned char *pixels, int stride, int width,
+                           int height, int y, signed char *line_buffer,
+                           unsigned char *row) {
+  int n = sizeof(RGBA32);
+  int row_bytes = width * n;
+  int best_filter = 0, best_filter_val = 0x7fffffff;
+  int filter_type;
+  for (filter_type = 0; filter_type < 5; filter_type++) {
+    stbiw__encode_png_line(pixels, stride, width, height, y, n, filter_type,
+                           line_buffer);
+    int est = 0;
+    for (int i = 0; i < row_bytes; ++i)
+      est += abs((signed char)line_buffer[i]);
+    if (est < best_filter_val) {
+      best_filter_val = est;
+      best_filter = filter_type;
+    }
+  }
+  if (filter_type != best_filter) {
+    stbiw__encode_png_line(pixels, stride, width, height, y, n, best_filter,
+                           line_buffer);
+  }
+  row[0] = (unsigned char)best_filter;
+  memcpy(row + 1, line_buffer, row_bytes);
+}
+
+static unsigned char *png_filter(const Framebuffer *fb, size_t *size) {
+  int n = sizeof(RGBA32);
+  int row_bytes = fb->width * n;
+  int stride = (fb->stride > 0 ? fb->stride : fb->width) * n;
+  unsigned char *pixels = (unsigned char *)fb->pixels;
+
+  *size = (size_t)(row_bytes + 1) * fb->height;
+  unsigned char *filt = malloc(*size);
+  signed char *line_buffer = malloc(row_bytes);
+  if (filt == NULL || line_buffer == NULL) {
+    free(filt);
+    free(line_buffer);
+    return NULL;
+  }
+
+  for (int y = 0; y < fb->height; ++y)
+    png_filter_row(pixels, stride, fb->width, fb->height, y, line_buffer,
+                   filt + (size_t)y * (row_bytes + 1));
+
+  free(line_buffer);
+  return filt;
+}
+
+unsigned char *image_encode_png(const Framebuffer *fb, size_t *size) {
+  Trace_Span span = trace_begin("png filter");
+  size_t filt_size;
+  unsigned char *filt = png_filter(fb, &filt_size);
+  trace_end(span);
+  if (filt == NULL)
+    return NULL;
+
+  span = trace_begin("deflate");
+  int zlen;
+  unsigned char *zlib = stbi_zlib_compress(filt, (int)filt_size, &zlen,
+                                           stbi_write_png_compression_level);
+  trace_end(span);
+  free(filt);
+  if (zlib == NULL)
+    return NULL;
+
+  // Signature, then IHDR, IDAT and IEND with 12 bytes of overhead each
+  *size = 8 + 12 + 13 + 12 + (size_t)zlen + 12;
+  unsigned char *out = malloc(*size);
+  if (out == NULL) {
+    free(zlib);
+    return NULL;
+  }
+
+  static const unsigned char sig[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  unsigned char *o = out;
+  memcpy(o, sig, 8);
+  o += 8;
+  stbiw__wp32(o, 13);
+  stbiw__wptag(o, "IHDR");
+  stbiw__wp32(o, fb->width);
+  stbiw__wp32(o, fb->height);
+  *o++ = 8; // bit depth
+  *o++ = 6; // colour type: RGBA
+  *o++ = 0;
+  *o++ = 0;
+  *o++ = 0;
+  stbiw__wpcrc(&o, 13);
+
+  stbiw__wp32(o, zlen);
+  stbiw__wptag(o, "IDAT");
+  memcpy(o, zlib, zlen);
+  o += zlen;
+  free(zlib);
+  stbiw__wpcrc(&o, zlen);
+
+  stbiw__wp32(o, 0);
+  stbiw__wptag(o, "IEND");
+  stbiw__wpcrc(&o, 0);
+
+  NOB_ASSERT(o == out + *size);
+  return out;
+}
+
+bool image_write_png(const Framebuffer *fb, const char *path) {
+  size_t size;
+  unsigned char *png = image_encode_png(fb, &size);
+  if (png == NULL) {
+    nob_log(ERROR, "Could not encode %s", path);
+    return false;
+  }
+
+  Trace_Span span = trace_begin("write file");
+  bool ok = write_entire_file(path, png, size);
+  trace_end(span);
+  free(png);
+  return ok;
+}
+
+// Writes a chunk of the PNG file, its length and CRC around tag and data
+static bool png_write_chunk(Png_Writer *w, const char *tag,
+                            const unsigned char *data, size_t size) {
+  unsigned char *chunk = malloc(size + 12);
+  if (chunk == NULL)
+    return false;
+  unsigned char *o = chunk;
+  stbiw__wp32(o, size);
+  stbiw__wptag(o, tag);
+  memcpy(o, data, size);
+  o += size;
+  stbiw__wpcrc(&o, (int)size);
+  bool ok = fwrite(chunk, 1, size + 12, w->file) == size + 12;
+  free(chunk);
+  return ok;
+}
+
+// Continues the single fixed Huffman block of the writer with data, matching
+// like stbi_zlib_compress() but only within data, and writes the whole bytes
+// out as an IDAT chunk. The bits of the last byte wait for the next call.
+static bool png_deflate(Png_Writer *w, unsigned char *data, int data_len) {
+  static const unsigned short lengthc[] = {
+      3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23,  27,
+      31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 259};
+  static const unsigned char lengtheb[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                           1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                           4, 4, 4, 4, 5, 5, 5, 5, 0};
+  static const unsigned short distc[] = {
+      1,    2,    3,    4,    5,    7,     9,     13,    17,    25,   33,
+      49,   65,   97,   129,  193,  257,   385,   513,   769,   1025, 1537,
+      2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 32768};
+  static const unsigned char disteb[] = {0, 0, 0,  0,  1,  1,  2,  2,
+                                         3, 3, 4,  4,  5,  5,  6,  6,
+                                         7, 7, 8,  8,  9,  9,  10, 10,
+                                         11, 11, 12, 12, 13, 13};
+  int quality = stbi_write_png_compression_level;
+  if (quality < 5)
+    quality = 5;
+  unsigned int bitbuf = w->bitbuf;
+  int bitcount = w->bitcount;
+  unsigned char *out = NULL;
+  unsigned char ***hash_table = calloc(stbiw__ZHASH, sizeof(*hash_table));
+  if (hash_table == NULL)
+    return false;
+
+  int i = 0;
+  while (i < data_len - 3) {
+    int h = stbiw__zhash(data + i) & (stbiw__ZHASH - 1), best = 3;
+    unsigned char *bestloc = NULL;
+    unsigned char **hlist = hash_table[h];
+    int n = stbiw__sbcount(hlist);
+    for (int j = 0; j < n; ++j) {
+      if (hlist[j] - data > i - 32768) {
+        int d = stbiw__zlib_countm(hlist[j], data + i, data_len - i);
+        if (d >= best) {
+          best = d;
+          bestloc = hlist[j];
+        }
+      }
+    }
+    if (hash_table[h] && stbiw__sbn(hash_table[h]) == 2 * quality) {
+      memmove(hash_table[h], hash_table[h] + quality,
+              sizeof(hash_table[h][0]) * quality);
+      stbiw__sbn(hash_table[h]) = quality;
+    }
+    stbiw__sbpush(hash_table[h], data + i);
+
+    if (bestloc) {
+      // Lazy matching: a better match at the next byte wins
+      h = stbiw__zhash(data + i + 1) & (stbiw__ZHASH - 1);
+      hlist = hash_table[h];
+      n = stbiw__sbcount(hlist);
+      for (int j = 0; j < n; ++j) {
+        if (hlist[j] - data > i - 32767) {
+          int e = stbiw__zlib_countm(hlist[j], data + i + 1, data_len - i - 1);
+          if (e > best) {
+            bestloc = NULL;
+            break;
+          }
+        }
+      }
+    }
+
+    if (bestloc) {
+      int d = (int)(data + i - bestloc);
+      int j;
+      for (j = 0; best > lengthc[j + 1] - 1; ++j)
+        ;
+      stbiw__zlib_huff(j + 257);
+      if (lengtheb[j])
+        stbiw__zlib_add(best - lengthc[j], lengtheb[j]);
+      for (j = 0; d > distc[j + 1] - 1; ++j)
+        ;
+      stbiw__zlib_add(stbiw__zlib_bitrev(j, 5), 5);
+      if (disteb[j])
+        stbiw__zlib_add(d - distc[j], disteb[j]);
+      i += best;
+    } else {
+      stbiw__zlib_huffb(data[i]);
+      ++i;
+    }
+  }
+  for (; i < data_len; ++i)
+    stbiw__zlib_huffb(data[i]);
+
+  for (int j = 0; j < stbiw__ZHASH; ++j)
+    (void)stbiw__sbfree(hash_table[j]);
+  free(hash_table);
+
+  // Adler-32 of the uncompressed data, in blocks short enough not to overflow
+  for (int j = 0; j < data_len;) {
+    int block = data_len - j < 5552 ? data_len - j : 5552;
+    for (int k = 0; k < block; ++k) {
+      w->adler_a += data[j + k];
+      w->adler_b += w->adler_a;
+    }
+    w->adler_a %= 65521;
+    w->adler_b %= 65521;
+    j += block;
+  }
+
+  w->bitbuf = bitbuf;
+  w->bitcount = bitcount;
+  bool ok = stbiw__sbcount(out) == 0 ||
+            png_write_chunk(w, "IDAT", out, stbiw__sbcount(out));
+  (void)stbiw__sbfree(out);
+  return ok;
+}
+
+bool png_writer_open(Png_Writer *w, const char *path, int width,
+                     int height) {
+  *w = (Png_Writer){.width = width, .height = height, .adler_a = 1};
+  w->file = fopen(path, "wb");
+  if (w->file == NULL) {
+    nob_log(ERROR, "Could not open %s: %s", path, strerror(errno));
+    return false;
+  }
+  w->path = path;
+  size_t row_bytes = (size_t)width * sizeof(RGBA32);
+  w->rows = malloc(2 * row_bytes);
+  w->line = malloc(row_bytes);
+  w->filtered = malloc(PNG_WRITER_ROWS * (row_bytes + 1));
+  w->ok = w->rows != NULL && w->line != NULL && w->filtered != NULL;
+
+  static const unsigned char sig[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  unsigned char ihdr[13];
+  unsigned char *o = ihdr;
+  stbiw__wp32(o, width);
+  stbiw__wp32(o, height);
+  *o++ = 8; // bit depth
+  *o++ = 6; // colour type: RGBA
+  *o++ = 0;
+  *o++ = 0;
+  *o++ = 0;
+  // The zlib header, then BFINAL and BTYPE of the only block: fixed Huffman
+  static const unsigned char zlib_header[2] = {0x78, 0x5e};
+  w->bitbuf = 1 | 1 << 1;
+  w->bitcount = 3;
+  w->ok = w->ok && fwrite(sig, 1, 8, w->file) == 8 &&
+          png_write_chunk(w, "IHDR", ihdr, sizeof(ihdr)) &&
+          png_write_chunk(w, "IDAT", zlib_header, sizeof(zlib_header));
+  return w->ok;
+}
+
+bool png_writer_rows(Png_Writer *w, const RGBA32 *pixels, int count,
+                     int stride) {
+  int row_bytes = w->width * (int)sizeof(RGBA32);
+  while (w->ok && count > 0) {
+    int batch = count < PNG_WRITER_ROWS ? count : PNG_WRITER_ROWS;
+    if (w->y + batch > w->height) {
+      nob_log(ERROR, "%s: more than %d rows", w->path, w->height);
+      w->ok = false;
+      break;
+    }
+    // The filters look at the previous row, kept in front of the current one
+    unsigned char *current = w->rows + row_bytes;
+    for (int r = 0; r < batch; ++r, ++w->y) {
+      memcpy(current, pixels + (size_t)r * stride, row_bytes);
+      unsigned char *row = w->filtered + (size_t)r * (row_bytes + 1);
+      if (w->y == 0)
+        png_filter_row(current, row_bytes, w->width, 1, 0, w->line, row);
+      else
+        png_filter_row(w->rows, row_bytes, w->width, 2, 1, w->line, row);
+      memcpy(w->rows, current, row_bytes);
+    }
+    w->ok = png_deflate(w, w->filtered, batch * (row_bytes + 1));
+    pixels += (size_t)batch * stride;
+    count -= batch;
+  }
+  return w->ok;
+}
+
+bool png_writer_close(Png_Writer *w) {
+  if (w->ok && w->y != w->height) {
+    nob_log(ERROR, "%s: %d rows of %d written", w->path, w->y, w->height);
+    w->ok = false;
+  }
+  if (w->ok) {
+    unsigned int bitbuf = w->bitbuf;
+    int bitcount = w->bitcount;
+    unsigned char *out = NULL;
+    stbiw__zlib_huff(256); // end of block
+    while (bitcount)
+      stbiw__zlib_add(0, 1);
+    stbiw__sbpush(out, STBIW_UCHAR(w->adler_b >> 8));
+    stbiw__sbpush(out, STBIW_UCHAR(w->adler_b));
+    stbiw__sbpush(out, STBIW_UCHAR(w->adler_a >> 8));
+    stbiw__sbpush(out, STBIW_UCHAR(w->adler_a));
+    w->ok = png_write_chunk(w, "IDAT", out, stbiw__sbcount(out)) &&
+            png_write_chunk(w, "IEND", NULL, 0);
+    (void)stbiw__sbfree(out);
+  }
+  if (w->file && fclose(w->file) != 0)
+    w->ok = false;
+  if (!w->ok && w->path)
+    nob_log(ERROR, "Could not write %s", w->path);
+  free(w->rows);
+  free(w->line);
+  free(w->filtered);
+  bool ok = w->ok;
+  *w = (Png_Writer){0};
+  return ok;
+}
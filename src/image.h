@@ -0,0 +1,47 @@
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+#include "render.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// PNG encoding of a Framebuffer. Produces the same bytes as stbi_write_png()
+// but records the filtering, deflate and file write phases as trace spans.
+
+// Returns a malloc()ed buffer holding the PNG file, NULL on failure
+unsigned char *image_encode_png(const Framebuffer *fb, size_t *size);
+bool image_write_png(const Framebuffer *fb, const char *path);
+
+// Rows compressed at a time by a Png_Writer
+#define PNG_WRITER_ROWS 16
+
+// PNG encoder for images too large to hold in memory: rows are filtered and
+// compressed as they come, PNG_WRITER_ROWS at a time, and written out as IDAT
+// chunks. Matches are only looked for within a batch of rows, so files come
+// out a little larger than the ones of image_encode_png().
+typedef struct {
+  FILE *file;
+  const char *path;
+  int width, height;
+  int y; // rows written so far
+  unsigned char *rows; // the previous row and the current one
+  signed char *line;
+  unsigned char *filtered;
+  // Deflate state: bits of the last unfinished byte and Adler-32
+  unsigned int bitbuf;
+  int bitcount;
+  uint32_t adler_a, adler_b;
+  bool ok;
+} Png_Writer;
+
+bool png_writer_open(Png_Writer *w, const char *path, int width, int height);
+// Appends count rows, stride pixels apart
+bool png_writer_rows(Png_Writer *w, const RGBA32 *pixels, int count,
+                     int stride);
+// Finishes the file, fails unless every row was written. Also to be called
+// after a failure, to release the writer.
+bool png_writer_close(Png_Writer *w);
+
+#endif // IMAGE_H_
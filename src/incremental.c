@@ -0,0 +1,601 @@
+#define NOB_STRIP_PREFIX
+
+#include "incremental.h"
+#include "fastmath.h"
+#include "nob.h"
+#include "quantize.h"
+#include "trace.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Rows evaluated together, small enough for the planes of a band to stay in
+// the cache while the tree is evaluated over them
+#define INCR_BAND_ROWS 8
+
+typedef enum {
+  INCR_NUMBER,
+  INCR_BOOL,
+  INCR_TRIPLE,
+} Incr_Type;
+
+static const size_t incr_widths[] = {
+    [INCR_NUMBER] = 1,
+    [INCR_BOOL] = 1,
+    [INCR_TRIPLE] = 3,
+};
+
+static const char *incr_type_names[] = {
+    [INCR_NUMBER] = "number",
+    [INCR_BOOL] = "boolean",
+    [INCR_TRIPLE] = "triple",
+};
+
+// One node of the tree, or a subtree taken from the cache
+typedef struct {
+  Node *node;
+  uint64_t hash;
+  size_t size; // nodes in the subtree, shared ones once per use
+  size_t args[3];
+  size_t arity;
+  Incr_Type type;
+  // Full-size planes the value is read from (hit) or written to, NULL when
+  // it only lives in the band buffer slot
+  float *planes;
+  bool hit;
+  int slot;
+  size_t last_use; // last step reading the value
+} Incr_Step;
+
+// Step of every hash, open addressing
+typedef struct {
+  uint64_t *keys;
+  size_t *values; // SIZE_MAX for empty slots
+  size_t count;
+  size_t capacity;
+} Incr_Index;
+
+typedef struct {
+  Plane_Cache *cache;
+  struct {
+    Incr_Step *items;
+    size_t count;
+    size_t capacity;
+  } steps;
+  Incr_Index index;
+  // Cached subtrees below a subtree that was itself cached, which this render
+  // does not read but which are still part of the tree
+  struct {
+    Incr_Step *items;
+    size_t count;
+    size_t capacity;
+  } dormant;
+  struct {
+    float **items;
+    size_t count;
+    size_t capacity;
+  } retired;
+  bool ok;
+} Incr_Plan;
+
+static size_t *incr_index_value(Incr_Index *ix, uint64_t key) {
+  if ((ix->count + 1) * 2 > ix->capacity) {
+    Incr_Index old = *ix;
+    ix->capacity = old.capacity ? old.capacity * 2 : 256;
+    ix->keys = malloc(ix->capacity * sizeof(*ix->keys));
+    ix->values = malloc(ix->capacity * sizeof(*ix->values));
+    NOB_ASSERT(ix->keys != NULL && ix->values != NULL);
+    memset(ix->values, 0xff, ix->capacity * sizeof(*ix->values));
+    ix->count = 0;
+    for (size_t i = 0; i < old.capacity; ++i) {
+      if (old.values[i] != SIZE_MAX)
+        *incr_index_value(ix, old.keys[i]) = old.values[i];
+    }
+    free(old.keys);
+    free(old.values);
+  }
+  size_t i = (size_t)(key >> 32 ^ key) & (ix->capacity - 1);
+  while (ix->values[i] != SIZE_MAX && ix->keys[i] != key)
+    i = (i + 1) & (ix->capacity - 1);
+  if (ix->values[i] == SIZE_MAX) {
+    ix->keys[i] = key;
+    ix->count += 1;
+  }
+  return &ix->values[i];
+}
+
+static int incr_entry_compare(const void *a, const void *b) {
+  uint64_t x = ((const Plane_Entry *)a)->hash;
+  uint64_t y = ((const Plane_Entry *)b)->hash;
+  return x < y ? -1 : x > y;
+}
+
+static Plane_Entry *incr_cache_find(Plane_Cache *cache, uint64_t hash) {
+  Plane_Entry key = {.hash = hash};
+  return bsearch(&key, cache->entries.items, cache->entries.count,
+                 sizeof(key), incr_entry_compare);
+}
+
+// The type of the value of node from the types of its operands
+static bool incr_type(Node *node, const Incr_Type *args, Incr_Type *type) {
+  Incr_Type want = INCR_NUMBER;
+  size_t from = 0;
+  *type = INCR_NUMBER;
+  switch (node->kind) {
+  case NK_BOOL:
+    *type = INCR_BOOL;
+    return true;
+  case NK_GT:
+    *type = INCR_BOOL;
+    break;
+  case NK_TRIPLE:
+    *type = INCR_TRIPLE;
+    break;
+  case NK_IF:
+    if (args[0] != INCR_BOOL) {
+      nob_log(ERROR, "%s:%d: the condition of if is a %s, expected a boolean",
+              node->file, node->line, incr_type_names[args[0]]);
+      return false;
+    }
+    want = *type = args[1];
+    from = 1;
+    break;
+  default:
+    break;
+  }
+  Node *children[3];
+  size_t n = node_children(node, children);
+  for (size_t i = from; i < n; ++i) {
+    if (args[i] != want) {
+      nob_log(ERROR, "%s:%d: operand %zu of %s is a %s, expected a %s",
+              node->file, node->line, i + 1, node_kind_name(node->kind),
+              incr_type_names[args[i]], incr_type_names[want]);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void incr_roll_back(Incr_Plan *plan, size_t start) {
+  for (size_t i = start; i < plan->steps.count; ++i) {
+    if (plan->steps.items[i].hit)
+      da_append(&plan->dormant, plan->steps.items[i]);
+  }
+  plan->steps.count = start;
+}
+
+// Appends the steps of the subtree at node and returns the step of node.
+// Subtrees that were planned before or are in the cache do not get steps.
+static size_t incr_plan(Incr_Plan *plan, Node *node) {
+  size_t start = plan->steps.count;
+  Incr_Step step = {.node = node, .size = 1, .slot = -1};
+  Node *children[3];
+  uint64_t hashes[3];
+  Incr_Type types[3];
+  step.arity = node_children(node, children);
+  for (size_t i = 0; i < step.arity; ++i) {
+    step.args[i] = incr_plan(plan, children[i]);
+    if (!plan->ok)
+      return 0;
+    Incr_Step *arg = &plan->steps.items[step.args[i]];
+    hashes[i] = arg->hash;
+    types[i] = arg->type;
+    step.size += arg->size;
+  }
+  step.hash = node_hash_with(node, hashes);
+
+  // Steps of subtrees that were rolled back may leave stale values behind
+  size_t *known = incr_index_value(&plan->index, step.hash);
+  if (*known < plan->steps.count &&
+      plan->steps.items[*known].hash == step.hash) {
+    incr_roll_back(plan, start);
+    return *known;
+  }
+  Plane_Entry *entry = incr_cache_find(plan->cache, step.hash);
+  if (entry) {
+    incr_roll_back(plan, start);
+    step.arity = 0;
+    step.hit = true;
+    step.type = entry->type;
+    step.planes = entry->planes;
+  } else if (!incr_type(node, types, &step.type)) {
+    plan->ok = false;
+    return 0;
+  }
+  da_append(&plan->steps, step);
+  // The table may have grown while planning the operands
+  *incr_index_value(&plan->index, step.hash) = plan->steps.count - 1;
+  return plan->steps.count - 1;
+}
+
+typedef struct {
+  Incr_Step *step;
+  double value; // time saved per byte when an edit leaves the subtree alone
+} Incr_Candidate;
+
+static int incr_candidate_compare(const void *a, const void *b) {
+  double x = ((const Incr_Candidate *)a)->value;
+  double y = ((const Incr_Candidate *)b)->value;
+  return x > y ? -1 : x < y;
+}
+
+// Decides which values to keep for the next render and replaces the entries
+// of the cache with them. An edit at a random node spares a subtree of size s
+// out of n with a chance of about (n - s) / n and then saves evaluating its s
+// nodes. The root is kept last, for renders of an unchanged tree. Planes this
+// render reads but that are not kept are added to plan->retired, the other
+// ones that are not kept are freed.
+static void incr_choose(Incr_Plan *plan, size_t plane_bytes, size_t budget) {
+  size_t count = plan->steps.count;
+  double n = (double)plan->steps.items[count - 1].size;
+  Incr_Candidate *candidates =
+      malloc((count + plan->dormant.count) * sizeof(*candidates));
+  NOB_ASSERT(candidates != NULL);
+  size_t candidates_count = 0;
+  for (size_t i = 0; i < count + plan->dormant.count; ++i) {
+    Incr_Step *s = i < count ? &plan->steps.items[i]
+                             : &plan->dormant.items[i - count];
+    if (s->arity == 0 && !s->hit)
+      continue; // leaves are as cheap to evaluate as to read
+    double spared = (n - (double)s->size + 1.0) / n;
+    candidates[candidates_count++] = (Incr_Candidate){
+        .step = s,
+        .value = spared * (double)s->size / incr_widths[s->type],
+    };
+  }
+  qsort(candidates, candidates_count, sizeof(*candidates),
+        incr_candidate_compare);
+
+  // What happens to each entry: 0 freed now, 1 freed after the render, 2 kept
+  Plane_Cache *cache = plan->cache;
+  uint8_t *fate = calloc(cache->entries.count + 1, 1);
+  NOB_ASSERT(fate != NULL);
+  for (size_t i = 0; i < count; ++i) {
+    Incr_Step *s = &plan->steps.items[i];
+    if (s->hit)
+      fate[incr_cache_find(cache, s->hash) - cache->entries.items] = 1;
+  }
+  struct {
+    Plane_Entry *items;
+    size_t count;
+    size_t capacity;
+  } kept = {0};
+  size_t bytes = 0;
+  for (size_t i = 0; i < candidates_count; ++i) {
+    Incr_Step *s = candidates[i].step;
+    size_t size = incr_widths[s->type] * plane_bytes;
+    uint8_t *entry_fate =
+        s->hit ? &fate[incr_cache_find(cache, s->hash) - cache->entries.items]
+               : NULL;
+    if (bytes + size > budget || (entry_fate && *entry_fate == 2))
+      continue;
+    bytes += size;
+    if (entry_fate) {
+      *entry_fate = 2;
+    } else {
+      s->planes = malloc(size);
+      NOB_ASSERT(s->planes != NULL);
+    }
+    da_append(&kept, ((Plane_Entry){.hash = s->hash,
+                                    .type = s->type,
+                                    .planes = s->planes,
+                                    .bytes = size}));
+  }
+
+  for (size_t i = 0; i < cache->entries.count; ++i) {
+    if (fate[i] == 0)
+      free(cache->entries.items[i].planes);
+    else if (fate[i] == 1)
+      da_append(&plan->retired, cache->entries.items[i].planes);
+  }
+  free(cache->entries.items);
+  cache->entries.items = kept.items;
+  cache->entries.count = kept.count;
+  cache->entries.capacity = kept.capacity;
+  cache->bytes = bytes;
+  qsort(cache->entries.items, cache->entries.count, sizeof(Plane_Entry),
+        incr_entry_compare);
+  free(fate);
+  free(candidates);
+}
+
+// Gives every value that only lives during a band a buffer slot, reusing the
+// slot of a value after its last use. Returns the number of slots.
+static int incr_allocate(Incr_Plan *plan) {
+  size_t count = plan->steps.count;
+  Incr_Step *steps = plan->steps.items;
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t j = 0; j < steps[i].arity; ++j)
+      steps[steps[i].args[j]].last_use = i;
+  }
+  steps[count - 1].last_use = count;
+
+  int *free_slots = malloc(count * sizeof(int));
+  NOB_ASSERT(free_slots != NULL);
+  size_t free_count = 0;
+  int slots = 0;
+  for (size_t i = 0; i < count; ++i) {
+    // Taken before the operands are released, the kernels do not expect
+    // their output to overlap an operand
+    if (steps[i].planes == NULL)
+      steps[i].slot = free_count > 0 ? free_slots[--free_count] : slots++;
+    for (size_t j = 0; j < steps[i].arity; ++j) {
+      Incr_Step *arg = &steps[steps[i].args[j]];
+      bool repeated = false;
+      for (size_t k = 0; k < j; ++k)
+        repeated = repeated || steps[i].args[k] == steps[i].args[j];
+      if (arg->last_use == i && arg->slot >= 0 && !repeated)
+        free_slots[free_count++] = arg->slot;
+    }
+  }
+  free(free_slots);
+  return slots;
+}
+
+typedef struct {
+  const Incr_Plan *plan;
+  Framebuffer *fb;
+  Render_Viewport view; // resolved
+  float t;
+  bool dither;
+  int slots;
+  atomic_int next_band;
+} Incr_Job;
+
+static void incr_planes(const Incr_Job *job, const Incr_Step *s, int y0,
+                        float *buffers, float *planes[3]) {
+  size_t image = (size_t)job->fb->width * job->fb->height;
+  size_t band = (size_t)job->fb->width * INCR_BAND_ROWS;
+  for (size_t p = 0; p < incr_widths[s->type]; ++p) {
+    planes[p] = s->planes ? s->planes + p * image + (size_t)y0 * job->fb->width
+                          : buffers + ((size_t)s->slot * 3 + p) * band;
+  }
+}
+
+// The same operations as eval(), on n pixels at once
+static void incr_eval_step(const Incr_Job *job, const Incr_Step *s, int y0,
+                           int rows, float *const out[3],
+                           float *const in[3][3]) {
+  int width = job->fb->width;
+  size_t n = (size_t)width * rows;
+  float *o = out[0];
+  const float *a = in[0][0], *b = in[1][0];
+  switch (s->node->kind) {
+  case NK_X:
+    for (int r = 0; r < rows; ++r) {
+      for (int x = 0; x < width; ++x)
+        o[(size_t)r * width + x] =
+            viewport_x(&job->view, (float)(job->view.x + x));
+    }
+    break;
+  case NK_Y:
+    for (int r = 0; r < rows; ++r) {
+      float ny = viewport_y(&job->view, (float)(job->view.y + y0 + r));
+      for (int x = 0; x < width; ++x)
+        o[(size_t)r * width + x] = ny;
+    }
+    break;
+  case NK_T:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = job->t;
+    break;
+  case NK_NUMBER:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = s->node->as.number;
+    break;
+  case NK_BOOL:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = s->node->as.boolean ? 1.0f : 0.0f;
+    break;
+  case NK_ADD:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = a[k] + b[k];
+    break;
+  case NK_MULT:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = a[k] * b[k];
+    break;
+  case NK_MOD:
+    math_fmodf_many(o, a, b, n);
+    break;
+  case NK_GT:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = a[k] > b[k] ? 1.0f : 0.0f;
+    break;
+  case NK_ATAN2:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = math_atan2f(a[k], b[k]);
+    break;
+  case NK_MIN:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = math_minf(a[k], b[k]);
+    break;
+  case NK_MAX:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = math_maxf(a[k], b[k]);
+    break;
+  case NK_SIN:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = math_sinf(a[k]);
+    break;
+  case NK_COS:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = math_cosf(a[k]);
+    break;
+  case NK_EXP:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = math_expf(a[k]);
+    break;
+  case NK_SQRT:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = math_sqrtf(a[k]);
+    break;
+  case NK_ABS:
+    for (size_t k = 0; k < n; ++k)
+      o[k] = fabsf(a[k]);
+    break;
+  case NK_TRIPLE:
+    for (int p = 0; p < 3; ++p)
+      memcpy(out[p], in[p][0], n * sizeof(float));
+    break;
+  case NK_IF: {
+    const float *c = in[0][0];
+    for (size_t p = 0; p < incr_widths[s->type]; ++p) {
+      const float *then = in[1][p], *elze = in[2][p];
+      for (size_t k = 0; k < n; ++k)
+        out[p][k] = c[k] != 0.0f ? then[k] : elze[k];
+    }
+    break;
+  }
+  }
+}
+
+static void *incr_worker(void *arg) {
+  Incr_Job *job = arg;
+  const Incr_Plan *plan = job->plan;
+  Framebuffer *fb = job->fb;
+  size_t band = (size_t)fb->width * INCR_BAND_ROWS;
+  float *buffers = malloc(((size_t)job->slots * 3 + 1) * band * sizeof(float));
+  NOB_ASSERT(buffers != NULL);
+  trace_thread_name("incremental worker");
+
+  int bands = (fb->height + INCR_BAND_ROWS - 1) / INCR_BAND_ROWS;
+  for (;;) {
+    int index = atomic_fetch_add(&job->next_band, 1);
+    if (index >= bands)
+      break;
+    Trace_Span span = trace_begin("incremental band");
+    int y0 = index * INCR_BAND_ROWS;
+    int rows = fb->height - y0 < INCR_BAND_ROWS ? fb->height - y0
+                                                : INCR_BAND_ROWS;
+    for (size_t i = 0; i < plan->steps.count; ++i) {
+      const Incr_Step *s = &plan->steps.items[i];
+      if (s->hit)
+        continue;
+      float *out[3], *in[3][3] = {0};
+      incr_planes(job, s, y0, buffers, out);
+      for (size_t j = 0; j < s->arity; ++j)
+        incr_planes(job, &plan->steps.items[s->args[j]], y0, buffers, in[j]);
+      incr_eval_step(job, s, y0, rows, out, in);
+    }
+    float *color[3];
+    incr_planes(job, &plan->steps.items[plan->steps.count - 1], y0, buffers,
+                color);
+    for (int r = 0; r < rows; ++r) {
+      size_t offset = (size_t)r * fb->width;
+      quantize_row(color[0] + offset, color[1] + offset, color[2] + offset,
+                   framebuffer_row(fb, y0 + r), fb->width, job->view.x,
+                   job->view.y + y0 + r, job->dither);
+    }
+    trace_end_arg(span, "y", y0);
+  }
+
+  free(buffers);
+  return NULL;
+}
+
+static void incr_cache_clear(Plane_Cache *cache) {
+  for (size_t i = 0; i < cache->entries.count; ++i)
+    free(cache->entries.items[i].planes);
+  cache->entries.count = 0;
+  cache->bytes = 0;
+}
+
+bool render_incremental(Node *f, Framebuffer *fb, const Render_Options *opts,
+                        Plane_Cache *cache) {
+  Render_Options defaults = {0};
+  if (opts == NULL)
+    opts = &defaults;
+  Render_Viewport view =
+      viewport_resolve(&opts->viewport, fb->width, fb->height);
+  if (!viewport_check(&view, fb->width, fb->height))
+    return false;
+  Trace_Span span = trace_begin("render_incremental");
+#ifdef RANDOMART_PROFILE
+  nob_log(WARNING,
+          "The profiler does not cover incremental renders, no report");
+#endif
+  if (cache->width != fb->width || cache->height != fb->height ||
+      cache->t != opts->t ||
+      memcmp(&cache->viewport, &view, sizeof(view)) != 0) {
+    incr_cache_clear(cache);
+    cache->width = fb->width;
+    cache->height = fb->height;
+    cache->t = opts->t;
+    cache->viewport = view;
+  }
+
+  Incr_Plan plan = {.cache = cache, .ok = true};
+  incr_plan(&plan, f);
+  if (plan.ok && plan.steps.items[plan.steps.count - 1].type != INCR_TRIPLE) {
+    nob_log(ERROR, "%s:%d: the tree is a %s, expected a triple", f->file,
+            f->line,
+            incr_type_names[plan.steps.items[plan.steps.count - 1].type]);
+    plan.ok = false;
+  }
+  bool ok = plan.ok;
+  if (ok) {
+    size_t plane_bytes = (size_t)fb->width * fb->height * sizeof(float);
+    incr_choose(&plan, plane_bytes,
+                cache->budget > 0 ? cache->budget : PLANE_CACHE_DEFAULT_BUDGET);
+    Incr_Job job = {
+        .plan = &plan,
+        .fb = fb,
+        .view = view,
+        .t = opts->t,
+        .dither = opts->dither,
+        .slots = incr_allocate(&plan),
+    };
+
+    int threads = opts->threads > 0 ? opts->threads : cpu_count();
+    pthread_t *handles = calloc(threads, sizeof(*handles));
+    NOB_ASSERT(handles != NULL);
+    int started = 0;
+    for (; started < threads; ++started) {
+      if (pthread_create(&handles[started], NULL, incr_worker, &job) != 0) {
+        nob_log(ERROR, "Could not create incremental worker %d", started);
+        break;
+      }
+    }
+    for (int i = 0; i < started; ++i)
+      pthread_join(handles[i], NULL);
+    free(handles);
+    // The planes of a render that did not finish are not complete
+    ok = started == threads;
+    if (!ok)
+      incr_cache_clear(cache);
+  }
+  for (size_t i = 0; i < plan.retired.count; ++i)
+    free(plan.retired.items[i]);
+
+  cache->evaluated = cache->reused = 0;
+  for (size_t i = 0; ok && i < plan.steps.count; ++i) {
+    if (plan.steps.items[i].hit)
+      cache->reused += 1;
+    else
+      cache->evaluated += 1;
+  }
+  if (ok && opts->log_stats) {
+    nob_log(INFO,
+            "Incremental: %zu nodes evaluated, %zu subtrees reused, %zu "
+            "planes kept (%.1f MB)",
+            cache->evaluated, cache->reused, cache->entries.count,
+            cache->bytes / 1e6);
+  }
+  free(plan.steps.items);
+  free(plan.index.keys);
+  free(plan.index.values);
+  free(plan.retired.items);
+  free(plan.dormant.items);
+  trace_end(span);
+  return ok;
+}
+
+void plane_cache_free(Plane_Cache *cache) {
+  incr_cache_clear(cache);
+  free(cache->entries.items);
+  *cache = (Plane_Cache){.budget = cache->budget};
+}
@@ -0,0 +1,60 @@
+#ifndef INCREMENTAL_H_
+#define INCREMENTAL_H_
+
+// Incremental rendering for loops that change a subtree and render again.
+//
+// render_incremental() evaluates the tree one node at a time over bands of
+// rows, each node into planes of floats holding its value at every pixel of
+// the band, and keeps the full-image planes of some of the nodes in a
+// Plane_Cache. The planes are keyed by node_hash(), so the next render finds
+// them for every subtree that did not change, whether the tree was edited in
+// place or built again, and only evaluates the nodes above them: after an edit
+// near the leaves, the edited node and its ancestors.
+//
+// Which planes are kept is decided per render within the byte budget of the
+// cache, preferring subtrees that are expensive to evaluate but small enough
+// that an edit elsewhere is likely to leave them alone. Planes of subtrees that
+// are not part of the latest tree are dropped.
+//
+// The image is the one render_pixels() produces with the same options,
+// viewport included, except that anti-aliasing and symmetry are not supported
+// and the backend is not used. Identical subtrees are evaluated once.
+
+#include "node.h"
+#include "render.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Default budget of a zero-initialized Plane_Cache
+#define PLANE_CACHE_DEFAULT_BUDGET ((size_t)512 << 20)
+
+typedef struct {
+  uint64_t hash;
+  int type;      // number, boolean or triple
+  float *planes; // one or three planes of width * height floats
+  size_t bytes;
+} Plane_Entry;
+
+typedef struct {
+  size_t budget; // bytes of planes kept between renders, 0 for the default
+  // Size, t and resolved viewport of the planes
+  int width, height;
+  float t;
+  Render_Viewport viewport;
+  struct {
+    Plane_Entry *items; // sorted by hash
+    size_t count;
+    size_t capacity;
+  } entries;
+  size_t bytes;
+  // Of the last render
+  size_t evaluated; // nodes evaluated
+  size_t reused;    // subtrees taken from the cache
+} Plane_Cache;
+
+bool render_incremental(Node *f, Framebuffer *fb, const Render_Options *opts,
+                        Plane_Cache *cache);
+void plane_cache_free(Plane_Cache *cache);
+
+#endif // INCREMENTAL_H_
@@ -0,0 +1,9 @@
+// Single translation unit holding the implementations of the header-only
+// libraries used by the project. stb_image_write.h is implemented in image.c.
+#define NOB_IMPLEMENTATION
+#define ARENA_IMPLEMENTATION
+#define SLAB_IMPLEMENTATION
+
+#include "arena.h"
+#include "nob.h"
+#include "slab.h"
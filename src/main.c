@@ -1,236 +1,34 @@
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#define NOB_IMPLEMENTATION
 #define NOB_STRIP_PREFIX
-#define ARENA_IMPLEMENTATION
 
-#include "arena.h"
+#include "anim.h"
+#include "bintree.h"
+#include "cache.h"
+#include "cost.h"
+#include "daemon.h"
+#include "image.h"
 #include "nob.h"
-#include "stb_image_write.h"
+#include "node.h"
+#include "parse.h"
+#include "perf.h"
+#include "render.h"
+#include "shard.h"
+#include "stream.h"
+#include "trace.h"
+#include <inttypes.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define WIDTH 1440
 #define HEIGHT 1080
-
-static Arena node_arena = {0};
-
-typedef enum {
-  NK_X,
-  NK_Y,
-  NK_NUMBER,
-  NK_ADD,
-  NK_MULT,
-  NK_TRIPLE,
-  NK_BOOL,
-  NK_GT,
-  NK_IF,
-  NK_MOD,
-} Node_Kind;
-
-typedef struct Node Node;
-
-typedef struct {
-  Node *lhs;
-  Node *rhs;
-} Node_Binop;
-
-typedef struct {
-  Node *first;
-  Node *second;
-  Node *third;
-} Node_Triple;
-
-typedef struct {
-  Node *cond;
-  Node *then;
-  Node *elze;
-} node_if;
-
-typedef union {
-  float number;
-  Node_Binop binop; // binary operaton;
-  Node_Triple triple;
-  bool boolean;
-  node_if iff;
-} Node_As;
-
-struct Node {
-  Node_Kind kind;
-  const char *file;
-  int line;
-  Node_As as;
-};
-
-Node *node_loc(const char *file, int line, Node_Kind kind) {
-  Node *node = arena_alloc(&node_arena, sizeof(Node));
-  node->kind = kind;
-  node->file = file;
-  node->line = line;
-  return node;
-}
-
-Node *node_number_loc(const char *file, int line, float number) {
-  Node *node = node_loc(file, line, NK_NUMBER);
-  node->as.number = number;
-  return node;
-}
-
-#define node_number(number) node_number_loc(__FILE__, __LINE__, number)
-
-#define node_x() node_loc(__FILE__, __LINE__, NK_X)
-
-// Node *node_x_loc(const char *file, int line) {
-//   return node_loc(file, line, NK_X);
-// }
-
-#define node_y() node_loc(__FILE__, __LINE__, NK_Y)
-
-// Node *node_y(void) {
-//   Node *node = arena_alloc(&node_arena, sizeof(Node));
-//   node->kind = NK_Y;
-//   return node;
-// }
-
-Node *node_add_loc(const char *file, int line, Node *lhs, Node *rhs) {
-  Node *node = node_loc(file, line, NK_ADD);
-  node->as.binop.lhs = lhs;
-  node->as.binop.rhs = rhs;
-  return node;
-}
-
-#define node_add(lhs, rhs) node_add_loc(__FILE__, __LINE__, lhs, rhs)
-
-Node *node_mult_loc(const char *file, int line, Node *lhs, Node *rhs) {
-  Node *node = node_loc(file, line, NK_MULT);
-  node->as.binop.lhs = lhs;
-  node->as.binop.rhs = rhs;
-  return node;
-}
-
-#define node_mult(lhs, rhs) node_mult_loc(__FILE__, __LINE__, lhs, rhs)
-
-Node *node_triple_loc(const char *file, int line, Node *first, Node *second,
-                      Node *third) {
-  Node *node = node_loc(file, line, NK_TRIPLE);
-  node->as.triple.first = first;
-  node->as.triple.second = second;
-  node->as.triple.third = third;
-  return node;
-}
-
-#define node_triple(first, second, third)                                      \
-  node_triple_loc(__FILE__, __LINE__, first, second, third)
-
-Node *node_if_loc(const char *file, int line, Node *cond, Node *then,
-                  Node *elze) {
-  Node *node = node_loc(file, line, NK_IF);
-  node->as.iff.cond = cond;
-  node->as.iff.then = then;
-  node->as.iff.elze = elze;
-  return node;
-}
-
-#define node_if(cond, then, elze)                                              \
-  node_if_loc(__FILE__, __LINE__, cond, then, elze)
-
-Node *node_gt_loc(const char *file, int line, Node *lhs, Node *rhs) {
-  Node *node = node_loc(file, line, NK_GT);
-  node->as.binop.lhs = lhs;
-  node->as.binop.rhs = rhs;
-  return node;
-}
-
-#define node_gt(lhs, rhs) node_gt_loc(__FILE__, __LINE__, lhs, rhs)
-
-Node *node_mod_loc(const char *file, int line, Node *lhs, Node *rhs) {
-  Node *node = node_loc(file, line, NK_MOD);
-  node->as.binop.lhs = lhs;
-  node->as.binop.rhs = rhs;
-  return node;
-}
-
-#define node_mod(lhs, rhs) node_mod_loc(__FILE__, __LINE__, lhs, rhs)
-
-void node_print(Node *node) {
-  switch (node->kind) {
-  case NK_X:
-    printf("x");
-    break;
-  case NK_Y:
-    printf("y");
-    break;
-  case NK_NUMBER:
-    printf("%f", node->as.number);
-    break;
-  case NK_MOD:
-    printf("mod(");
-    node_print(node->as.binop.lhs);
-    printf(", ");
-    node_print(node->as.binop.rhs);
-    printf(")");
-    break;
-
-  case NK_BOOL:
-    printf("%s", node->as.boolean ? "true" : "false");
-    break;
-  case NK_GT:
-    printf("gt(");
-    node_print(node->as.binop.lhs);
-    printf(", ");
-    node_print(node->as.binop.rhs);
-    printf(")");
-    break;
-  case NK_ADD:
-    printf("(");
-    node_print(node->as.binop.lhs);
-    printf(", ");
-    node_print(node->as.binop.rhs);
-    printf(")");
-    break;
-  case NK_MULT:
-    printf("mult(");
-    node_print(node->as.binop.lhs);
-    printf(", ");
-    node_print(node->as.binop.rhs);
-    printf(")");
-    break;
-  case NK_TRIPLE:
-    printf("(");
-    node_print(node->as.triple.first);
-    printf(", ");
-    node_print(node->as.triple.second);
-    printf(", ");
-    node_print(node->as.triple.third);
-    printf(")");
-    break;
-  case NK_IF:
-    printf("if ");
-    node_print(node->as.iff.cond);
-    printf(" then ");
-    node_print(node->as.iff.then);
-    printf(" else ");
-    node_print(node->as.iff.elze);
-    break;
-  }
-}
-
-typedef struct {
-  uint8_t r;
-  uint8_t g;
-  uint8_t b;
-  uint8_t a;
-} RGBA32;
-
-static RGBA32 pixels[WIDTH * HEIGHT];
+#define CACHE_DEFAULT_MAX_MB 256
 
 typedef struct {
   float X, Y;
 } Vector2;
 
-typedef struct {
-  float r, g, b;
-} Color;
-
 Color grey_gradient(float x, float y) {
   (void)y;
   return (Color){x, x, x};
@@ -255,225 +53,451 @@ Color justTry(float x, float y) {
   }
 }
 
-bool expect_number(Node *expr) {
-  if (expr->kind != NK_NUMBER) {
-    printf("%s:%d: ERROR: expected number\n", expr->file, expr->line);
-    return false;
-  };
-  return true;
-}
-
-bool expect_triple(Node *expr) {
-  if (expr->kind != NK_TRIPLE) {
-    printf("%s:%d: ERROR: expected triple\n", expr->file, expr->line);
-    return false;
-  }
-  return true;
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [--cost-model FILE] [--budget-ms MS] [--trace FILE] "
+          "[--perf] [--dither] [--progressive] [--aa N] [--aa-budget N] "
+          "[--symmetry MODE] [--expr FILE] [--save-bin FILE] [--frames N] "
+          "[--frame-batch N] [--frame-cache-mb MB] "
+          "[--stream y4m|raw] [--cache DIR] [--cache-max-mb MB] "
+          "[--daemon SOCKET] [--daemon-workers N] [--daemon-queue N] "
+          "[--center X,Y] [--scale S] [--region X,Y,W,H] [--size W,H] "
+          "[--threads N] [--shards N] [--raw FILE]\n"
+          "  --cost-model FILE  predict the render time with a model saved by "
+          "kind-bench\n"
+          "  --budget-ms MS     refuse to render if the render may take longer "
+          "than MS, given\n"
+          "                     the error range of the cost model\n"
+          "  --trace FILE       write a Chrome trace-event timeline to FILE\n"
+          "  --perf             report hardware counters for render and encode\n"
+          "  --dither           ordered dithering when quantizing colors\n"
+          "  --aa N             up to N samples for pixels on edges\n"
+          "  --aa-budget N      at most N extra samples for the whole image\n"
+          "  --expr FILE        render the expression in FILE instead of the "
+          "built-in one\n"
+          "                     (text, or the first tree of a binary file)\n"
+          "  --save-bin FILE    save the expression in the binary format\n"
+          "  --symmetry MODE    proven or sampled: evaluate only the part "
+          "of a symmetric image\n"
+          "                     that cannot be mirrored\n"
+          "  --progressive      write a coarse preview to output.png first, "
+          "refined twice\n"
+          "  --frames N         render N frames of an animated version to "
+          "output-NNNN.png\n"
+          "  --frame-batch N    frames rendered together (default 8)\n"
+          "  --frame-cache-mb MB keep the parts of the tree that do not depend "
+          "on t for every\n"
+          "                     pixel up to MB (default 256), or evaluate them "
+          "again per batch\n"
+          "  --stream FORMAT    write the frames to stdout instead, as y4m "
+          "or raw RGBA\n"
+          "  --cache DIR        reuse the image of an earlier render of the "
+          "same expression\n"
+          "                     and settings, kept in DIR\n"
+          "  --cache-max-mb MB  evict the least recently used images beyond "
+          "MB (default %d)\n"
+          "  --daemon SOCKET    serve render requests on a Unix domain socket "
+          "(see daemon.h)\n"
+          "  --daemon-workers N requests rendered at once (default 2)\n"
+          "  --daemon-queue N   connections waiting before new ones are "
+          "turned away (default 16)\n"
+          "  --center X,Y       center the image on (X, Y) instead of the "
+          "origin\n"
+          "  --scale S          show [-S, S] around the center instead of "
+          "[-1, 1]\n"
+          "  --region X,Y,W,H   render only the W x H pixels at X,Y of the "
+          "image, as they\n"
+          "                     are in the whole image, to output.png\n"
+          "  --size W,H         size of the image (default %dx%d)\n"
+          "  --threads N        render workers (default one per CPU)\n"
+          "  --shards N         render in N bands, each in a process of its "
+          "own, and stitch\n"
+          "                     them into output.png (see shard.h)\n"
+          "  --raw FILE         write the RGBA pixels to FILE instead of "
+          "output.png\n",
+          program, CACHE_DEFAULT_MAX_MB, WIDTH, HEIGHT);
 }
 
-bool expect_boolean(Node *expr) {
-  if (expr->kind != NK_BOOL) {
-    printf("%s:%d: ERROR: expected boolean\n", expr->file, expr->line);
+static bool save_preview(const Framebuffer *fb, int pass, int step,
+                         void *user) {
+  const char *path = user;
+  if (step == 1)
+    return true; // the final image is saved like a normal render
+  if (!image_write_png(fb, path))
     return false;
-  }
+  nob_log(INFO, "Pass %d (%dx%d blocks) saved to: %s", pass, step, step, path);
   return true;
 }
 
-Node *node_boolean_loc(const char *file, int line, bool boolean) {
-  Node *node = node_loc(file, line, NK_BOOL);
-  node->as.boolean = boolean;
-  return node;
+// stdout carries the frames when streaming, so the banners are left out
+static int success(const char *trace_path, bool streaming) {
+  if (trace_path && !trace_finish())
+    return 1;
+  if (streaming)
+    return 0;
+  printf("Success\n");
+  printf("\033[1;34m\n------------code Execution ends "
+         "here------------\n\033[0m");
+  return 0;
 }
 
-Node *eval(Node *expr, float x, float y) {
-  switch (expr->kind) {
-  case NK_X: {
-    return node_number_loc(expr->file, expr->line, x);
-    break;
-  }
-  case NK_Y: {
-    return node_number_loc(expr->file, expr->line, y);
-    break;
-  }
-  case NK_NUMBER: {
-    return expr;
-    break;
+int main(int argc, char **argv) {
+  const char *program = shift(argv, argc);
+  const char *cost_model_path = NULL;
+  double budget_ms = 0.0;
+  const char *trace_path = NULL;
+  bool perf = false;
+  bool dither = false;
+  bool progressive = false;
+  int aa_samples = 0;
+  size_t aa_budget = 0;
+  Symmetry_Mode symmetry = SYMMETRY_OFF;
+  const char *expr_path = NULL;
+  const char *save_bin_path = NULL;
+  int frames = 0;
+  int frame_batch = 0;
+  size_t frame_cache_mb = 0;
+  const char *stream_name = NULL;
+  Render_Cache cache = {.max_bytes = (uint64_t)CACHE_DEFAULT_MAX_MB << 20};
+  const char *daemon_socket = NULL;
+  Daemon_Options daemon = {0};
+  Render_Viewport viewport = {0};
+  bool region = false;
+  int width = WIDTH, height = HEIGHT;
+  int threads = 0;
+  int shards = 0;
+  const char *raw_path = NULL;
+  // The options the pixels depend on, passed on to the shards
+  Cmd forward = {0};
+  while (argc > 0) {
+    const char *flag = shift(argv, argc);
+    if (strcmp(flag, "--cost-model") == 0 && argc > 0) {
+      cost_model_path = shift(argv, argc);
+    } else if (strcmp(flag, "--budget-ms") == 0 && argc > 0) {
+      budget_ms = atof(shift(argv, argc));
+    } else if (strcmp(flag, "--trace") == 0 && argc > 0) {
+      trace_path = shift(argv, argc);
+    } else if (strcmp(flag, "--perf") == 0) {
+      perf = true;
+    } else if (strcmp(flag, "--dither") == 0) {
+      dither = true;
+      cmd_append(&forward, flag);
+    } else if (strcmp(flag, "--aa") == 0 && argc > 0) {
+      const char *value = shift(argv, argc);
+      aa_samples = atoi(value);
+      cmd_append(&forward, flag, value);
+    } else if (strcmp(flag, "--aa-budget") == 0 && argc > 0) {
+      aa_budget = strtoull(shift(argv, argc), NULL, 10);
+    } else if (strcmp(flag, "--expr") == 0 && argc > 0) {
+      expr_path = shift(argv, argc);
+      cmd_append(&forward, flag, expr_path);
+    } else if (strcmp(flag, "--save-bin") == 0 && argc > 0) {
+      save_bin_path = shift(argv, argc);
+    } else if (strcmp(flag, "--symmetry") == 0 && argc > 0) {
+      const char *name = shift(argv, argc);
+      if (!symmetry_mode_by_name(name, &symmetry)) {
+        nob_log(ERROR, "Unknown symmetry mode: %s", name);
+        return 1;
+      }
+      cmd_append(&forward, flag, name);
+    } else if (strcmp(flag, "--progressive") == 0) {
+      progressive = true;
+    } else if (strcmp(flag, "--frames") == 0 && argc > 0) {
+      frames = atoi(shift(argv, argc));
+    } else if (strcmp(flag, "--frame-batch") == 0 && argc > 0) {
+      frame_batch = atoi(shift(argv, argc));
+    } else if (strcmp(flag, "--frame-cache-mb") == 0 && argc > 0) {
+      frame_cache_mb = strtoull(shift(argv, argc), NULL, 10);
+    } else if (strcmp(flag, "--stream") == 0 && argc > 0) {
+      stream_name = shift(argv, argc);
+    } else if (strcmp(flag, "--cache") == 0 && argc > 0) {
+      cache.dir = shift(argv, argc);
+    } else if (strcmp(flag, "--cache-max-mb") == 0 && argc > 0) {
+      cache.max_bytes = strtoull(shift(argv, argc), NULL, 10) << 20;
+    } else if (strcmp(flag, "--daemon") == 0 && argc > 0) {
+      daemon_socket = shift(argv, argc);
+    } else if (strcmp(flag, "--daemon-workers") == 0 && argc > 0) {
+      daemon.workers = atoi(shift(argv, argc));
+    } else if (strcmp(flag, "--daemon-queue") == 0 && argc > 0) {
+      daemon.queue = atoi(shift(argv, argc));
+    } else if (strcmp(flag, "--center") == 0 && argc > 0) {
+      const char *value = shift(argv, argc);
+      if (sscanf(value, "%f,%f", &viewport.center_x, &viewport.center_y) !=
+          2) {
+        nob_log(ERROR, "Expected --center X,Y, got: %s", value);
+        return 1;
+      }
+      cmd_append(&forward, flag, value);
+    } else if (strcmp(flag, "--scale") == 0 && argc > 0) {
+      const char *value = shift(argv, argc);
+      viewport.scale = atof(value);
+      cmd_append(&forward, flag, value);
+    } else if (strcmp(flag, "--region") == 0 && argc > 0) {
+      const char *value = shift(argv, argc);
+      if (sscanf(value, "%d,%d,%d,%d", &viewport.x, &viewport.y,
+                 &viewport.width, &viewport.height) != 4 ||
+          viewport.width <= 0 || viewport.height <= 0) {
+        nob_log(ERROR, "Expected --region X,Y,W,H, got: %s", value);
+        return 1;
+      }
+      region = true;
+    } else if (strcmp(flag, "--size") == 0 && argc > 0) {
+      const char *value = shift(argv, argc);
+      if (sscanf(value, "%d,%d", &width, &height) != 2 || width <= 0 ||
+          height <= 0) {
+        nob_log(ERROR, "Expected --size W,H, got: %s", value);
+        return 1;
+      }
+    } else if (strcmp(flag, "--threads") == 0 && argc > 0) {
+      threads = atoi(shift(argv, argc));
+    } else if (strcmp(flag, "--shards") == 0 && argc > 0) {
+      shards = atoi(shift(argv, argc));
+    } else if (strcmp(flag, "--raw") == 0 && argc > 0) {
+      raw_path = shift(argv, argc);
+    } else {
+      usage(program);
+      return 1;
+    }
   }
-  case NK_BOOL: {
-    return expr;
-    break;
+  if (budget_ms > 0.0 && cost_model_path == NULL) {
+    nob_log(ERROR, "--budget-ms needs --cost-model");
+    return 1;
   }
-  case NK_GT: {
-    Node *lhs = eval(expr->as.binop.lhs, x, y);
-    if (!lhs)
-      return NULL;
-    if (!expect_number(lhs)) {
-      return NULL;
+  Stream_Format stream_format = STREAM_Y4M;
+  if (stream_name) {
+    if (!stream_format_by_name(stream_name, &stream_format)) {
+      nob_log(ERROR, "Unknown stream format: %s", stream_name);
+      return 1;
+    }
+    if (frames <= 0) {
+      nob_log(ERROR, "--stream needs --frames");
+      return 1;
     }
-    Node *rhs = eval(expr->as.binop.rhs, x, y);
-    if (!rhs)
-      return NULL;
-    if (!expect_number(rhs))
-      return NULL;
-    return node_boolean_loc(expr->file, expr->line,
-                            lhs->as.number > rhs->as.number);
-    break;
   }
-
-  case NK_ADD: {
-    Node *lhs = eval(expr->as.binop.lhs, x, y);
-    if (!lhs)
-      return NULL;
-    if (!expect_number(lhs))
-      return NULL;
-    Node *rhs = eval(expr->as.binop.rhs, x, y);
-    if (!rhs)
-      return NULL;
-    if (!expect_number(rhs))
-      return NULL;
-    return node_number_loc(expr->file, expr->line,
-                           lhs->as.number + rhs->as.number);
-    break;
+  if (shards > 0 && (region || raw_path || progressive || perf ||
+                     aa_budget > 0 || frames > 0)) {
+    nob_log(ERROR, "--shards does not go with --region, --raw, "
+                   "--progressive, --perf, --aa-budget or --frames");
+    return 1;
   }
-  case NK_MULT: {
-    Node *lhs = eval(expr->as.binop.lhs, x, y);
-    if (!lhs)
-      return NULL;
-    if (!expect_number(lhs))
-      return NULL;
-    Node *rhs = eval(expr->as.binop.rhs, x, y);
-    if (!rhs)
-      return NULL;
-    if (!expect_number(rhs))
-      return NULL;
-    return node_number_loc(expr->file, expr->line,
-                           lhs->as.number * rhs->as.number);
-    break;
+  if (progressive && (aa_samples > 1 || symmetry != SYMMETRY_OFF)) {
+    nob_log(ERROR, "--progressive does not go with --aa or --symmetry");
+    return 1;
   }
-  case NK_TRIPLE: {
-    Node *first = eval(expr->as.triple.first, x, y);
-    Node *second = eval(expr->as.triple.second, x, y);
-    Node *third = eval(expr->as.triple.third, x, y);
-    return node_triple_loc(expr->file, expr->line, first, second, third);
-    break;
+  if (trace_path)
+    trace_start(trace_path);
+  if (daemon_socket) {
+    bool served = daemon_run(daemon_socket, &daemon);
+    if (trace_path && !trace_finish())
+      return 1;
+    return served ? 0 : 1;
   }
-  case NK_MOD: {
-    Node *lhs = eval(expr->as.binop.lhs, x, y);
-    if (!lhs)
-      return NULL;
-    if (!expect_number(lhs))
-      return NULL;
-    Node *rhs = eval(expr->as.binop.rhs, x, y);
-    if (!rhs)
-      return NULL;
-    if (!expect_number(rhs))
-      return NULL;
-    return node_number_loc(expr->file, expr->line,
-                           fmodf(lhs->as.number, rhs->as.number));
 
-    break;
-  }
-  case NK_IF: {
-    Node *cond = eval(expr->as.iff.cond, x, y);
-    if (!cond)
-      return NULL;
-    if (!expect_boolean(cond))
-      return NULL;
-    Node *then = eval(expr->as.iff.then, x, y);
-    if (!then)
-      return NULL;
-    Node *elze = eval(expr->as.iff.elze, x, y);
-    if (!elze)
-      return NULL;
-    return cond->as.boolean ? then : elze;
-    break;
-  }
-  default: {
-    NOB_UNREACHABLE("eval");
+  // Workers of --shards write pixels, not banners
+  if (!stream_name && !raw_path)
+    printf("\033[1;32m\n------------code Execution starts "
+         "here------------\n\033[0m");
+  // bool ok = render_pixels(node_if(
+  //     node_gt(node_mult(node_x(), node_y()), node_number(0)),
+  //     node_triple(node_x(), node_y(), node_number(1)),
+  //     node_triple(node_mod(node_x(), node_y()), node_mod(node_x(), node_y()),
+  //                 node_mod(node_x(), node_y()))));
+  // bool ok = render_pixels(node_triple(node_y(), node_x(), node_x()));
+  Trace_Span span = trace_begin("build tree");
+  Node *f = NULL;
+  // A binary tree is rendered from the mapping of the file, unless something
+  // below needs its nodes
+  Bintree_File file;
+  Bintree bin;
+  bool in_place = false;
+  if (expr_path && bintree_is_file(expr_path)) {
+    if (!bintree_open(&file, expr_path))
+      return 1;
+    bool loaded = bintree_get(&file, 0, &bin);
+    in_place = loaded && !save_bin_path && frames <= 0 && !progressive &&
+               symmetry == SYMMETRY_OFF && !cache.dir && !cost_model_path;
+    if (!in_place) {
+      f = loaded ? bintree_to_node(&bin) : NULL;
+      bintree_close(&file);
+      if (f == NULL)
+        return 1;
+    }
+  } else if (expr_path) {
+    f = parse_file(expr_path);
+    if (f == NULL)
+      return 1;
+  } else {
+    // When animating, the boundary between the two halves sweeps back and
+    // forth
+    Node *threshold =
+        frames > 0 ? node_mult(node_number(0.5f),
+                               node_sin(node_mult(node_t(),
+                                                  node_number(6.28318531f))))
+                   : node_number(0);
+    f = node_if(
+        node_gt(node_mult(node_x(), node_y()), threshold),
+        node_triple(node_x(), node_y(), node_number(1)),
+        node_triple(node_mod(node_x(), node_y()), node_mod(node_x(), node_y()),
+                    node_mod(node_x(), node_y())));
   }
+  trace_end(span);
+  if (save_bin_path) {
+    if (!bintree_write_file(save_bin_path, &f, 1))
+      return 1;
+    nob_log(INFO, "Expression saved to: %s", save_bin_path);
   }
-}
 
-bool *eval_func(Node *body, float x, float y, Color *c) {
-  Node *result = eval(body, x, y);
-  if (result == NULL) {
-    return (void *)false;
-  }
-  if (!expect_triple(result)) {
-    return (void *)false;
-  }
-  if (!expect_number(result->as.triple.first)) {
-    return (void *)false;
+  if (frames > 0) {
+    if (region || raw_path || viewport.scale != 0.0f ||
+        viewport.center_x != 0.0f || viewport.center_y != 0.0f) {
+      nob_log(ERROR,
+              "--center, --scale, --region and --raw do not apply to frames");
+      return 1;
+    }
+    Anim_Options anim = {
+        .frames = frames,
+        .t0 = 0.0f,
+        .t1 = 1.0f,
+        .width = width,
+        .height = height,
+        .batch = frame_batch,
+        .cache_mb = frame_cache_mb,
+        .dither = dither,
+        .pattern = "output-%04d.png",
+    };
+    if (stream_name) {
+      anim.stream = stream_open(fileno(stdout), stream_format, width, height,
+                                30, 0);
+      if (anim.stream == NULL)
+        return 1;
+      bool ok = render_animation(f, &anim);
+      if (!stream_close(anim.stream) || !ok)
+        return 1;
+      nob_log(INFO, "Streamed %d frames to stdout", frames);
+      return success(trace_path, true);
+    }
+    if (!render_animation(f, &anim))
+      return 1;
+    nob_log(INFO, "Frames saved to: output-0000.png .. output-%04d.png",
+            frames - 1);
+    return success(trace_path, false);
   }
-  if (!expect_number(result->as.triple.second)) {
-    return (void *)false;
+  Framebuffer fb = {.width = width, .height = height};
+  if (region) {
+    // The framebuffer is the region, the viewport the whole image
+    fb.width = viewport.width;
+    fb.height = viewport.height;
+    viewport.width = width;
+    viewport.height = height;
   }
-  if (!expect_number(result->as.triple.third)) {
-    return (void *)false;
+  Render_Options opts = {
+      .threads = threads,
+      .log_stats = raw_path == NULL,
+      .dither = dither,
+      .aa_samples = aa_samples,
+      .aa_budget = aa_budget,
+      .symmetry = symmetry,
+      .viewport = viewport,
+  };
+  const char *output_path = "output.png";
+
+  uint64_t cache_key_value = 0;
+  if (cache.dir && !raw_path) {
+    span = trace_begin("cache lookup");
+    cache_key_value = cache_key(f, fb.width, fb.height, &opts);
+    bool hit = cache_fetch(&cache, cache_key_value, output_path);
+    trace_end(span);
+    if (hit) {
+      nob_log(INFO, "Cache hit %016" PRIx64 ", image copied to: %s",
+              cache_key_value, output_path);
+      return success(trace_path, false);
+    }
   }
-  c->r = result->as.triple.first->as.number;
-  c->g = result->as.triple.second->as.number;
-  c->b = result->as.triple.third->as.number;
-  return (void *)true;
-}
 
-bool render_pixels(Node *f) {
-  // inside thew for loop we have to normalize the HEIGHT and WIDTH between -1
-  // to 1 but we have current range 0 to Height and 0 to Width;
-  for (int y = 0; y < HEIGHT; y++) {
-    // 0..<HEIGHT -> 0..<1 -> 0..<2 -> -1..<1
-    float ny = (float)y / HEIGHT * 2.0f - 1.0f;
-    for (int x = 0; x < WIDTH; x++) {
-      // 0..<WIDTH -> 0..<1 -> 0..<2 -> -1..<1
-      float nx = (float)x / WIDTH * 2.0f - 1.0f;
-      // Color c = f(nx, ny);
-      Color c;
-      if (!eval_func(f, nx, ny, &c))
-        return false;
-      // -1 to 1 -> +1
-      // 0 to 2 -> /2
-      // 0 to 1 -> *255
-      // 0 to 255; done;
-      size_t index = y * WIDTH + x;
-      pixels[index].r = (c.r + 1.0f) / 2.0f * 255;
-      pixels[index].g = (c.g + 1.0f) / 2.0f * 255;
-      pixels[index].b = (c.b + 1.0f) / 2.0f * 255;
-      pixels[index].a = 255;
+  if (cost_model_path) {
+    span = trace_begin("predict cost");
+    Cost_Model model;
+    if (!cost_model_load(&model, cost_model_path))
+      return 1;
+    opts.backend = model.backend;
+    double predicted_ms =
+        cost_predict_secs(&model, f, fb.width, fb.height, opts.threads) * 1e3;
+    double fastest_ms, slowest_ms;
+    cost_predict_range(&model, predicted_ms, &fastest_ms, &slowest_ms);
+    trace_end(span);
+    nob_log(INFO, "Predicted render time: %.1f ms (%.1f to %.1f ms)",
+            predicted_ms, fastest_ms, slowest_ms);
+    if (budget_ms > 0.0 && slowest_ms > budget_ms) {
+      nob_log(ERROR, "Predicted render time may exceed the budget of %.1f ms",
+              budget_ms);
+      return 1;
     }
   }
-  return true;
-}
 
-#define node_print_ln(node) (node_print(node), printf("\n"))
+  if (shards > 0) {
+    Shard_Options sharded = {
+        .program = program,
+        .forward = forward,
+        .shards = shards,
+        .width = width,
+        .height = height,
+        .threads = threads,
+        .output_path = output_path,
+    };
+    if (!render_sharded(&sharded))
+      return 1;
+    nob_log(INFO, "Image saved to: %s", output_path);
+    if (cache.dir && !cache_store(&cache, cache_key_value, output_path))
+      nob_log(WARNING, "Could not add %s to the cache", output_path);
+    return success(trace_path, false);
+  }
 
-int main(void) {
-  printf("\033[1;32m\n------------code Execution starts "
-         "here------------\n\033[0m");
-  // bool ok = render_pixels(node_if(
-  //     node_gt(node_mult(node_x(), node_y()), node_number(0)),
-  //     node_triple(node_x(), node_y(), node_number(1)),
-  //     node_triple(node_mod(node_x(), node_y()), node_mod(node_x(), node_y()),
-  //                 node_mod(node_x(), node_y()))));
-  // bool ok = render_pixels(node_triple(node_y(), node_x(), node_x()));
-  bool ok = render_pixels(node_if(
-      node_gt(node_mult(node_x(), node_y()), node_number(0)),
-      node_triple(node_x(), node_y(), node_number(1)),
-      node_triple(node_mod(node_x(), node_y()), node_mod(node_x(), node_y()),
-                  node_mod(node_x(), node_y())))
+  fb.pixels = malloc((size_t)fb.width * fb.height * sizeof(RGBA32));
+  if (fb.pixels == NULL) {
+    nob_log(ERROR, "Could not allocate %dx%d pixels", fb.width, fb.height);
+    return 1;
+  }
+  if (raw_path) {
+    bool ok = in_place ? render_bintree(&bin, &fb, &opts)
+                       : render_pixels(f, &fb, &opts);
+    if (!ok || !write_entire_file(raw_path, fb.pixels,
+                           (size_t)fb.width * fb.height * sizeof(RGBA32)))
+      return 1;
+    return success(trace_path, true);
+  }
 
-  );
+  // Opened before the render workers exist so that they inherit the counters
+  Perf counters;
+  if (perf && !perf_open(&counters))
+    return 1;
+  size_t pixel_count = (size_t)fb.width * fb.height;
+
+  Perf_Sample before = perf ? perf_read(&counters) : (Perf_Sample){0};
+  bool ok;
+  if (progressive)
+    ok = render_progressive(f, &fb, &opts, save_preview, (void *)output_path);
+  else if (in_place)
+    ok = render_bintree(&bin, &fb, &opts);
+  else
+    ok = render_pixels(f, &fb, &opts);
   if (!ok)
     return 1;
-  const char *output_path = "output.png";
-  if (!stbi_write_png(output_path, WIDTH, HEIGHT, 4, pixels,
-                      WIDTH * sizeof(RGBA32))) {
+  if (perf) {
+    Perf_Sample after = perf_read(&counters);
+    perf_report("render", before, after, pixel_count);
+    before = after;
+  }
+  if (!image_write_png(&fb, output_path)) {
     printf("Could not save Image: %s", output_path);
     nob_log(ERROR, "Could not save Image: %s", output_path);
     return 1;
   };
+  if (perf) {
+    perf_report("encode", before, perf_read(&counters), pixel_count);
+    perf_close(&counters);
+  }
   nob_log(INFO, "Image saved to: %s", output_path);
-  printf("Success\n");
-  printf("\033[1;34m\n------------code Execution ends "
-         "here------------\n\033[0m");
-  return 0;
+  if (cache.dir && !cache_store(&cache, cache_key_value, output_path))
+    nob_log(WARNING, "Could not add %s to the cache", output_path);
+  return success(trace_path, false);
 }
@@ -0,0 +1,861 @@
+#define NOB_STRIP_PREFIX
+
+#include "node.h"
+#include "fastmath.h"
+#include "nob.h"
+#include "profile.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Arena node_arena = {0};
+_Thread_local Arena *scratch_arena = NULL;
+Slab *node_slab = NULL;
+
+Node *node_loc(const char *file, int line, Node_Kind kind) {
+  Node *node;
+  if (scratch_arena) {
+    node = arena_alloc(scratch_arena, sizeof(Node));
+    node->refs = 0;
+  } else if (node_slab) {
+    node = slab_alloc(node_slab, sizeof(Node));
+    node->refs = 1;
+  } else {
+    node = arena_alloc(&node_arena, sizeof(Node));
+    node->refs = 0;
+  }
+  node->kind = kind;
+  node->file = file;
+  node->line = line;
+  return node;
+}
+
+Node *node_number_loc(const char *file, int line, float number) {
+  Node *node = node_loc(file, line, NK_NUMBER);
+  node->as.number = number;
+  return node;
+}
+
+// Node *node_x_loc(const char *file, int line) {
+//   return node_loc(file, line, NK_X);
+// }
+
+// Node *node_y(void) {
+//   Node *node = arena_alloc(&node_arena, sizeof(Node));
+//   node->kind = NK_Y;
+//   return node;
+// }
+
+Node *node_add_loc(const char *file, int line, Node *lhs, Node *rhs) {
+  Node *node = node_loc(file, line, NK_ADD);
+  node->as.binop.lhs = lhs;
+  node->as.binop.rhs = rhs;
+  return node;
+}
+
+Node *node_mult_loc(const char *file, int line, Node *lhs, Node *rhs) {
+  Node *node = node_loc(file, line, NK_MULT);
+  node->as.binop.lhs = lhs;
+  node->as.binop.rhs = rhs;
+  return node;
+}
+
+Node *node_triple_loc(const char *file, int line, Node *first, Node *second,
+                      Node *third) {
+  Node *node = node_loc(file, line, NK_TRIPLE);
+  node->as.triple.first = first;
+  node->as.triple.second = second;
+  node->as.triple.third = third;
+  return node;
+}
+
+Node *node_if_loc(const char *file, int line, Node *cond, Node *then,
+                  Node *elze) {
+  Node *node = node_loc(file, line, NK_IF);
+  node->as.iff.cond = cond;
+  node->as.iff.then = then;
+  node->as.iff.elze = elze;
+  return node;
+}
+
+Node *node_gt_loc(const char *file, int line, Node *lhs, Node *rhs) {
+  Node *node = node_loc(file, line, NK_GT);
+  node->as.binop.lhs = lhs;
+  node->as.binop.rhs = rhs;
+  return node;
+}
+
+Node *node_mod_loc(const char *file, int line, Node *lhs, Node *rhs) {
+  Node *node = node_loc(file, line, NK_MOD);
+  node->as.binop.lhs = lhs;
+  node->as.binop.rhs = rhs;
+  return node;
+}
+
+Node *node_unop_loc(const char *file, int line, Node_Kind kind, Node *arg) {
+  Node *node = node_loc(file, line, kind);
+  node->as.unop.arg = arg;
+  return node;
+}
+
+Node *node_binop_loc(const char *file, int line, Node_Kind kind, Node *lhs,
+                     Node *rhs) {
+  Node *node = node_loc(file, line, kind);
+  node->as.binop.lhs = lhs;
+  node->as.binop.rhs = rhs;
+  return node;
+}
+
+// Reference counting for nodes allocated from node_slab. A constructor takes
+// over the references of its children, so a subtree that is used in more than
+// one place has to be node_retain()ed once per extra use. Both functions are
+// no-ops for arena nodes.
+Node *node_retain(Node *node) {
+  if (node->refs > 0)
+    node->refs += 1;
+  return node;
+}
+
+void node_release(Node *node) {
+  if (node->refs == 0 || --node->refs > 0)
+    return;
+  switch (node->kind) {
+  case NK_X:
+  case NK_Y:
+  case NK_T:
+  case NK_NUMBER:
+  case NK_BOOL:
+    break;
+  case NK_SIN:
+  case NK_COS:
+  case NK_EXP:
+  case NK_SQRT:
+  case NK_ABS:
+    node_release(node->as.unop.arg);
+    break;
+  case NK_ADD:
+  case NK_MULT:
+  case NK_GT:
+  case NK_MOD:
+  case NK_ATAN2:
+  case NK_MIN:
+  case NK_MAX:
+    node_release(node->as.binop.lhs);
+    node_release(node->as.binop.rhs);
+    break;
+  case NK_TRIPLE:
+    node_release(node->as.triple.first);
+    node_release(node->as.triple.second);
+    node_release(node->as.triple.third);
+    break;
+  case NK_IF:
+    node_release(node->as.iff.cond);
+    node_release(node->as.iff.then);
+    node_release(node->as.iff.elze);
+    break;
+  }
+  slab_free(node_slab, node, sizeof(Node));
+}
+
+static const char *node_kind_names[COUNT_NK] = {
+    [NK_X] = "x",
+    [NK_Y] = "y",
+    [NK_NUMBER] = "number",
+    [NK_ADD] = "add",
+    [NK_MULT] = "mult",
+    [NK_TRIPLE] = "triple",
+    [NK_BOOL] = "boolean",
+    [NK_GT] = "gt",
+    [NK_IF] = "if",
+    [NK_MOD] = "mod",
+    [NK_SIN] = "sin",
+    [NK_COS] = "cos",
+    [NK_EXP] = "exp",
+    [NK_SQRT] = "sqrt",
+    [NK_ABS] = "abs",
+    [NK_ATAN2] = "atan2",
+    [NK_MIN] = "min",
+    [NK_MAX] = "max",
+    [NK_T] = "t",
+};
+
+const char *node_kind_name(Node_Kind kind) {
+  NOB_ASSERT(kind < COUNT_NK);
+  return node_kind_names[kind];
+}
+
+size_t node_children(Node *node, Node *children[3]) {
+  switch (node->kind) {
+  case NK_X:
+  case NK_Y:
+  case NK_T:
+  case NK_NUMBER:
+  case NK_BOOL:
+    return 0;
+  case NK_SIN:
+  case NK_COS:
+  case NK_EXP:
+  case NK_SQRT:
+  case NK_ABS:
+    children[0] = node->as.unop.arg;
+    return 1;
+  case NK_ADD:
+  case NK_MULT:
+  case NK_GT:
+  case NK_MOD:
+  case NK_ATAN2:
+  case NK_MIN:
+  case NK_MAX:
+    children[0] = node->as.binop.lhs;
+    children[1] = node->as.binop.rhs;
+    return 2;
+  case NK_TRIPLE:
+    children[0] = node->as.triple.first;
+    children[1] = node->as.triple.second;
+    children[2] = node->as.triple.third;
+    return 3;
+  case NK_IF:
+    children[0] = node->as.iff.cond;
+    children[1] = node->as.iff.then;
+    children[2] = node->as.iff.elze;
+    return 3;
+  }
+  NOB_UNREACHABLE("node_children");
+}
+
+void node_set_children(Node *node, Node *const children[3]) {
+  switch (node->kind) {
+  case NK_X:
+  case NK_Y:
+  case NK_T:
+  case NK_NUMBER:
+  case NK_BOOL:
+    break;
+  case NK_SIN:
+  case NK_COS:
+  case NK_EXP:
+  case NK_SQRT:
+  case NK_ABS:
+    node->as.unop.arg = children[0];
+    break;
+  case NK_ADD:
+  case NK_MULT:
+  case NK_GT:
+  case NK_MOD:
+  case NK_ATAN2:
+  case NK_MIN:
+  case NK_MAX:
+    node->as.binop.lhs = children[0];
+    node->as.binop.rhs = children[1];
+    break;
+  case NK_TRIPLE:
+    node->as.triple.first = children[0];
+    node->as.triple.second = children[1];
+    node->as.triple.third = children[2];
+    break;
+  case NK_IF:
+    node->as.iff.cond = children[0];
+    node->as.iff.then = children[1];
+    node->as.iff.elze = children[2];
+    break;
+  }
+}
+
+void node_histogram(Node *node, size_t hist[COUNT_NK]) {
+  hist[node->kind] += 1;
+  switch (node->kind) {
+  case NK_X:
+  case NK_Y:
+  case NK_T:
+  case NK_NUMBER:
+  case NK_BOOL:
+    break;
+  case NK_SIN:
+  case NK_COS:
+  case NK_EXP:
+  case NK_SQRT:
+  case NK_ABS:
+    node_histogram(node->as.unop.arg, hist);
+    break;
+  case NK_ADD:
+  case NK_MULT:
+  case NK_GT:
+  case NK_MOD:
+  case NK_ATAN2:
+  case NK_MIN:
+  case NK_MAX:
+    node_histogram(node->as.binop.lhs, hist);
+    node_histogram(node->as.binop.rhs, hist);
+    break;
+  case NK_TRIPLE:
+    node_histogram(node->as.triple.first, hist);
+    node_histogram(node->as.triple.second, hist);
+    node_histogram(node->as.triple.third, hist);
+    break;
+  case NK_IF:
+    node_histogram(node->as.iff.cond, hist);
+    node_histogram(node->as.iff.then, hist);
+    node_histogram(node->as.iff.elze, hist);
+    break;
+  }
+}
+
+size_t node_count(Node *node) {
+  switch (node->kind) {
+  case NK_X:
+  case NK_Y:
+  case NK_T:
+  case NK_NUMBER:
+  case NK_BOOL:
+    return 1;
+  case NK_SIN:
+  case NK_COS:
+  case NK_EXP:
+  case NK_SQRT:
+  case NK_ABS:
+    return 1 + node_count(node->as.unop.arg);
+  case NK_ADD:
+  case NK_MULT:
+  case NK_GT:
+  case NK_MOD:
+  case NK_ATAN2:
+  case NK_MIN:
+  case NK_MAX:
+    return 1 + node_count(node->as.binop.lhs) + node_count(node->as.binop.rhs);
+  case NK_TRIPLE:
+    return 1 + node_count(node->as.triple.first) +
+           node_count(node->as.triple.second) +
+           node_count(node->as.triple.third);
+  case NK_IF:
+    return 1 + node_count(node->as.iff.cond) + node_count(node->as.iff.then) +
+           node_count(node->as.iff.elze);
+  }
+  NOB_UNREACHABLE("node_count");
+}
+
+static uint64_t node_hash_mix(uint64_t h, uint64_t v) {
+  h = (h ^ v) * 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 31;
+  h *= 0x94d049bb133111ebull;
+  return h ^ (h >> 29);
+}
+
+uint64_t node_hash_with(Node *node, const uint64_t children[3]) {
+  uint64_t h = node_hash_mix(0x9e3779b97f4a7c15ull, node->kind);
+  switch (node->kind) {
+  case NK_NUMBER: {
+    uint32_t bits;
+    memcpy(&bits, &node->as.number, sizeof(bits));
+    return node_hash_mix(h, bits);
+  }
+  case NK_BOOL:
+    return node_hash_mix(h, node->as.boolean);
+  default: {
+    Node *operands[3];
+    size_t n = node_children(node, operands);
+    for (size_t i = 0; i < n; ++i)
+      h = node_hash_mix(h, children[i]);
+    return h;
+  }
+  }
+}
+
+uint64_t node_hash(Node *node) {
+  Node *operands[3];
+  uint64_t children[3];
+  size_t n = node_children(node, operands);
+  for (size_t i = 0; i < n; ++i)
+    children[i] = node_hash(operands[i]);
+  return node_hash_with(node, children);
+}
+
+// Shortest "%g" form that reads back as the same float
+static void node_print_number(FILE *stream, float number) {
+  char buf[32];
+  for (int precision = 6; precision <= 9; ++precision) {
+    snprintf(buf, sizeof(buf), "%.*g", precision, number);
+    if (strtof(buf, NULL) == number || number != number)
+      break;
+  }
+  fputs(buf, stream);
+}
+
+static void node_print_open(FILE *stream, Node *node) {
+  switch (node->kind) {
+  case NK_X:
+  case NK_Y:
+  case NK_T:
+    fputs(node_kind_name(node->kind), stream);
+    break;
+  case NK_NUMBER:
+    node_print_number(stream, node->as.number);
+    break;
+  case NK_BOOL:
+    fputs(node->as.boolean ? "true" : "false", stream);
+    break;
+  case NK_IF:
+    fputs("if ", stream);
+    break;
+  case NK_ADD:
+  case NK_MULT:
+  case NK_TRIPLE:
+  case NK_GT:
+  case NK_MOD:
+  case NK_SIN:
+  case NK_COS:
+  case NK_EXP:
+  case NK_SQRT:
+  case NK_ABS:
+  case NK_ATAN2:
+  case NK_MIN:
+  case NK_MAX:
+    fprintf(stream, "%s(", node_kind_name(node->kind));
+    break;
+  }
+}
+
+// Iterative, so printing a very deep tree does not overflow the C stack
+void node_fprint(FILE *stream, Node *node) {
+  Arena arena = {0};
+  struct {
+    Eval_Frame *items;
+    size_t count;
+    size_t capacity;
+  } frames = {0};
+  arena_da_append(&arena, &frames, ((Eval_Frame){.expr = node}));
+
+  while (frames.count > 0) {
+    Eval_Frame *top = &frames.items[frames.count - 1];
+    Node *operands[3];
+    size_t n = node_children(top->expr, operands);
+    if (top->next == 0)
+      node_print_open(stream, top->expr);
+    if (top->next < n) {
+      if (top->next > 0) {
+        if (top->expr->kind == NK_IF)
+          fputs(top->next == 1 ? " then " : " else ", stream);
+        else
+          fputs(", ", stream);
+      }
+      Node *operand = operands[top->next++];
+      arena_da_append(&arena, &frames, ((Eval_Frame){.expr = operand}));
+      continue;
+    }
+    if (n > 0 && top->expr->kind != NK_IF)
+      fputc(')', stream);
+    frames.count -= 1;
+  }
+  arena_free(&arena);
+}
+
+void node_print(Node *node) { node_fprint(stdout, node); }
+
+bool expect_number(Node *expr) {
+  if (expr->kind != NK_NUMBER) {
+    printf("%s:%d: ERROR: expected number\n", expr->file, expr->line);
+    return false;
+  };
+  return true;
+}
+
+bool expect_triple(Node *expr) {
+  if (expr->kind != NK_TRIPLE) {
+    printf("%s:%d: ERROR: expected triple\n", expr->file, expr->line);
+    return false;
+  }
+  return true;
+}
+
+bool expect_boolean(Node *expr) {
+  if (expr->kind != NK_BOOL) {
+    printf("%s:%d: ERROR: expected boolean\n", expr->file, expr->line);
+    return false;
+  }
+  return true;
+}
+
+Node *node_boolean_loc(const char *file, int line, bool boolean) {
+  Node *node = node_loc(file, line, NK_BOOL);
+  node->as.boolean = boolean;
+  return node;
+}
+
+// The number -> number kinds, shared by eval() and eval_iter()
+static float eval_unop(Node_Kind kind, float a) {
+  switch (kind) {
+  case NK_SIN:
+    return math_sinf(a);
+  case NK_COS:
+    return math_cosf(a);
+  case NK_EXP:
+    return math_expf(a);
+  case NK_SQRT:
+    return math_sqrtf(a);
+  case NK_ABS:
+    return fabsf(a);
+  default:
+    NOB_UNREACHABLE("eval_unop");
+  }
+}
+
+static float eval_binop(Node_Kind kind, float a, float b) {
+  switch (kind) {
+  case NK_ATAN2:
+    return math_atan2f(a, b);
+  case NK_MIN:
+    return math_minf(a, b);
+  case NK_MAX:
+    return math_maxf(a, b);
+  default:
+    NOB_UNREACHABLE("eval_binop");
+  }
+}
+
+static Node *eval_node(Node *expr, float x, float y, float t);
+
+Node *eval(Node *expr, float x, float y, float t) {
+#ifdef RANDOMART_PROFILE
+  if (profile_table) {
+    Profile_Entry *e = profile_entry(profile_table, expr);
+    e->count += 1;
+    if (!profile_table->sampling)
+      return eval_node(expr, x, y, t);
+    uint64_t start = profile_cycles();
+    Node *result = eval_node(expr, x, y, t);
+    // The entry may have moved if the table grew while evaluating children
+    e = profile_entry(profile_table, expr);
+    e->cycles += profile_cycles() - start;
+    e->samples += 1;
+    return result;
+  }
+#endif // RANDOMART_PROFILE
+  return eval_node(expr, x, y, t);
+}
+
+static Node *eval_node(Node *expr, float x, float y, float t) {
+  switch (expr->kind) {
+  case NK_X: {
+    return node_number_loc(expr->file, expr->line, x);
+    break;
+  }
+  case NK_Y: {
+    return node_number_loc(expr->file, expr->line, y);
+    break;
+  }
+  case NK_T: {
+    return node_number_loc(expr->file, expr->line, t);
+  }
+  case NK_NUMBER: {
+    return expr;
+    break;
+  }
+  case NK_BOOL: {
+    return expr;
+    break;
+  }
+  case NK_GT: {
+    Node *lhs = eval(expr->as.binop.lhs, x, y, t);
+    if (!lhs)
+      return NULL;
+    if (!expect_number(lhs)) {
+      return NULL;
+    }
+    Node *rhs = eval(expr->as.binop.rhs, x, y, t);
+    if (!rhs)
+      return NULL;
+    if (!expect_number(rhs))
+      return NULL;
+    return node_boolean_loc(expr->file, expr->line,
+                            lhs->as.number > rhs->as.number);
+    break;
+  }
+
+  case NK_ADD: {
+    Node *lhs = eval(expr->as.binop.lhs, x, y, t);
+    if (!lhs)
+      return NULL;
+    if (!expect_number(lhs))
+      return NULL;
+    Node *rhs = eval(expr->as.binop.rhs, x, y, t);
+    if (!rhs)
+      return NULL;
+    if (!expect_number(rhs))
+      return NULL;
+    return node_number_loc(expr->file, expr->line,
+                           lhs->as.number + rhs->as.number);
+    break;
+  }
+  case NK_MULT: {
+    Node *lhs = eval(expr->as.binop.lhs, x, y, t);
+    if (!lhs)
+      return NULL;
+    if (!expect_number(lhs))
+      return NULL;
+    Node *rhs = eval(expr->as.binop.rhs, x, y, t);
+    if (!rhs)
+      return NULL;
+    if (!expect_number(rhs))
+      return NULL;
+    return node_number_loc(expr->file, expr->line,
+                           lhs->as.number * rhs->as.number);
+    break;
+  }
+  case NK_TRIPLE: {
+    Node *first = eval(expr->as.triple.first, x, y, t);
+    Node *second = eval(expr->as.triple.second, x, y, t);
+    Node *third = eval(expr->as.triple.third, x, y, t);
+    return node_triple_loc(expr->file, expr->line, first, second, third);
+    break;
+  }
+  case NK_MOD: {
+    Node *lhs = eval(expr->as.binop.lhs, x, y, t);
+    if (!lhs)
+      return NULL;
+    if (!expect_number(lhs))
+      return NULL;
+    Node *rhs = eval(expr->as.binop.rhs, x, y, t);
+    if (!rhs)
+      return NULL;
+    if (!expect_number(rhs))
+      return NULL;
+    return node_number_loc(expr->file, expr->line,
+                           math_fmodf(lhs->as.number, rhs->as.number));
+
+    break;
+  }
+  case NK_SIN:
+  case NK_COS:
+  case NK_EXP:
+  case NK_SQRT:
+  case NK_ABS: {
+    Node *arg = eval(expr->as.unop.arg, x, y, t);
+    if (!arg)
+      return NULL;
+    if (!expect_number(arg))
+      return NULL;
+    return node_number_loc(expr->file, expr->line,
+                           eval_unop(expr->kind, arg->as.number));
+  }
+  case NK_ATAN2:
+  case NK_MIN:
+  case NK_MAX: {
+    Node *lhs = eval(expr->as.binop.lhs, x, y, t);
+    if (!lhs)
+      return NULL;
+    if (!expect_number(lhs))
+      return NULL;
+    Node *rhs = eval(expr->as.binop.rhs, x, y, t);
+    if (!rhs)
+      return NULL;
+    if (!expect_number(rhs))
+      return NULL;
+    return node_number_loc(
+        expr->file, expr->line,
+        eval_binop(expr->kind, lhs->as.number, rhs->as.number));
+  }
+  case NK_IF: {
+    Node *cond = eval(expr->as.iff.cond, x, y, t);
+    if (!cond)
+      return NULL;
+    if (!expect_boolean(cond))
+      return NULL;
+    Node *then = eval(expr->as.iff.then, x, y, t);
+    if (!then)
+      return NULL;
+    Node *elze = eval(expr->as.iff.elze, x, y, t);
+    if (!elze)
+      return NULL;
+    return cond->as.boolean ? then : elze;
+    break;
+  }
+  default: {
+    NOB_UNREACHABLE("eval");
+  }
+  }
+}
+
+static bool eval_color(Node *result, Color *c) {
+  if (result == NULL) {
+    return false;
+  }
+  if (!expect_triple(result)) {
+    return false;
+  }
+  // A triple keeps the operands that failed to evaluate as NULL
+  if (!result->as.triple.first || !result->as.triple.second ||
+      !result->as.triple.third) {
+    return false;
+  }
+  if (!expect_number(result->as.triple.first)) {
+    return false;
+  }
+  if (!expect_number(result->as.triple.second)) {
+    return false;
+  }
+  if (!expect_number(result->as.triple.third)) {
+    return false;
+  }
+  c->r = result->as.triple.first->as.number;
+  c->g = result->as.triple.second->as.number;
+  c->b = result->as.triple.third->as.number;
+  return true;
+}
+
+bool *eval_func(Node *body, float x, float y, float t, Color *c) {
+  return (void *)eval_color(eval(body, x, y, t), c);
+}
+
+// The check eval() does on an operand right after evaluating it
+static bool eval_expect(Node *expr, size_t operand, Node *value) {
+  switch (expr->kind) {
+  case NK_SIN:
+  case NK_COS:
+  case NK_EXP:
+  case NK_SQRT:
+  case NK_ABS:
+  case NK_ADD:
+  case NK_MULT:
+  case NK_GT:
+  case NK_MOD:
+  case NK_ATAN2:
+  case NK_MIN:
+  case NK_MAX:
+    return expect_number(value);
+  case NK_IF:
+    return operand > 0 || expect_boolean(value);
+  default:
+    return true;
+  }
+}
+
+// Combines the already evaluated operands of expr like eval_node() does
+static Node *eval_apply(Node *expr, Node **operands, float x, float y,
+                        float t) {
+  switch (expr->kind) {
+  case NK_X:
+    return node_number_loc(expr->file, expr->line, x);
+  case NK_Y:
+    return node_number_loc(expr->file, expr->line, y);
+  case NK_T:
+    return node_number_loc(expr->file, expr->line, t);
+  case NK_NUMBER:
+  case NK_BOOL:
+    return expr;
+  case NK_GT:
+    return node_boolean_loc(expr->file, expr->line,
+                            operands[0]->as.number > operands[1]->as.number);
+  case NK_ADD:
+    return node_number_loc(expr->file, expr->line,
+                           operands[0]->as.number + operands[1]->as.number);
+  case NK_MULT:
+    return node_number_loc(expr->file, expr->line,
+                           operands[0]->as.number * operands[1]->as.number);
+  case NK_TRIPLE:
+    return node_triple_loc(expr->file, expr->line, operands[0], operands[1],
+                           operands[2]);
+  case NK_MOD:
+    return node_number_loc(expr->file, expr->line,
+                           math_fmodf(operands[0]->as.number,
+                                      operands[1]->as.number));
+  case NK_IF:
+    return operands[0]->as.boolean ? operands[1] : operands[2];
+  case NK_SIN:
+  case NK_COS:
+  case NK_EXP:
+  case NK_SQRT:
+  case NK_ABS:
+    return node_number_loc(expr->file, expr->line,
+                           eval_unop(expr->kind, operands[0]->as.number));
+  case NK_ATAN2:
+  case NK_MIN:
+  case NK_MAX:
+    return node_number_loc(expr->file, expr->line,
+                           eval_binop(expr->kind, operands[0]->as.number,
+                                      operands[1]->as.number));
+  }
+  NOB_UNREACHABLE("eval_apply");
+}
+
+// Lays the tree out in postorder, so that evaluating it is a single loop over
+// stack->program with the operands of every node on top of stack->values.
+static void eval_iter_compile(Eval_Stack *stack, Node *expr) {
+  stack->root = expr;
+  stack->program.count = 0;
+  stack->frames.count = 0;
+  arena_da_append(&stack->arena, &stack->frames,
+                  ((Eval_Frame){.expr = expr}));
+  while (stack->frames.count > 0) {
+    Eval_Frame *top = &stack->frames.items[stack->frames.count - 1];
+    Node *operands[3];
+    size_t n = node_children(top->expr, operands);
+    if (top->next < n) {
+      Eval_Frame frame = {.expr = operands[top->next++]};
+      arena_da_append(&stack->arena, &stack->frames, frame);
+      continue;
+    }
+    Eval_Step step = {.expr = top->expr, .arity = n};
+    arena_da_append(&stack->arena, &stack->program, step);
+    stack->frames.count -= 1;
+  }
+}
+
+Node *eval_iter(Eval_Stack *stack, Node *expr, float x, float y,
+                float t) {
+  if (stack->root != expr)
+    eval_iter_compile(stack, expr);
+
+  stack->values.count = 0;
+#ifdef RANDOMART_PROFILE
+  // Counted and timed like eval(): the subtree of a step starts with the
+  // subtree of its first operand
+  Profile_Table *profile = profile_table;
+  bool timed = profile && profile->sampling;
+  stack->starts.count = 0;
+#endif
+  for (size_t i = 0; i < stack->program.count; ++i) {
+    Eval_Step *step = &stack->program.items[i];
+    size_t base = stack->values.count - step->arity;
+#ifdef RANDOMART_PROFILE
+    uint64_t start = 0;
+    if (timed)
+      start = step->arity > 0 ? stack->starts.items[base] : profile_cycles();
+#endif
+    Node **operands = stack->values.items + base;
+    for (size_t j = 0; j < step->arity; ++j) {
+      if (!eval_expect(step->expr, j, operands[j]))
+        return NULL;
+    }
+    Node *result = eval_apply(step->expr, operands, x, y, t);
+    stack->values.count = base;
+    arena_da_append(&stack->arena, &stack->values, result);
+#ifdef RANDOMART_PROFILE
+    if (profile) {
+      Profile_Entry *e = profile_entry(profile, step->expr);
+      e->count += 1;
+      if (timed) {
+        e->cycles += profile_cycles() - start;
+        e->samples += 1;
+        stack->starts.count = base;
+        arena_da_append(&stack->arena, &stack->starts, start);
+      }
+    }
+#endif
+  }
+  return stack->values.items[0];
+}
+
+bool eval_func_iter(Eval_Stack *stack, Node *body, float x, float y, float t,
+                    Color *c) {
+  return eval_color(eval_iter(stack, body, x, y, t), c);
+}
+
+void eval_stack_forget(Eval_Stack *stack) {
+  stack->root = NULL;
+  stack->program.count = 0;
+}
+
+void eval_stack_free(Eval_Stack *stack) {
+  arena_free(&stack->arena);
+  *stack = (Eval_Stack){0};
+}
@@ -0,0 +1,218 @@
+#ifndef NODE_H_
+#define NODE_H_
+
+#include "arena.h"
+#include "slab.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum {
+  NK_X,
+  NK_Y,
+  NK_NUMBER,
+  NK_ADD,
+  NK_MULT,
+  NK_TRIPLE,
+  NK_BOOL,
+  NK_GT,
+  NK_IF,
+  NK_MOD,
+  NK_SIN,
+  NK_COS,
+  NK_EXP,
+  NK_SQRT,
+  NK_ABS,
+  NK_ATAN2,
+  NK_MIN,
+  NK_MAX,
+  NK_T, // time, for animations
+} Node_Kind;
+
+#define COUNT_NK (NK_T + 1) // keep in sync with the last Node_Kind
+
+typedef struct Node Node;
+
+typedef struct {
+  Node *arg;
+} Node_Unop;
+
+typedef struct {
+  Node *lhs;
+  Node *rhs;
+} Node_Binop;
+
+typedef struct {
+  Node *first;
+  Node *second;
+  Node *third;
+} Node_Triple;
+
+typedef struct {
+  Node *cond;
+  Node *then;
+  Node *elze;
+} node_if;
+
+typedef union {
+  float number;
+  Node_Unop unop;
+  Node_Binop binop; // binary operaton;
+  Node_Triple triple;
+  bool boolean;
+  node_if iff;
+} Node_As;
+
+struct Node {
+  Node_Kind kind;
+  uint32_t refs; // 0 for nodes that are not reference counted (arena nodes)
+  const char *file;
+  int line;
+  Node_As as;
+};
+
+typedef struct {
+  float r, g, b;
+} Color;
+
+extern Arena node_arena;
+
+// Render workers allocate the intermediate results of eval() from their own
+// arena instead of node_arena.
+extern _Thread_local Arena *scratch_arena;
+
+// When set, node_loc() takes nodes from this slab instead of node_arena and
+// they can be given back one subtree at a time with node_release().
+extern Slab *node_slab;
+
+Node *node_loc(const char *file, int line, Node_Kind kind);
+Node *node_number_loc(const char *file, int line, float number);
+Node *node_boolean_loc(const char *file, int line, bool boolean);
+Node *node_add_loc(const char *file, int line, Node *lhs, Node *rhs);
+Node *node_mult_loc(const char *file, int line, Node *lhs, Node *rhs);
+Node *node_triple_loc(const char *file, int line, Node *first, Node *second,
+                      Node *third);
+Node *node_if_loc(const char *file, int line, Node *cond, Node *then,
+                  Node *elze);
+Node *node_gt_loc(const char *file, int line, Node *lhs, Node *rhs);
+Node *node_mod_loc(const char *file, int line, Node *lhs, Node *rhs);
+// sin, cos, exp, sqrt and abs of a number
+Node *node_unop_loc(const char *file, int line, Node_Kind kind, Node *arg);
+// atan2(lhs, rhs), min and max of two numbers
+Node *node_binop_loc(const char *file, int line, Node_Kind kind, Node *lhs,
+                     Node *rhs);
+
+#define node_number(number) node_number_loc(__FILE__, __LINE__, number)
+#define node_x() node_loc(__FILE__, __LINE__, NK_X)
+#define node_y() node_loc(__FILE__, __LINE__, NK_Y)
+#define node_t() node_loc(__FILE__, __LINE__, NK_T)
+#define node_add(lhs, rhs) node_add_loc(__FILE__, __LINE__, lhs, rhs)
+#define node_mult(lhs, rhs) node_mult_loc(__FILE__, __LINE__, lhs, rhs)
+#define node_triple(first, second, third)                                      \
+  node_triple_loc(__FILE__, __LINE__, first, second, third)
+#define node_if(cond, then, elze)                                              \
+  node_if_loc(__FILE__, __LINE__, cond, then, elze)
+#define node_gt(lhs, rhs) node_gt_loc(__FILE__, __LINE__, lhs, rhs)
+#define node_mod(lhs, rhs) node_mod_loc(__FILE__, __LINE__, lhs, rhs)
+#define node_boolean(boolean) node_boolean_loc(__FILE__, __LINE__, boolean)
+#define node_sin(arg) node_unop_loc(__FILE__, __LINE__, NK_SIN, arg)
+#define node_cos(arg) node_unop_loc(__FILE__, __LINE__, NK_COS, arg)
+#define node_exp(arg) node_unop_loc(__FILE__, __LINE__, NK_EXP, arg)
+#define node_sqrt(arg) node_unop_loc(__FILE__, __LINE__, NK_SQRT, arg)
+#define node_abs(arg) node_unop_loc(__FILE__, __LINE__, NK_ABS, arg)
+#define node_atan2(lhs, rhs)                                                   \
+  node_binop_loc(__FILE__, __LINE__, NK_ATAN2, lhs, rhs)
+#define node_min(lhs, rhs) node_binop_loc(__FILE__, __LINE__, NK_MIN, lhs, rhs)
+#define node_max(lhs, rhs) node_binop_loc(__FILE__, __LINE__, NK_MAX, lhs, rhs)
+
+Node *node_retain(Node *node);
+void node_release(Node *node);
+
+const char *node_kind_name(Node_Kind kind);
+
+// Stores the operands of node in children and returns how many there are.
+size_t node_children(Node *node, Node *children[3]);
+// The reverse of node_children(): replaces the operands of node.
+void node_set_children(Node *node, Node *const children[3]);
+
+// Number of nodes in the tree, counting shared subtrees once per use.
+size_t node_count(Node *node);
+// Hash of the structure of the tree: kinds, numbers and booleans, but not
+// the file and line nodes were built at or where they are in memory.
+uint64_t node_hash(Node *node);
+// node_hash() of node given the hashes of its operands
+uint64_t node_hash_with(Node *node, const uint64_t children[3]);
+// Adds the number of nodes of each kind in the tree to hist.
+void node_histogram(Node *node, size_t hist[COUNT_NK]);
+
+// Prints the tree in the syntax parse_expr() reads: name(operands) for every
+// operator except "if c then a else b", numbers with enough digits to read
+// back the same float.
+void node_fprint(FILE *stream, Node *node);
+void node_print(Node *node);
+#define node_print_ln(node) (node_print(node), printf("\n"))
+
+bool expect_number(Node *expr);
+bool expect_triple(Node *expr);
+bool expect_boolean(Node *expr);
+
+Node *eval(Node *expr, float x, float y, float t);
+bool *eval_func(Node *body, float x, float y, float t, Color *c);
+
+// Iterative counterpart of eval(): the tree is walked with an explicit stack
+// instead of the C stack, so its depth is only limited by memory. The walk
+// is done once per tree and cached in the Eval_Stack as a postorder program;
+// every call then evaluates that program with a stack of intermediate values.
+// It fails on the same trees as eval(), though when a tree has several type
+// errors the first one reported may differ.
+//
+// The program is found again by the address of the tree alone. A tree built
+// where a freed one was, after an arena rewind or node_release(), would run
+// the stale program: call eval_stack_forget() whenever the trees given to a
+// stack may have been freed since its last call.
+typedef struct {
+  Node *expr;
+  size_t next; // index of the next operand to visit
+} Eval_Frame;
+
+typedef struct {
+  Node *expr;
+  size_t arity; // number of operands it pops from the value stack
+} Eval_Step;
+
+typedef struct {
+  Arena arena; // backs the arrays below, which keep their capacity
+  Node *root;  // tree program was built for, NULL for none
+  struct {
+    Eval_Step *items;
+    size_t count;
+    size_t capacity;
+  } program;
+  struct {
+    Eval_Frame *items;
+    size_t count;
+    size_t capacity;
+  } frames;
+  struct {
+    Node **items;
+    size_t count;
+    size_t capacity;
+  } values;
+#ifdef RANDOMART_PROFILE
+  // Cycle counter when the subtree of each value started, on timed pixels
+  struct {
+    uint64_t *items;
+    size_t count;
+    size_t capacity;
+  } starts;
+#endif
+} Eval_Stack;
+
+Node *eval_iter(Eval_Stack *stack, Node *expr, float x, float y, float t);
+bool eval_func_iter(Eval_Stack *stack, Node *body, float x, float y, float t,
+                    Color *c);
+// Drops the cached program, keeping the memory
+void eval_stack_forget(Eval_Stack *stack);
+void eval_stack_free(Eval_Stack *stack);
+
+#endif // NODE_H_
@@ -0,0 +1,409 @@
+#define NOB_STRIP_PREFIX
+
+#include "parse.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  const char *path;
+  const char *p;
+  const char *end;
+  int line;
+  const char *line_start;
+  char quoted[4]; // of parser_describe(), which can run on any thread
+} Parser;
+
+// An operator whose operands are being parsed
+typedef struct {
+  Node_Kind kind;
+  bool paren;   // bare parentheses: add or triple, decided by the arity
+  size_t arity; // operands expected, the maximum for paren
+  size_t count;
+  Node *operands[3];
+  int line;
+  int col;
+} Parse_Frame;
+
+static int parser_col(const Parser *p, const char *at) {
+  return (int)(at - p->line_start) + 1;
+}
+
+#define parser_error(p, at, fmt, ...)                                          \
+  nob_log(ERROR, "%s:%d:%d: " fmt, (p)->path, (p)->line,                       \
+          parser_col(p, at), __VA_ARGS__)
+
+static void parser_skip_space(Parser *p) {
+  while (p->p < p->end) {
+    char c = *p->p;
+    if (c == '\n') {
+      p->line += 1;
+      p->line_start = ++p->p;
+    } else if (c == ' ' || c == '\t' || c == '\r') {
+      p->p++;
+    } else if (c == '#') {
+      while (p->p < p->end && *p->p != '\n')
+        p->p++;
+    } else {
+      break;
+    }
+  }
+}
+
+// ASCII only, and unlike <ctype.h> no locale lookups per character
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static bool ident_start(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool ident_char(char c) { return ident_start(c) || is_digit(c); }
+
+static String_View parser_ident(Parser *p) {
+  const char *begin = p->p;
+  while (p->p < p->end && ident_char(*p->p))
+    p->p++;
+  return sv_from_parts(begin, p->p - begin);
+}
+
+static bool parser_expect(Parser *p, char c) {
+  parser_skip_space(p);
+  if (p->p < p->end && *p->p == c) {
+    p->p++;
+    return true;
+  }
+  return false;
+}
+
+static const char *parser_describe(Parser *p) {
+  if (p->p >= p->end)
+    return "end of input";
+  snprintf(p->quoted, sizeof(p->quoted), "'%c'", *p->p);
+  return p->quoted;
+}
+
+// Short decimals like the ones node_fprint() writes, without strtof(): the
+// digits and the power of ten are exact in double, so their quotient is
+// correctly rounded, and rounding that to float is too unless the double
+// landed exactly halfway between two floats. Everything else goes to
+// strtof().
+static bool parser_number_fast(const char *p, const char *end, float *number) {
+  static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4,  1e5,
+                                  1e6, 1e7, 1e8, 1e9, 1e10, 1e11};
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+  uint64_t digits = 0;
+  int count = 0;
+  int decimals = -1;
+  for (; p < end; ++p) {
+    if (*p == '.' && decimals < 0) {
+      decimals = 0;
+      continue;
+    }
+    if (!is_digit(*p) || count == 15)
+      return false;
+    digits = digits * 10 + (uint64_t)(*p - '0');
+    count += 1;
+    if (decimals >= 0)
+      decimals += 1;
+  }
+  if (count == 0 || decimals >= (int)ARRAY_LEN(powers))
+    return false;
+  double d = decimals > 0 ? (double)digits / powers[decimals] : (double)digits;
+  float f = (float)d;
+  if ((double)f != d) {
+    float other = nextafterf(f, (double)f < d ? INFINITY : -INFINITY);
+    if (d == ((double)f + (double)other) / 2.0)
+      return false;
+  }
+  *number = negative ? -f : f;
+  return true;
+}
+
+static bool parser_number(Parser *p, float *number) {
+  const char *begin = p->p;
+  const char *q = p->p;
+  if (q < p->end && (*q == '-' || *q == '+'))
+    q++;
+  if (q < p->end && ident_start(*q)) {
+    // inf and nan, as printf() writes them
+    const char *name = q;
+    while (q < p->end && ident_char(*q))
+      q++;
+    String_View sv = sv_from_parts(name, q - name);
+    float value;
+    if (sv_eq(sv, sv_from_cstr("inf")))
+      value = INFINITY;
+    else if (sv_eq(sv, sv_from_cstr("nan")))
+      value = NAN;
+    else
+      return false;
+    *number = *begin == '-' ? -value : value;
+    p->p = q;
+    return true;
+  }
+  while (q < p->end && (is_digit(*q) || *q == '.'))
+    q++;
+  if (q < p->end && (*q == 'e' || *q == 'E')) {
+    q++;
+    if (q < p->end && (*q == '-' || *q == '+'))
+      q++;
+    while (q < p->end && is_digit(*q))
+      q++;
+  }
+  size_t n = q - begin;
+  if (n == 0)
+    return false;
+  if (parser_number_fast(begin, q, number)) {
+    p->p = q;
+    return true;
+  }
+  // strtof() needs a terminated string, the text is not
+  char buf[64];
+  if (n >= sizeof(buf))
+    return false;
+  memcpy(buf, begin, n);
+  buf[n] = '\0';
+  char *stop;
+  *number = strtof(buf, &stop);
+  if (stop != buf + n)
+    return false;
+  p->p = q;
+  return true;
+}
+
+static size_t kind_arity(Node_Kind kind) {
+  switch (kind) {
+  case NK_X:
+  case NK_Y:
+  case NK_T:
+  case NK_NUMBER:
+  case NK_BOOL:
+    return 0;
+  case NK_SIN:
+  case NK_COS:
+  case NK_EXP:
+  case NK_SQRT:
+  case NK_ABS:
+    return 1;
+  case NK_ADD:
+  case NK_MULT:
+  case NK_GT:
+  case NK_MOD:
+  case NK_ATAN2:
+  case NK_MIN:
+  case NK_MAX:
+    return 2;
+  case NK_TRIPLE:
+  case NK_IF:
+    return 3;
+  }
+  NOB_UNREACHABLE("kind_arity");
+}
+
+// The names of node_kind_name(), plus the spellings of booleans and of the
+// numbers printf() writes as words
+#define PARSE_WORD(word, kind) {word, sizeof(word) - 1, kind}
+static const struct {
+  const char *name;
+  size_t count;
+  Node_Kind kind;
+} parse_words[] = {
+    PARSE_WORD("x", NK_X),         PARSE_WORD("y", NK_Y),
+    PARSE_WORD("t", NK_T),         PARSE_WORD("add", NK_ADD),
+    PARSE_WORD("mult", NK_MULT),   PARSE_WORD("triple", NK_TRIPLE),
+    PARSE_WORD("gt", NK_GT),       PARSE_WORD("if", NK_IF),
+    PARSE_WORD("mod", NK_MOD),     PARSE_WORD("sin", NK_SIN),
+    PARSE_WORD("cos", NK_COS),     PARSE_WORD("exp", NK_EXP),
+    PARSE_WORD("sqrt", NK_SQRT),   PARSE_WORD("abs", NK_ABS),
+    PARSE_WORD("atan2", NK_ATAN2), PARSE_WORD("min", NK_MIN),
+    PARSE_WORD("max", NK_MAX),     PARSE_WORD("true", NK_BOOL),
+    PARSE_WORD("false", NK_BOOL),  PARSE_WORD("inf", NK_NUMBER),
+    PARSE_WORD("nan", NK_NUMBER),
+};
+
+static bool parser_word(String_View name, Node_Kind *kind) {
+  for (size_t i = 0; i < ARRAY_LEN(parse_words); ++i) {
+    if (parse_words[i].count == name.count &&
+        memcmp(parse_words[i].name, name.data, name.count) == 0) {
+      *kind = parse_words[i].kind;
+      return true;
+    }
+  }
+  return false;
+}
+
+typedef struct {
+  Parse_Frame *items;
+  size_t count;
+  size_t capacity;
+} Parse_Stack;
+
+// Parses the start of an expression: either a complete leaf in *leaf, or the
+// opening of an operator pushed on the stack.
+static bool parser_open(Parser *p, Arena *arena, Parse_Stack *stack,
+                        Node **leaf) {
+  parser_skip_space(p);
+  const char *at = p->p;
+  int line = p->line;
+  *leaf = NULL;
+  if (p->p >= p->end) {
+    parser_error(p, at, "expected an expression, got %s", "end of input");
+    return false;
+  }
+
+  if (*p->p == '(') {
+    p->p++;
+    Parse_Frame frame = {.paren = true, .arity = 3, .line = line,
+                         .col = parser_col(p, at)};
+    arena_da_append(arena, stack, frame);
+    return true;
+  }
+
+  if (ident_start(*p->p)) {
+    String_View name = parser_ident(p);
+    Node_Kind kind;
+    if (!parser_word(name, &kind)) {
+      parser_error(p, at, "unknown name '%.*s'", SV_Arg(name));
+      return false;
+    }
+    if (kind == NK_BOOL) {
+      *leaf = node_boolean_loc(p->path, line, name.count == 4);
+      return true;
+    }
+    if (kind == NK_NUMBER) {
+      p->p = at; // inf or nan, read below
+    } else {
+      size_t arity = kind_arity(kind);
+      if (arity == 0) {
+        *leaf = node_loc(p->path, line, kind);
+        return true;
+      }
+      if (kind != NK_IF && !parser_expect(p, '(')) {
+        parser_error(p, p->p, "expected '(' after %.*s, got %s",
+                     SV_Arg(name), parser_describe(p));
+        return false;
+      }
+      Parse_Frame frame = {.kind = kind, .arity = arity, .line = line,
+                           .col = parser_col(p, at)};
+      arena_da_append(arena, stack, frame);
+      return true;
+    }
+  }
+
+  float number;
+  if (!parser_number(p, &number)) {
+    parser_error(p, at, "expected an expression, got %s", parser_describe(p));
+    return false;
+  }
+  *leaf = node_number_loc(p->path, line, number);
+  return true;
+}
+
+static const char *if_keywords[] = {"then", "else"};
+
+// Adds a finished operand to the frame on top of the stack and reads what
+// follows it. When that closes the frame, its node is built, popped and
+// stored in *done, otherwise *done is NULL and more operands follow.
+static bool parser_operand(Parser *p, Parse_Stack *stack, Node *operand,
+                           Node **done) {
+  Parse_Frame *top = &stack->items[stack->count - 1];
+  top->operands[top->count++] = operand;
+  *done = NULL;
+  parser_skip_space(p);
+  const char *at = p->p;
+
+  if (top->kind == NK_IF && !top->paren) {
+    if (top->count < 3) {
+      String_View word = {0};
+      if (p->p < p->end && ident_start(*p->p))
+        word = parser_ident(p);
+      const char *keyword = if_keywords[top->count - 1];
+      if (!sv_eq(word, sv_from_cstr(keyword))) {
+        parser_error(p, at, "expected '%s' in the if at %d:%d", keyword,
+                     top->line, top->col);
+        return false;
+      }
+      return true;
+    }
+  } else if (parser_expect(p, ',')) {
+    if (top->count < top->arity)
+      return true;
+    parser_error(p, at, "too many operands, %s takes %zu",
+                 top->paren ? "(...)" : node_kind_name(top->kind),
+                 top->arity);
+    return false;
+  } else if (!parser_expect(p, ')')) {
+    parser_error(p, at, "expected ',' or ')', got %s", parser_describe(p));
+    return false;
+  } else if (top->paren) {
+    if (top->count < 2) {
+      parser_error(p, at, "(...) needs 2 operands for add or 3 for triple, "
+                          "got %zu",
+                   top->count);
+      return false;
+    }
+    top->kind = top->count == 2 ? NK_ADD : NK_TRIPLE;
+  } else if (top->count != top->arity) {
+    parser_error(p, at, "%s takes %zu operands, got %zu",
+                 node_kind_name(top->kind), top->arity, top->count);
+    return false;
+  }
+
+  Node *node = node_loc(p->path, top->line, top->kind);
+  node_set_children(node, top->operands);
+  stack->count -= 1;
+  *done = node;
+  return true;
+}
+
+Node *parse_expr(const char *path, String_View source) {
+  Parser p = {
+      .path = path,
+      .p = source.data,
+      .end = source.data + source.count,
+      .line = 1,
+      .line_start = source.data,
+  };
+  Arena arena = {0};
+  Parse_Stack stack = {0};
+  Node *result = NULL;
+
+  for (;;) {
+    Node *node;
+    if (!parser_open(&p, &arena, &stack, &node))
+      goto defer;
+    // Complete as many operators as this operand finishes
+    while (node != NULL && stack.count > 0) {
+      if (!parser_operand(&p, &stack, node, &node))
+        goto defer;
+    }
+    if (node != NULL && stack.count == 0) {
+      result = node;
+      break;
+    }
+  }
+
+  parser_skip_space(&p);
+  if (p.p < p.end) {
+    parser_error(&p, p.p, "unexpected %s after the expression",
+                 parser_describe(&p));
+    result = NULL;
+  }
+
+defer:
+  arena_free(&arena);
+  return result;
+}
+
+Node *parse_file(const char *path) {
+  String_Builder sb = {0};
+  if (!read_entire_file(path, &sb))
+    return NULL;
+  Node *node = parse_expr(path, sb_to_sv(sb));
+  free(sb.items);
+  return node;
+}
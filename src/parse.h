@@ -0,0 +1,26 @@
+#ifndef PARSE_H_
+#define PARSE_H_
+
+// Reads expressions in the syntax node_fprint() writes:
+//
+//   if gt(mult(x, y), 0) then triple(x, y, 1) else triple(mod(x, y), 0.5, t)
+//
+// Every operator is written name(operands), with the names of
+// node_kind_name(), except for "if c then a else b". The output of older
+// versions, which wrote add and triple as bare parentheses, is read too:
+// (a, b) is add and (a, b, c) is triple. # starts a comment.
+//
+// The parser works directly on the text, without a tokenizer pass or
+// copies, and keeps its own stack, so the depth of the tree is not limited
+// by the C stack. Nodes come from node_loc() like the ones built in C, with
+// the path as their file and the line they start on.
+
+#include "nob.h"
+#include "node.h"
+
+// path names the text in error messages and in the nodes, so it must
+// outlive them. Errors are logged as path:line:col and give NULL.
+Node *parse_expr(const char *path, Nob_String_View source);
+Node *parse_file(const char *path);
+
+#endif // PARSE_H_
@@ -0,0 +1,152 @@
+#define NOB_STRIP_PREFIX
+
+#include "perf.h"
+#include "nob.h"
+#include <errno.h>
+#include <string.h>
+
+static const char *perf_counter_names[COUNT_PERF] = {
+    [PERF_CYCLES] = "cycles",
+    [PERF_INSTRUCTIONS] = "instructions",
+    [PERF_CACHE_MISSES] = "cache misses",
+    [PERF_BRANCH_MISSES] = "branch misses",
+    [PERF_DTLB_MISSES] = "dTLB misses",
+};
+
+#ifdef __linux__
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int perf_event_open(struct perf_event_attr *attr) {
+  // This process and all the threads it creates afterwards, on any CPU
+  return (int)syscall(SYS_perf_event_open, attr, 0, -1, -1, 0);
+}
+
+bool perf_open(Perf *p) {
+  static const struct {
+    uint32_t type;
+    uint64_t config;
+  } events[COUNT_PERF] = {
+      [PERF_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      [PERF_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      [PERF_CACHE_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+      [PERF_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+      [PERF_DTLB_MISSES] = {PERF_TYPE_HW_CACHE,
+                            PERF_COUNT_HW_CACHE_DTLB |
+                                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+  };
+
+  bool any = false;
+  bool denied = false;
+  for (size_t i = 0; i < COUNT_PERF; ++i) {
+    struct perf_event_attr attr = {0};
+    attr.size = sizeof(attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // When there are more counters than hardware slots the kernel
+    // multiplexes them; the times let perf_read() scale the counts.
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    p->fds[i] = perf_event_open(&attr);
+    if (p->fds[i] < 0) {
+      nob_log(WARNING, "perf: %s counter unavailable: %s",
+              perf_counter_names[i], strerror(errno));
+      denied = denied || errno == EACCES || errno == EPERM;
+      continue;
+    }
+    any = true;
+  }
+  if (!any) {
+    if (denied)
+      nob_log(ERROR, "perf: access to the counters was denied, check "
+                     "/proc/sys/kernel/perf_event_paranoid");
+    else
+      nob_log(ERROR, "perf: no hardware counters available on this machine");
+  }
+  return any;
+}
+
+void perf_close(Perf *p) {
+  for (size_t i = 0; i < COUNT_PERF; ++i) {
+    if (p->fds[i] >= 0)
+      close(p->fds[i]);
+    p->fds[i] = -1;
+  }
+}
+
+Perf_Sample perf_read(Perf *p) {
+  Perf_Sample s = {0};
+  for (size_t i = 0; i < COUNT_PERF; ++i) {
+    if (p->fds[i] < 0)
+      continue;
+    uint64_t data[3]; // value, time enabled, time running
+    if (read(p->fds[i], data, sizeof(data)) != sizeof(data))
+      continue;
+    s.values[i] = data[0];
+    if (data[2] > 0 && data[2] < data[1])
+      s.values[i] = (uint64_t)((double)data[0] * data[1] / data[2]);
+    s.valid[i] = true;
+  }
+  return s;
+}
+
+#else
+
+bool perf_open(Perf *p) {
+  for (size_t i = 0; i < COUNT_PERF; ++i)
+    p->fds[i] = -1;
+  nob_log(ERROR, "perf: hardware counters are only supported on Linux");
+  return false;
+}
+
+void perf_close(Perf *p) { (void)p; }
+
+Perf_Sample perf_read(Perf *p) {
+  (void)p;
+  return (Perf_Sample){0};
+}
+
+#endif // __linux__
+
+void perf_report(const char *phase, Perf_Sample begin, Perf_Sample end,
+                 size_t pixels) {
+  double delta[COUNT_PERF];
+  bool valid[COUNT_PERF];
+  for (size_t i = 0; i < COUNT_PERF; ++i) {
+    valid[i] = begin.valid[i] && end.valid[i];
+    delta[i] = valid[i] ? (double)(end.values[i] - begin.values[i]) : 0.0;
+  }
+  if (pixels == 0)
+    pixels = 1;
+
+  String_Builder sb = {0};
+  sb_append_cstr(&sb, temp_sprintf("perf %s:", phase));
+  for (size_t i = 0; i < COUNT_PERF; ++i) {
+    if (!valid[i])
+      continue;
+    if (i == PERF_CYCLES || i == PERF_INSTRUCTIONS) {
+      sb_append_cstr(&sb, temp_sprintf(" %.0f %s,", delta[i],
+                                       perf_counter_names[i]));
+    } else {
+      sb_append_cstr(&sb, temp_sprintf(" %.4f %s/pixel,", delta[i] / pixels,
+                                       perf_counter_names[i]));
+    }
+  }
+  if (valid[PERF_CYCLES] && valid[PERF_INSTRUCTIONS] &&
+      delta[PERF_CYCLES] > 0) {
+    sb_append_cstr(&sb, temp_sprintf(
+                            " IPC %.2f",
+                            delta[PERF_INSTRUCTIONS] / delta[PERF_CYCLES]));
+  }
+  if (sb.count > 0 && sb.items[sb.count - 1] == ',')
+    sb.count -= 1;
+  nob_log(INFO, "%.*s", (int)sb.count, sb.items);
+  free(sb.items);
+}
@@ -0,0 +1,42 @@
+#ifndef PERF_H_
+#define PERF_H_
+
+// Hardware performance counters around a phase of the program, through
+// Linux perf_event_open(2). The counters are opened with inherit set, so
+// render workers created after perf_open() are counted too, as long as they
+// have exited (been joined) before the phase ends.
+//
+// On other systems, or when the kernel refuses (see
+// /proc/sys/kernel/perf_event_paranoid), perf_open() fails and reports why.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_DTLB_MISSES,
+  COUNT_PERF,
+} Perf_Counter;
+
+typedef struct {
+  int fds[COUNT_PERF]; // -1 for counters the kernel refused
+} Perf;
+
+typedef struct {
+  uint64_t values[COUNT_PERF];
+  bool valid[COUNT_PERF];
+} Perf_Sample;
+
+bool perf_open(Perf *p);
+void perf_close(Perf *p);
+
+Perf_Sample perf_read(Perf *p);
+// Logs the difference between two samples, with IPC and misses per pixel
+void perf_report(const char *phase, Perf_Sample begin, Perf_Sample end,
+                 size_t pixels);
+
+#endif // PERF_H_
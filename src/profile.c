@@ -0,0 +1,209 @@
+#define NOB_STRIP_PREFIX
+
+#include "profile.h"
+#include "nob.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef RANDOMART_PROFILE
+
+_Thread_local Profile_Table *profile_table = NULL;
+
+static size_t profile_hash(Node *node, size_t capacity) {
+  uint64_t h = (uint64_t)(uintptr_t)node * 0x9e3779b97f4a7c15ull;
+  return (size_t)(h >> 32) & (capacity - 1);
+}
+
+Profile_Entry *profile_find(const Profile_Table *t, Node *node) {
+  if (t->capacity == 0)
+    return NULL;
+  for (size_t i = profile_hash(node, t->capacity);;
+       i = (i + 1) & (t->capacity - 1)) {
+    if (t->items[i].node == node)
+      return &t->items[i];
+    if (t->items[i].node == NULL)
+      return NULL;
+  }
+}
+
+static void profile_grow(Profile_Table *t) {
+  Profile_Table old = *t;
+  t->capacity = old.capacity ? old.capacity * 2 : 256;
+  t->items = calloc(t->capacity, sizeof(*t->items));
+  NOB_ASSERT(t->items != NULL);
+  t->count = 0;
+  for (size_t i = 0; i < old.capacity; ++i) {
+    if (old.items[i].node) {
+      *profile_entry(t, old.items[i].node) = old.items[i];
+    }
+  }
+  free(old.items);
+}
+
+Profile_Entry *profile_entry(Profile_Table *t, Node *node) {
+  if ((t->count + 1) * 2 > t->capacity)
+    profile_grow(t);
+  size_t i = profile_hash(node, t->capacity);
+  while (t->items[i].node != node) {
+    if (t->items[i].node == NULL) {
+      t->items[i].node = node;
+      t->count += 1;
+      break;
+    }
+    i = (i + 1) & (t->capacity - 1);
+  }
+  return &t->items[i];
+}
+
+void profile_pixel(Profile_Table *t) {
+  t->sampling = t->pixels % PROFILE_SAMPLE_PERIOD == 0;
+  t->pixels += 1;
+}
+
+void profile_merge(Profile_Table *dst, const Profile_Table *src) {
+  for (size_t i = 0; i < src->capacity; ++i) {
+    const Profile_Entry *s = &src->items[i];
+    if (s->node == NULL)
+      continue;
+    Profile_Entry *d = profile_entry(dst, s->node);
+    d->count += s->count;
+    d->samples += s->samples;
+    d->cycles += s->cycles;
+  }
+  dst->pixels += src->pixels;
+}
+
+void profile_free(Profile_Table *t) {
+  free(t->items);
+  memset(t, 0, sizeof(*t));
+}
+
+typedef struct {
+  const char *file;
+  int line;
+  Node_Kind kind;
+  uint64_t count;
+  double self; // estimated cycles over the whole render
+} Profile_Location;
+
+typedef struct {
+  Profile_Location *items;
+  size_t count;
+  size_t capacity;
+} Profile_Locations;
+
+// Cycles of the subtree at node minus the cycles of its children, scaled
+// from the timed pixels to all of them
+static double profile_self(const Profile_Table *t, Node *node) {
+  Profile_Entry *e = profile_find(t, node);
+  if (e == NULL || e->samples == 0)
+    return 0.0;
+  double self = (double)e->cycles;
+  Node *children[3];
+  size_t n = node_children(node, children);
+  for (size_t i = 0; i < n; ++i) {
+    Profile_Entry *c = profile_find(t, children[i]);
+    if (c)
+      self -= (double)c->cycles;
+  }
+  if (self < 0.0)
+    self = 0.0;
+  return self * (double)e->count / (double)e->samples;
+}
+
+static void profile_folded(const Profile_Table *t, Node *node,
+                           String_Builder *path, Profile_Locations *locs) {
+  size_t mark = path->count;
+  if (mark > 0)
+    da_append(path, ';');
+  sb_append_cstr(path, temp_sprintf("%s:%d %s", node->file, node->line,
+                                    node_kind_name(node->kind)));
+
+  Profile_Entry *e = profile_find(t, node);
+  double self = profile_self(t, node);
+  if (self >= 1.0)
+    fprintf(stderr, "%.*s %.0f\n", (int)path->count, path->items, self);
+  da_append(locs, ((Profile_Location){
+                      .file = node->file,
+                      .line = node->line,
+                      .kind = node->kind,
+                      .count = e ? e->count : 0,
+                      .self = self,
+                  }));
+
+  Node *children[3];
+  size_t n = node_children(node, children);
+  for (size_t i = 0; i < n; ++i)
+    profile_folded(t, children[i], path, locs);
+  path->count = mark;
+}
+
+static int compare_location(const void *a, const void *b) {
+  const Profile_Location *la = a, *lb = b;
+  int c = strcmp(la->file, lb->file);
+  if (c != 0)
+    return c;
+  if (la->line != lb->line)
+    return (la->line > lb->line) - (la->line < lb->line);
+  return (la->kind > lb->kind) - (la->kind < lb->kind);
+}
+
+static int compare_self_desc(const void *a, const void *b) {
+  const Profile_Location *la = a, *lb = b;
+  return (la->self < lb->self) - (la->self > lb->self);
+}
+
+void profile_report(const Profile_Table *t, Node *root) {
+  size_t temp = temp_save();
+  Profile_Entry *r = profile_find(t, root);
+  double total = r && r->samples
+                     ? (double)r->cycles * (double)r->count / (double)r->samples
+                     : 0.0;
+  uint64_t pixels = t->pixels ? t->pixels : 1;
+
+  // Folded stacks, one line per node: the path of file:line frames from the
+  // root and the self cost. Feed to flamegraph.pl to get a flame graph.
+  fprintf(stderr,
+          "# eval profile: %" PRIu64 " pixels, one in %d timed, %s\n",
+          t->pixels, PROFILE_SAMPLE_PERIOD, PROFILE_CYCLES_UNIT);
+  fprintf(stderr, "# folded stacks\n");
+  String_Builder path = {0};
+  Profile_Locations locs = {0};
+  profile_folded(t, root, &path, &locs);
+
+  // Nodes of the same kind built by the same line of code are added up
+  qsort(locs.items, locs.count, sizeof(*locs.items), compare_location);
+  size_t merged = 0;
+  for (size_t i = 0; i < locs.count; ++i) {
+    if (merged > 0 && compare_location(&locs.items[merged - 1],
+                                       &locs.items[i]) == 0) {
+      locs.items[merged - 1].count += locs.items[i].count;
+      locs.items[merged - 1].self += locs.items[i].self;
+    } else {
+      locs.items[merged++] = locs.items[i];
+    }
+  }
+  locs.count = merged;
+  qsort(locs.items, locs.count, sizeof(*locs.items), compare_self_desc);
+
+  fprintf(stderr, "# hottest locations\n");
+  fprintf(stderr, "# %-32s %-8s %12s %12s %8s\n", "location", "kind",
+          "evals/pixel", "self/pixel", "self %");
+  for (size_t i = 0; i < locs.count && i < 20; ++i) {
+    Profile_Location *l = &locs.items[i];
+    fprintf(stderr, "# %-32s %-8s %12.2f %12.1f %7.1f%%\n",
+            temp_sprintf("%s:%d", l->file, l->line), node_kind_name(l->kind),
+            (double)l->count / pixels, l->self / pixels,
+            total > 0.0 ? l->self / total * 100.0 : 0.0);
+  }
+  fprintf(stderr, "# total: %.1f %s/pixel\n", total / pixels,
+          PROFILE_CYCLES_UNIT);
+
+  free(path.items);
+  free(locs.items);
+  temp_rewind(temp);
+}
+
+#endif // RANDOMART_PROFILE
@@ -0,0 +1,73 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+// Evaluation profiler, compiled in with -DRANDOMART_PROFILE=ON.
+//
+// Every evaluation of a node of the input tree is counted. On one pixel out
+// of PROFILE_SAMPLE_PERIOD the evaluator also reads the cycle counter around
+// every node, which gives the cycles spent in each subtree. Each render
+// worker records into its own table; render_pixels() merges them and prints
+// a report keyed by the file:line of the nodes. eval(), eval_iter() and
+// bintree_eval() record; the records of a Bintree have no file:line, so the
+// bin backend is reported per record and per kind instead.
+
+#include "node.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PROFILE_SAMPLE_PERIOD 16
+
+typedef struct {
+  Node *node;
+  uint64_t count;   // evaluations
+  uint64_t samples; // evaluations that were timed
+  uint64_t cycles;  // cycles spent in the subtree during the timed ones
+} Profile_Entry;
+
+typedef struct {
+  Profile_Entry *items; // open addressing hash table keyed by node
+  size_t count;
+  size_t capacity;
+  bool sampling; // time the evaluations of the current pixel
+  uint64_t pixels;
+} Profile_Table;
+
+#ifdef RANDOMART_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+static inline uint64_t profile_cycles(void) { return __rdtsc(); }
+#define PROFILE_CYCLES_UNIT "cycles"
+#else
+#include <time.h>
+static inline uint64_t profile_cycles(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#define PROFILE_CYCLES_UNIT "ns"
+#endif
+
+// Table of the calling thread, NULL when it is not profiling
+extern _Thread_local Profile_Table *profile_table;
+
+Profile_Entry *profile_entry(Profile_Table *t, Node *node);
+// NULL when node was never evaluated
+Profile_Entry *profile_find(const Profile_Table *t, Node *node);
+// Key of the record at offset of a Bintree, which has no nodes
+static inline Node *profile_record_key(size_t offset) {
+  return (Node *)(uintptr_t)(offset + 1);
+}
+// Called once per pixel, decides whether this pixel is timed
+void profile_pixel(Profile_Table *t);
+void profile_merge(Profile_Table *dst, const Profile_Table *src);
+void profile_report(const Profile_Table *t, Node *root);
+void profile_free(Profile_Table *t);
+
+#endif // RANDOMART_PROFILE
+
+#endif // PROFILE_H_
@@ -0,0 +1,63 @@
+#include "quantize.h"
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// (bayer[y][x] + 0.5) / 16, the offset added to a channel before truncation
+static const float bayer4[4][4] = {
+    {0.5f / 16, 8.5f / 16, 2.5f / 16, 10.5f / 16},
+    {12.5f / 16, 4.5f / 16, 14.5f / 16, 6.5f / 16},
+    {3.5f / 16, 11.5f / 16, 1.5f / 16, 9.5f / 16},
+    {15.5f / 16, 7.5f / 16, 13.5f / 16, 5.5f / 16},
+};
+
+static inline uint8_t quantize_channel(float c, float offset) {
+  float v = (c + 1.0f) / 2.0f * 255 + offset;
+  // Written so that NaN fails both comparisons
+  v = v > 0.0f ? v : 0.0f;
+  v = v < 255.0f ? v : 255.0f;
+  return (uint8_t)v;
+}
+
+#ifdef __SSE2__
+static inline __m128i quantize_channel4(__m128 c, __m128 offset) {
+  __m128 v = _mm_mul_ps(_mm_add_ps(c, _mm_set1_ps(1.0f)), _mm_set1_ps(0.5f));
+  v = _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.0f)), offset);
+  // maxps returns its second operand when the first one is NaN
+  v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+  return _mm_cvttps_epi32(v);
+}
+#endif
+
+void quantize_row(const float *r, const float *g, const float *b,
+                  RGBA32 *out, int width, int x0, int y, bool dither) {
+  // Rotated so that offsets[x & 3] belongs to pixel x of the row
+  float offsets[4] = {0};
+  for (int i = 0; dither && i < 4; ++i)
+    offsets[i] = bayer4[y & 3][(x0 + i) & 3];
+  int x = 0;
+#ifdef __SSE2__
+  // Four pixels at a time; RGBA32 is r, g, b, a in memory, so on this
+  // little-endian target a pixel is r | g << 8 | b << 16 | a << 24.
+  __m128 offset = _mm_loadu_ps(offsets);
+  __m128i alpha = _mm_set1_epi32((int32_t)0xFF000000);
+  for (; x + 4 <= width; x += 4) {
+    __m128i ri = quantize_channel4(_mm_loadu_ps(r + x), offset);
+    __m128i gi = quantize_channel4(_mm_loadu_ps(g + x), offset);
+    __m128i bi = quantize_channel4(_mm_loadu_ps(b + x), offset);
+    __m128i pixels = _mm_or_si128(
+        _mm_or_si128(ri, _mm_slli_epi32(gi, 8)),
+        _mm_or_si128(_mm_slli_epi32(bi, 16), alpha));
+    _mm_storeu_si128((__m128i *)(out + x), pixels);
+  }
+#endif
+  for (; x < width; ++x) {
+    float offset = offsets[x & 3];
+    out[x].r = quantize_channel(r[x], offset);
+    out[x].g = quantize_channel(g[x], offset);
+    out[x].b = quantize_channel(b[x], offset);
+    out[x].a = 255;
+  }
+}
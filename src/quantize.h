@@ -0,0 +1,19 @@
+#ifndef QUANTIZE_H_
+#define QUANTIZE_H_
+
+#include "render.h"
+#include <stdbool.h>
+
+// Converts rows of colors in [-1, 1], given as separate red, green and blue
+// float planes, to opaque RGBA32. Every channel is mapped with
+// (c + 1) / 2 * 255, clamped to [0, 255] (NaN becomes 0) and truncated, so
+// in-range colors give the same bytes as the plain conversion.
+//
+// With dither set a 4x4 ordered (Bayer) threshold is added before truncating,
+// which trades the banding of smooth gradients for a fine regular pattern.
+// The threshold depends on the pixel position, so x and y are the position of
+// the first pixel in the image.
+void quantize_row(const float *r, const float *g, const float *b,
+                  RGBA32 *out, int width, int x, int y, bool dither);
+
+#endif // QUANTIZE_H_
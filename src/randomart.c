@@ -0,0 +1,125 @@
+#define NOB_STRIP_PREFIX
+
+#include "randomart.h"
+#include "bintree.h"
+#include "gen.h"
+#include "nob.h"
+#include "parse.h"
+#include "stb_image_write.h"
+
+// Nodes go to the arena of the context on this thread while it is set
+static Arena *randomart_enter(Randomart *ra) {
+  Arena *outer = scratch_arena;
+  scratch_arena = &ra->nodes;
+  return outer;
+}
+
+Node *randomart_parse(Randomart *ra, const char *text, size_t size) {
+  Arena *outer = randomart_enter(ra);
+  Node *f = parse_expr("<randomart>", sv_from_parts(text, size));
+  scratch_arena = outer;
+  return f;
+}
+
+Node *randomart_load(Randomart *ra, const void *data, size_t size) {
+  Bintree_File file;
+  Bintree bin;
+  if (!bintree_read(&file, data, size) || !bintree_get(&file, 0, &bin))
+    return NULL;
+  Arena *outer = randomart_enter(ra);
+  Node *f = bintree_to_node(&bin);
+  scratch_arena = outer;
+  return f;
+}
+
+Node *randomart_generate(Randomart *ra, uint64_t seed, int depth) {
+  Arena *outer = randomart_enter(ra);
+  Node *f = gen_tree(seed, depth);
+  scratch_arena = outer;
+  return f;
+}
+
+void randomart_begin(Randomart *ra) { scratch_arena = &ra->nodes; }
+
+void randomart_end(Randomart *ra) {
+  if (scratch_arena == &ra->nodes)
+    scratch_arena = NULL;
+}
+
+// The framebuffer and the options of a render into buffer
+static bool randomart_target(Randomart *ra, void *buffer, int width,
+                             int height, size_t stride,
+                             const Render_Viewport *viewport, Framebuffer *fb,
+                             Render_Options *opts) {
+  if (width <= 0 || height <= 0 || stride % sizeof(RGBA32) != 0 ||
+      stride < (size_t)width * sizeof(RGBA32)) {
+    nob_log(ERROR, "Bad buffer: %dx%d pixels, %zu bytes per row", width,
+            height, stride);
+    return false;
+  }
+  *fb = (Framebuffer){.pixels = buffer,
+                      .width = width,
+                      .height = height,
+                      .stride = (int)(stride / sizeof(RGBA32))};
+  *opts = ra->opts;
+  opts->viewport = viewport ? *viewport : (Render_Viewport){0};
+  opts->pool = &ra->pool;
+  return true;
+}
+
+bool randomart_render_into(Randomart *ra, Node *tree, void *buffer, int width,
+                           int height, size_t stride,
+                           const Render_Viewport *viewport) {
+  Framebuffer fb;
+  Render_Options opts;
+  if (!randomart_target(ra, buffer, width, height, stride, viewport, &fb,
+                        &opts))
+    return false;
+
+  // What the calling thread evaluates, for the symmetry tests, is dropped
+  // afterwards
+  Arena_Mark mark = arena_snapshot(&ra->nodes);
+  Arena *outer = randomart_enter(ra);
+  bool ok = render_pixels(tree, &fb, &opts);
+  scratch_arena = outer;
+  arena_rewind(&ra->nodes, mark);
+  return ok;
+}
+
+bool randomart_render_binary(Randomart *ra, const void *data, size_t size,
+                             void *buffer, int width, int height,
+                             size_t stride, const Render_Viewport *viewport) {
+  Framebuffer fb;
+  Render_Options opts;
+  Bintree_File file;
+  Bintree bin;
+  if (!randomart_target(ra, buffer, width, height, stride, viewport, &fb,
+                        &opts) ||
+      !bintree_read(&file, data, size) || !bintree_get(&file, 0, &bin))
+    return false;
+  if (opts.symmetry == SYMMETRY_OFF)
+    return render_bintree(&bin, &fb, &opts);
+
+  // The symmetry tests need the nodes, which are dropped afterwards
+  Arena_Mark mark = arena_snapshot(&ra->nodes);
+  Arena *outer = randomart_enter(ra);
+  Node *tree = bintree_to_node(&bin);
+  bool ok = tree != NULL && render_pixels(tree, &fb, &opts);
+  scratch_arena = outer;
+  arena_rewind(&ra->nodes, mark);
+  return ok;
+}
+
+bool randomart_write_png(const void *buffer, int width, int height,
+                         size_t stride, Randomart_Write_Func *write,
+                         void *user) {
+  return stbi_write_png_to_func(write, user, width, height, sizeof(RGBA32),
+                                buffer, (int)stride) != 0;
+}
+
+void randomart_reset(Randomart *ra) { arena_reset(&ra->nodes); }
+
+void randomart_free(Randomart *ra) {
+  arena_free(&ra->nodes);
+  region_pool_free(&ra->pool);
+}
@@ -0,0 +1,69 @@
+#ifndef RANDOMART_H_
+#define RANDOMART_H_
+
+// Entry points for programs that embed the renderer instead of running
+// ran-art.
+//
+// A Randomart context owns the nodes of the trees built in it and the regions
+// of its render workers, so threads with contexts of their own render at the
+// same time without sharing anything but the trace, which is off unless
+// started. A context is used by one thread at a time.
+//
+//   Randomart ra = {.opts = {.threads = 4}};
+//   Node *tree = randomart_parse(&ra, text, size);
+//   if (tree && randomart_render_into(&ra, tree, pixels, w, h, w * 4, NULL))
+//     randomart_write_png(pixels, w, h, w * 4, write, user);
+//   randomart_free(&ra);
+
+#include "node.h"
+#include "render.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  Render_Options opts; // of every render, but for the viewport and the pool
+  Arena nodes;
+  Region_Pool pool;
+} Randomart;
+
+// The expression text format of parse.h
+Node *randomart_parse(Randomart *ra, const char *text, size_t size);
+// The first tree of a file written by bintree_write_file(), held in memory.
+// randomart_render_binary() renders one without building its nodes.
+Node *randomart_load(Randomart *ra, const void *data, size_t size);
+// A tree of gen_tree()
+Node *randomart_generate(Randomart *ra, uint64_t seed, int depth);
+
+// Between these, the node_*() constructors of node.h build nodes in ra on the
+// calling thread
+void randomart_begin(Randomart *ra);
+void randomart_end(Randomart *ra);
+
+// Renders tree into width x height RGBA pixels, stride bytes apart from one
+// row to the next (a multiple of 4). viewport places them in a larger image,
+// NULL for the whole image.
+bool randomart_render_into(Randomart *ra, Node *tree, void *buffer, int width,
+                           int height, size_t stride,
+                           const Render_Viewport *viewport);
+
+// Renders the first tree of a file written by bintree_write_file() straight
+// from data, without building its nodes unless ra->opts asks for symmetry.
+// data only needs to stay valid during the call.
+bool randomart_render_binary(Randomart *ra, const void *data, size_t size,
+                             void *buffer, int width, int height,
+                             size_t stride, const Render_Viewport *viewport);
+
+// Receives the PNG file in pieces, like stbi_write_func
+typedef void Randomart_Write_Func(void *user, void *data, int size);
+
+// Encodes pixels laid out like the ones of randomart_render_into()
+bool randomart_write_png(const void *buffer, int width, int height,
+                         size_t stride, Randomart_Write_Func *write,
+                         void *user);
+
+// Drops every tree of ra and keeps the memory for the next ones
+void randomart_reset(Randomart *ra);
+void randomart_free(Randomart *ra);
+
+#endif // RANDOMART_H_
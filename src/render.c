@@ -0,0 +1,812 @@
+#define NOB_STRIP_PREFIX
+
+#include "render.h"
+#include "bintree.h"
+#include "nob.h"
+#include "profile.h"
+#include "quantize.h"
+#include "trace.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// The regions of the worker arenas are handed back to region_pool when a
+// worker finishes, so the next render reuses them.
+static Region_Pool region_pool = {0};
+
+static const char *backend_names[COUNT_BACKENDS] = {
+    [BACKEND_EVAL] = "eval",
+    [BACKEND_STACK] = "stack",
+    [BACKEND_BIN] = "bin",
+};
+
+const char *backend_name(Backend backend) {
+  NOB_ASSERT(backend < COUNT_BACKENDS);
+  return backend_names[backend];
+}
+
+bool backend_by_name(const char *name, Backend *backend) {
+  for (Backend b = 0; b < COUNT_BACKENDS; ++b) {
+    if (strcmp(backend_names[b], name) == 0) {
+      *backend = b;
+      return true;
+    }
+  }
+  return false;
+}
+
+typedef struct {
+  Node *f;
+  Framebuffer *fb;
+  Render_Viewport view; // resolved, pixel (0, 0) of fb is (view.x, view.y)
+  // Tiles of symmetric images: every pixel takes the color of the pixel of
+  // the fundamental region render_symmetric() copies into it
+  Symmetry remap;
+  Region_Pool *pool;
+  Backend backend;
+  Bintree bin;             // f encoded for BACKEND_BIN, or the caller's
+  String_Builder bin_code; // holds bin.code when it is f encoded
+  bool dither;
+  float t;
+  // Progressive passes: only the samples on the step grid that are not on
+  // the grid of the previous pass are evaluated, into full size float planes.
+  int step;
+  int coarse_step; // step of the previous pass, 0 for the first one
+  float *planes[3];
+  // Symmetric renders only cover the top left cols x rows pixels (0 for all
+  // of them), and with lower set only the pixels with x <= y there
+  int cols, rows;
+  bool lower;
+  // Anti-aliasing pass: up to aa_extra samples spread over each pixel in
+  // edges, their average replaces the one in planes
+  const uint32_t *edges;
+  size_t edges_count;
+  int aa_extra;
+  atomic_size_t aa_taken;
+  atomic_int next_row;
+  atomic_bool failed;
+#ifdef RANDOMART_PROFILE
+  Profile_Table profile;
+#endif
+} Render_Job;
+
+typedef struct {
+  pthread_t thread;
+  Render_Job *job;
+  int index;
+  size_t rows;
+  Arena_Stats stats;
+#ifdef RANDOMART_PROFILE
+  Profile_Table profile;
+#endif
+} Render_Worker;
+
+int cpu_count(void) {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+#endif
+}
+
+Render_Viewport viewport_resolve(const Render_Viewport *vp, int width,
+                                 int height) {
+  Render_Viewport r = *vp;
+  if (r.width <= 0)
+    r.width = width;
+  if (r.height <= 0)
+    r.height = height;
+  if (r.scale == 0.0f)
+    r.scale = 1.0f;
+  return r;
+}
+
+bool viewport_whole(const Render_Viewport *vp, int width, int height) {
+  return vp->x == 0 && vp->y == 0 && vp->width == width &&
+         vp->height == height;
+}
+
+bool viewport_check(const Render_Viewport *vp, int width, int height) {
+  if (vp->x < 0 || vp->y < 0 || vp->x + width > vp->width ||
+      vp->y + height > vp->height || !(vp->scale > 0.0f)) {
+    nob_log(ERROR,
+            "Bad viewport: %dx%d pixels at %d,%d of an image of %dx%d, "
+            "scale %g",
+            width, height, vp->x, vp->y, vp->width, vp->height, vp->scale);
+    return false;
+  }
+  return true;
+}
+
+// Fills in the parts of job that come from the options. With bin set, job
+// evaluates its records rather than f, which is NULL.
+static void render_job_init(Render_Job *job, Node *f, const Bintree *bin,
+                            Framebuffer *fb, const Render_Options *opts) {
+  job->f = f;
+  job->fb = fb;
+  job->view = viewport_resolve(&opts->viewport, fb->width, fb->height);
+  job->pool = opts->pool ? opts->pool : &region_pool;
+  job->backend = opts->backend;
+  if (bin) {
+    job->bin = *bin;
+    job->backend = BACKEND_BIN;
+  }
+  job->dither = opts->dither;
+  job->t = opts->t;
+}
+
+// The pixel of the fundamental region whose color render_symmetric() gives
+// to (x, y), with the same rules
+static void render_representative(const Render_Job *job, int *x, int *y) {
+  int w = job->view.width, h = job->view.height;
+  if (job->remap.mirror_x && *x >= w / 2 + 1)
+    *x = w - *x;
+  if (job->remap.mirror_y && *y >= h / 2 + 1)
+    *y = h - *y;
+  if (job->remap.swap && *x > *y) {
+    int swap = *x;
+    *x = *y;
+    *y = swap;
+  }
+}
+
+// Evaluation stack of BACKEND_BIN, allocated by each worker
+static _Thread_local float *bin_scratch;
+
+static bool render_sample(Render_Job *job, Eval_Stack *stack, float nx,
+                          float ny, Color *c) {
+  switch (job->backend) {
+  case BACKEND_STACK:
+    return eval_func_iter(stack, job->f, nx, ny, job->t, c);
+  case BACKEND_BIN:
+    // The types were checked when encoding, evaluation cannot fail
+    bintree_eval(&job->bin, nx, ny, job->t, bin_scratch, c);
+    return true;
+  default:
+    return eval_func(job->f, nx, ny, job->t, c);
+  }
+}
+
+// One row of colors as float planes, handed to quantize_row() when complete
+typedef struct {
+  float *r, *g, *b;
+} Render_Row;
+
+static void render_row(Render_Job *job, int y, Arena *arena, Eval_Stack *stack,
+                       Render_Row *row, bool *ok) {
+  Framebuffer *fb = job->fb;
+  const Render_Viewport *view = &job->view;
+  bool remap = symmetry_any(job->remap);
+  float ny = viewport_y(view, (float)(view->y + y));
+  for (int x = 0; x < fb->width; x++) {
+    float nx;
+    if (remap) {
+      int px = view->x + x, py = view->y + y;
+      render_representative(job, &px, &py);
+      nx = viewport_x(view, (float)px);
+      ny = viewport_y(view, (float)py);
+    } else {
+      nx = viewport_x(view, (float)(view->x + x));
+    }
+    // Color c = f(nx, ny);
+    Color c;
+#ifdef RANDOMART_PROFILE
+    if (profile_table)
+      profile_pixel(profile_table);
+#endif
+    Arena_Mark mark = arena_snapshot(arena);
+    bool pixel_ok = render_sample(job, stack, nx, ny, &c);
+    arena_rewind(arena, mark);
+    if (!pixel_ok) {
+      *ok = false;
+      return;
+    }
+    row->r[x] = c.r;
+    row->g[x] = c.g;
+    row->b[x] = c.b;
+  }
+  quantize_row(row->r, row->g, row->b, framebuffer_row(fb, y), fb->width,
+               view->x, view->y + y, job->dither);
+}
+
+// Row gy of the grid of a progressive pass. Every new sample is copied over
+// its step x step block, finer passes overwrite the part they refine.
+static void render_grid_row(Render_Job *job, int gy, Arena *arena,
+                            Eval_Stack *stack, bool *ok) {
+  Framebuffer *fb = job->fb;
+  int step = job->step;
+  int y = gy * step;
+  float ny = viewport_y(&job->view, (float)(job->view.y + y));
+  int coarse = job->coarse_step;
+  int y1 = y + step < fb->height ? y + step : fb->height;
+  int cols = job->cols > 0 ? job->cols : fb->width;
+  if (job->lower && cols > y + 1)
+    cols = y + 1;
+  for (int x = 0; x < cols; x += step) {
+    if (coarse > 0 && x % coarse == 0 && y % coarse == 0)
+      continue; // done by the previous pass
+    float nx = viewport_x(&job->view, (float)(job->view.x + x));
+    Color c;
+#ifdef RANDOMART_PROFILE
+    if (profile_table)
+      profile_pixel(profile_table);
+#endif
+    Arena_Mark mark = arena_snapshot(arena);
+    bool pixel_ok = render_sample(job, stack, nx, ny, &c);
+    arena_rewind(arena, mark);
+    if (!pixel_ok) {
+      *ok = false;
+      return;
+    }
+    int x1 = x + step < fb->width ? x + step : fb->width;
+    for (int by = y; by < y1; ++by) {
+      size_t row = (size_t)by * fb->width;
+      for (int bx = x; bx < x1; ++bx) {
+        job->planes[0][row + bx] = c.r;
+        job->planes[1][row + bx] = c.g;
+        job->planes[2][row + bx] = c.b;
+      }
+    }
+  }
+}
+
+// Edge pixels are handed to the workers in chunks of this many
+#define RENDER_AA_CHUNK 64
+// Colors further apart than 4 steps of the 8 bit output count as an edge
+#define RENDER_AA_THRESHOLD (4.0f * 2.0f / 255.0f)
+// Samples taken before deciding whether a pixel needs the rest
+#define RENDER_AA_PROBE 3
+
+static inline float aa_clamp(float c) {
+  // Same range as quantize_row(), NaN goes to -1 like it goes to 0 there
+  return fminf(fmaxf(c, -1.0f), 1.0f);
+}
+
+static inline bool aa_differ(Color a, Color b) {
+  return fabsf(aa_clamp(a.r) - aa_clamp(b.r)) > RENDER_AA_THRESHOLD ||
+         fabsf(aa_clamp(a.g) - aa_clamp(b.g)) > RENDER_AA_THRESHOLD ||
+         fabsf(aa_clamp(a.b) - aa_clamp(b.b)) > RENDER_AA_THRESHOLD;
+}
+
+// Offset in [0, 1)^2 of sample i of a pixel: the R2 low discrepancy sequence,
+// shifted by a hash of the pixel so that neighbouring edge pixels do not all
+// use the same pattern. The corner sample of the base pass is not part of
+// the average, it sits on the pixel boundary and the edges of NK_GT on x or y
+// often run exactly through it.
+static void aa_offset(int x, int y, int i, float *ox, float *oy) {
+  uint32_t h = (uint32_t)x * 0x9e3779b1u ^ (uint32_t)y * 0x85ebca77u;
+  h ^= h >> 15;
+  h *= 0x2c1b3c6du;
+  h ^= h >> 12;
+  float jx = (float)(h & 0xffff) / 65536.0f;
+  float jy = (float)(h >> 16) / 65536.0f;
+  float fx = jx + 0.7548776662f * (float)i;
+  float fy = jy + 0.5698402910f * (float)i;
+  *ox = fx - floorf(fx);
+  *oy = fy - floorf(fy);
+}
+
+// Chunk of the edge pixels: a few samples first, and the rest of the budget
+// only where they disagree with each other or with the base sample.
+static void render_edges(Render_Job *job, int chunk, Arena *arena,
+                         Eval_Stack *stack, bool *ok) {
+  Framebuffer *fb = job->fb;
+  size_t begin = (size_t)chunk * RENDER_AA_CHUNK;
+  size_t end = begin + RENDER_AA_CHUNK < job->edges_count
+                   ? begin + RENDER_AA_CHUNK
+                   : job->edges_count;
+  size_t taken = 0;
+  for (size_t e = begin; e < end; ++e) {
+    size_t index = job->edges[e];
+    // In the image, for the offsets and coordinates to match whole renders
+    int x = job->view.x + (int)(index % fb->width);
+    int y = job->view.y + (int)(index / fb->width);
+    Color base = {job->planes[0][index], job->planes[1][index],
+                  job->planes[2][index]};
+    Color lo = {aa_clamp(base.r), aa_clamp(base.g), aa_clamp(base.b)};
+    Color hi = lo;
+    Color sum = {0};
+    int n = 0;
+    for (int i = 0; i < job->aa_extra; ++i) {
+      if (i == RENDER_AA_PROBE && !aa_differ(lo, hi))
+        break; // the probes agree, the pixel is flat after all
+      float ox, oy;
+      aa_offset(x, y, i, &ox, &oy);
+      float nx = viewport_x(&job->view, (float)x + ox);
+      float ny = viewport_y(&job->view, (float)y + oy);
+      Color c;
+#ifdef RANDOMART_PROFILE
+      if (profile_table)
+        profile_pixel(profile_table);
+#endif
+      Arena_Mark mark = arena_snapshot(arena);
+      bool pixel_ok = render_sample(job, stack, nx, ny, &c);
+      arena_rewind(arena, mark);
+      if (!pixel_ok) {
+        *ok = false;
+        return;
+      }
+      c = (Color){aa_clamp(c.r), aa_clamp(c.g), aa_clamp(c.b)};
+      sum.r += c.r;
+      sum.g += c.g;
+      sum.b += c.b;
+      lo = (Color){fminf(lo.r, c.r), fminf(lo.g, c.g), fminf(lo.b, c.b)};
+      hi = (Color){fmaxf(hi.r, c.r), fmaxf(hi.g, c.g), fmaxf(hi.b, c.b)};
+      n += 1;
+    }
+    taken += n;
+    if (n == job->aa_extra) {
+      job->planes[0][index] = sum.r / n;
+      job->planes[1][index] = sum.g / n;
+      job->planes[2][index] = sum.b / n;
+    }
+  }
+  atomic_fetch_add(&job->aa_taken, taken);
+}
+
+static void *render_worker(void *arg) {
+  Render_Worker *worker = arg;
+  Render_Job *job = worker->job;
+  Arena arena = {.pool = job->pool};
+  scratch_arena = &arena;
+  // One per run, so no other tree can take the place of job->f while it
+  // holds the program of job->f
+  Eval_Stack stack = {.arena = {.pool = job->pool}};
+  // Allocated before any per-pixel snapshot, so rewinding keeps them
+  size_t row_bytes = job->fb->width * sizeof(float);
+  Render_Row row = {
+      .r = arena_alloc(&arena, row_bytes),
+      .g = arena_alloc(&arena, row_bytes),
+      .b = arena_alloc(&arena, row_bytes),
+  };
+  if (job->backend == BACKEND_BIN)
+    bin_scratch =
+        arena_alloc(&arena, bintree_scratch_size(&job->bin) * sizeof(float));
+#ifdef RANDOMART_PROFILE
+  profile_table = &worker->profile;
+#endif
+  char thread_name[32];
+  snprintf(thread_name, sizeof(thread_name), "render worker %d", worker->index);
+  trace_thread_name(thread_name);
+
+  int rows = job->edges
+                 ? (int)((job->edges_count + RENDER_AA_CHUNK - 1) /
+                         RENDER_AA_CHUNK)
+                 : ((job->rows > 0 ? job->rows : job->fb->height) +
+                    job->step - 1) /
+                       job->step;
+  while (!atomic_load(&job->failed)) {
+    int y = atomic_fetch_add(&job->next_row, 1);
+    if (y >= rows)
+      break;
+    bool ok = true;
+    Trace_Span span = trace_begin("render row");
+    if (job->edges)
+      render_edges(job, y, &arena, &stack, &ok);
+    else if (job->planes[0])
+      render_grid_row(job, y, &arena, &stack, &ok);
+    else
+      render_row(job, y, &arena, &stack, &row, &ok);
+    trace_end_arg(span, "y", y);
+    if (!ok) {
+      atomic_store(&job->failed, true);
+      break;
+    }
+    worker->rows += 1;
+  }
+
+  scratch_arena = NULL;
+  bin_scratch = NULL;
+#ifdef RANDOMART_PROFILE
+  profile_table = NULL;
+#endif
+  worker->stats = arena.stats;
+  arena_free(&arena);
+  eval_stack_free(&stack);
+  return NULL;
+}
+
+// Reports the profile of job and frees what render_run() left in it
+static void render_job_finish(Render_Job *job) {
+#ifdef RANDOMART_PROFILE
+  if (job->backend == BACKEND_BIN && job->bin.code != NULL)
+    bintree_profile_report(&job->bin, &job->profile);
+  else
+    profile_report(&job->profile, job->f);
+  profile_free(&job->profile);
+#endif
+  free(job->bin_code.items);
+}
+
+// Side of the grid of points symmetry_sample() compares
+#define RENDER_SYMMETRY_SAMPLES 64
+
+// Runs the workers over the rows of job and merges their profiles into
+// job->profile.
+static bool render_run(Render_Job *job, const Render_Options *opts) {
+  // Encoded on the first run, the passes of a job share it
+  if (job->backend == BACKEND_BIN && job->bin.code == NULL) {
+    if (!bintree_encode(job->f, true, &job->bin_code) ||
+        !bintree_load((const uint8_t *)job->bin_code.items,
+                      job->bin_code.count, &job->bin))
+      return false;
+  }
+
+  int workers_count = opts->threads > 0 ? opts->threads : cpu_count();
+  Render_Worker *workers = calloc(workers_count, sizeof(*workers));
+  NOB_ASSERT(workers != NULL);
+
+  for (int i = 0; i < workers_count; ++i) {
+    workers[i].job = job;
+    workers[i].index = i;
+    if (pthread_create(&workers[i].thread, NULL, render_worker, &workers[i]) !=
+        0) {
+      nob_log(ERROR, "Could not create render worker %d", i);
+      atomic_store(&job->failed, true);
+      workers_count = i;
+      break;
+    }
+  }
+  for (int i = 0; i < workers_count; ++i) {
+    pthread_join(workers[i].thread, NULL);
+  }
+
+  if (opts->log_stats) {
+    for (int i = 0; i < workers_count; ++i) {
+      Arena_Stats *s = &workers[i].stats;
+      nob_log(INFO,
+              "worker %d: %zu rows, %zu allocs, %zu bytes, %zu new regions, "
+              "%zu recycled regions",
+              i, workers[i].rows, s->allocs, s->bytes, s->regions_new,
+              s->regions_recycled);
+    }
+  }
+
+#ifdef RANDOMART_PROFILE
+  for (int i = 0; i < workers_count; ++i) {
+    profile_merge(&job->profile, &workers[i].profile);
+    profile_free(&workers[i].profile);
+  }
+#endif
+
+  free(workers);
+  return workers_count > 0 && !atomic_load(&job->failed);
+}
+
+// Contrast of a pixel with its neighbours, in steps of 1/127
+static uint8_t aa_contrast(Color a, Color b) {
+  float d = fmaxf(fabsf(aa_clamp(a.r) - aa_clamp(b.r)),
+                  fmaxf(fabsf(aa_clamp(a.g) - aa_clamp(b.g)),
+                        fabsf(aa_clamp(a.b) - aa_clamp(b.b))));
+  return (uint8_t)(d * 127.0f);
+}
+
+// Picks the pixels that differ from a neighbour by more than
+// RENDER_AA_THRESHOLD. When there are more than max_edges of them (0 for no
+// limit), the ones with the least contrast are left out.
+static size_t aa_find_edges(Render_Job *job, size_t max_edges,
+                            uint32_t *edges) {
+  int w = job->fb->width, h = job->fb->height;
+  size_t count = (size_t)w * h;
+  uint8_t *contrast = calloc(count, 1);
+  NOB_ASSERT(contrast != NULL);
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      size_t i = (size_t)y * w + x;
+      Color c = {job->planes[0][i], job->planes[1][i], job->planes[2][i]};
+      size_t neighbours[2] = {i + 1, i + w};
+      bool inside[2] = {x + 1 < w, y + 1 < h};
+      for (int k = 0; k < 2; ++k) {
+        if (!inside[k])
+          continue;
+        size_t j = neighbours[k];
+        Color d = {job->planes[0][j], job->planes[1][j], job->planes[2][j]};
+        if (!aa_differ(c, d))
+          continue;
+        uint8_t v = aa_contrast(c, d);
+        if (v == 0)
+          v = 1; // 0 means not an edge
+        if (contrast[i] < v)
+          contrast[i] = v;
+        if (contrast[j] < v)
+          contrast[j] = v;
+      }
+    }
+  }
+
+  size_t hist[256] = {0};
+  for (size_t i = 0; i < count; ++i)
+    hist[contrast[i]] += 1;
+  int min_level = 1;
+  if (max_edges > 0) {
+    size_t kept = 0;
+    for (min_level = 255; min_level > 1; --min_level) {
+      if (kept + hist[min_level] > max_edges)
+        break;
+      kept += hist[min_level];
+    }
+    if (kept + hist[min_level] > max_edges)
+      min_level += 1;
+  }
+
+  size_t edges_count = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (contrast[i] >= min_level)
+      edges[edges_count++] = (uint32_t)i;
+  }
+  free(contrast);
+  return edges_count;
+}
+
+static bool render_antialiased(Node *f, const Bintree *bin, Framebuffer *fb,
+                               const Render_Options *opts) {
+  Trace_Span span = trace_begin("render_antialiased");
+  // Whether a pixel is on an edge depends on its neighbours, so a tile is
+  // rendered with a margin of one pixel, where the image has one
+  Render_Job job = {.step = 1};
+  render_job_init(&job, f, bin, fb, opts);
+  Render_Viewport view = job.view;
+  int x0 = view.x > 0 ? view.x - 1 : 0;
+  int y0 = view.y > 0 ? view.y - 1 : 0;
+  int x1 = view.x + fb->width < view.width ? view.x + fb->width + 1
+                                           : view.width;
+  int y1 = view.y + fb->height < view.height ? view.y + fb->height + 1
+                                             : view.height;
+  Framebuffer area = {.width = x1 - x0, .height = y1 - y0};
+  job.fb = &area;
+  job.view.x = x0;
+  job.view.y = y0;
+  size_t count = (size_t)area.width * area.height;
+  for (int i = 0; i < 3; ++i) {
+    job.planes[i] = malloc(count * sizeof(float));
+    NOB_ASSERT(job.planes[i] != NULL);
+  }
+  uint32_t *edges = NULL;
+
+  bool ok = render_run(&job, opts);
+  if (ok) {
+    Trace_Span edges_span = trace_begin("find edges");
+    edges = malloc(count * sizeof(*edges));
+    NOB_ASSERT(edges != NULL);
+    // Leave out edges rather than go below a few samples per pixel
+    int min_samples = opts->aa_samples < RENDER_AA_PROBE + 1
+                          ? opts->aa_samples
+                          : RENDER_AA_PROBE + 1;
+    job.edges_count =
+        aa_find_edges(&job, opts->aa_budget / min_samples, edges);
+    trace_end_arg(edges_span, "edges", (int64_t)job.edges_count);
+
+    job.edges = edges;
+    job.aa_extra = opts->aa_samples;
+    if (opts->aa_budget > 0 && job.edges_count > 0 &&
+        opts->aa_budget / job.edges_count < (size_t)job.aa_extra)
+      job.aa_extra = (int)(opts->aa_budget / job.edges_count);
+    atomic_store(&job.next_row, 0);
+    if (job.aa_extra > 0 && job.edges_count > 0)
+      ok = render_run(&job, opts);
+  }
+  if (ok) {
+    for (int y = 0; y < fb->height; ++y) {
+      size_t row = (size_t)(view.y - y0 + y) * area.width + (view.x - x0);
+      quantize_row(job.planes[0] + row, job.planes[1] + row,
+                   job.planes[2] + row, framebuffer_row(fb, y), fb->width,
+                   view.x, view.y + y, job.dither);
+    }
+    if (opts->log_stats) {
+      size_t taken = atomic_load(&job.aa_taken);
+      nob_log(INFO,
+              "Anti-aliasing: %zu edge pixels (%.1f%%), %zu more samples, "
+              "%.2f samples per pixel",
+              job.edges_count, 100.0 * job.edges_count / count, taken,
+              (double)(count + taken) / count);
+    }
+  }
+
+  render_job_finish(&job);
+
+  free(edges);
+  for (int i = 0; i < 3; ++i)
+    free(job.planes[i]);
+  trace_end(span);
+  return ok;
+}
+
+// Renders the part of the image that the symmetries do not determine and
+// mirrors it into the rest. A mirrored pixel gets the color of the exact
+// negation of its partner's coordinate, which viewport_x() and viewport_y()
+// also give it in the plain mapping.
+static bool render_symmetric(Node *f, Framebuffer *fb,
+                             const Render_Options *opts, Symmetry sym) {
+  Trace_Span span = trace_begin("render_symmetric");
+  int w = fb->width, h = fb->height;
+  size_t count = (size_t)w * h;
+  // Pixel x mirrors to w - x, so pixel 0 has no partner and w / 2 is its own
+  Render_Job job = {.step = 1,
+                    .cols = sym.mirror_x ? w / 2 + 1 : w,
+                    .rows = sym.mirror_y ? h / 2 + 1 : h,
+                    .lower = sym.swap};
+  render_job_init(&job, f, NULL, fb, opts);
+  for (int i = 0; i < 3; ++i) {
+    job.planes[i] = malloc(count * sizeof(float));
+    NOB_ASSERT(job.planes[i] != NULL);
+  }
+
+  bool ok = render_run(&job, opts);
+  if (ok) {
+    Trace_Span fill_span = trace_begin("mirror");
+    for (int p = 0; p < 3; ++p) {
+      float *plane = job.planes[p];
+      if (sym.swap) {
+        for (int y = 0; y < job.rows; ++y) {
+          for (int x = y + 1; x < job.cols; ++x)
+            plane[(size_t)y * w + x] = plane[(size_t)x * w + y];
+        }
+      }
+      if (sym.mirror_x) {
+        for (int y = 0; y < job.rows; ++y) {
+          float *row = plane + (size_t)y * w;
+          for (int x = job.cols; x < w; ++x)
+            row[x] = row[w - x];
+        }
+      }
+      if (sym.mirror_y) {
+        for (int y = job.rows; y < h; ++y)
+          memcpy(plane + (size_t)y * w, plane + (size_t)(h - y) * w,
+                 w * sizeof(float));
+      }
+    }
+    for (int y = 0; y < h; ++y) {
+      size_t row = (size_t)y * w;
+      quantize_row(job.planes[0] + row, job.planes[1] + row,
+                   job.planes[2] + row, framebuffer_row(fb, y), w, 0, y,
+                   job.dither);
+    }
+    trace_end(fill_span);
+  }
+
+  if (ok && opts->log_stats) {
+    size_t rendered = (size_t)job.cols * job.rows;
+    if (sym.swap)
+      rendered = (size_t)job.cols * (job.cols + 1) / 2;
+    nob_log(INFO, "Symmetry:%s%s%s, evaluated %.1f%% of the pixels",
+            sym.mirror_x ? " mirror x" : "", sym.mirror_y ? " mirror y" : "",
+            sym.swap ? " swap x y" : "", 100.0 * rendered / count);
+  }
+
+  render_job_finish(&job);
+
+  for (int i = 0; i < 3; ++i)
+    free(job.planes[i]);
+  trace_end(span);
+  return ok;
+}
+
+bool render_pixels(Node *f, Framebuffer *fb, const Render_Options *opts) {
+  Render_Options defaults = {0};
+  if (opts == NULL)
+    opts = &defaults;
+  Render_Viewport view =
+      viewport_resolve(&opts->viewport, fb->width, fb->height);
+  if (!viewport_check(&view, fb->width, fb->height))
+    return false;
+  bool whole = viewport_whole(&view, fb->width, fb->height);
+  if (opts->aa_samples > 1) {
+    // Which edges fit in the budget depends on the whole image
+    if (opts->aa_budget > 0 && !whole) {
+      nob_log(ERROR, "A tile of an anti-aliased image cannot have a budget");
+      return false;
+    }
+    return render_antialiased(f, NULL, fb, opts);
+  }
+  Symmetry sym = {0};
+  // Mirroring pixels negates coordinates only around the origin
+  if (opts->symmetry != SYMMETRY_OFF && view.center_x == 0.0f &&
+      view.center_y == 0.0f) {
+    sym = opts->symmetry == SYMMETRY_PROVEN
+              ? symmetry_prove(f)
+              : symmetry_sample(f, opts->t, RENDER_SYMMETRY_SAMPLES);
+    // Exchanging x and y maps pixels onto pixels only in a square image, and
+    // only leaves the rendered region in place with both mirrors or neither
+    if (view.width != view.height || sym.mirror_x != sym.mirror_y)
+      sym.swap = false;
+    if (symmetry_any(sym) && whole)
+      return render_symmetric(f, fb, opts, sym);
+  }
+  Trace_Span span = trace_begin("render_pixels");
+
+  // inside thew for loop we have to normalize the HEIGHT and WIDTH between -1
+  // to 1 but we have current range 0 to Height and 0 to Width;
+  Render_Job job = {.step = 1, .remap = sym};
+  render_job_init(&job, f, NULL, fb, opts);
+  bool ok = render_run(&job, opts);
+
+  render_job_finish(&job);
+
+  trace_end(span);
+  return ok;
+}
+
+bool render_bintree(const Bintree *t, Framebuffer *fb,
+                    const Render_Options *opts) {
+  Render_Options defaults = {0};
+  if (opts == NULL)
+    opts = &defaults;
+  Render_Viewport view =
+      viewport_resolve(&opts->viewport, fb->width, fb->height);
+  if (!viewport_check(&view, fb->width, fb->height))
+    return false;
+  if (opts->aa_samples > 1) {
+    if (opts->aa_budget > 0 && !viewport_whole(&view, fb->width, fb->height)) {
+      nob_log(ERROR, "A tile of an anti-aliased image cannot have a budget");
+      return false;
+    }
+    return render_antialiased(NULL, t, fb, opts);
+  }
+  Trace_Span span = trace_begin("render_bintree");
+  Render_Job job = {.step = 1};
+  render_job_init(&job, NULL, t, fb, opts);
+  bool ok = render_run(&job, opts);
+  render_job_finish(&job);
+  trace_end(span);
+  return ok;
+}
+
+bool render_progressive(Node *f, Framebuffer *fb, const Render_Options *opts,
+                        Render_Pass_Func on_pass, void *user) {
+  Render_Options defaults = {0};
+  if (opts == NULL)
+    opts = &defaults;
+  Render_Viewport view =
+      viewport_resolve(&opts->viewport, fb->width, fb->height);
+  if (!viewport_check(&view, fb->width, fb->height))
+    return false;
+  Trace_Span span = trace_begin("render_progressive");
+
+  size_t count = (size_t)fb->width * fb->height;
+  Render_Job job = {0};
+  render_job_init(&job, f, NULL, fb, opts);
+  for (int i = 0; i < 3; ++i) {
+    job.planes[i] = malloc(count * sizeof(float));
+    NOB_ASSERT(job.planes[i] != NULL);
+  }
+
+  bool ok = true;
+  int pass = 0;
+  for (int step = RENDER_PROGRESSIVE_STEP; ok && step >= 1; step /= 2) {
+    Trace_Span pass_span = trace_begin("render pass");
+    job.step = step;
+    job.coarse_step = step < RENDER_PROGRESSIVE_STEP ? step * 2 : 0;
+    atomic_store(&job.next_row, 0);
+    ok = render_run(&job, opts);
+    if (ok) {
+      for (int y = 0; y < fb->height; ++y) {
+        size_t row = (size_t)y * fb->width;
+        quantize_row(job.planes[0] + row, job.planes[1] + row,
+                     job.planes[2] + row, framebuffer_row(fb, y), fb->width,
+                     view.x, view.y + y, job.dither);
+      }
+    }
+    trace_end_arg(pass_span, "step", step);
+    if (ok && on_pass && !on_pass(fb, pass, step, user))
+      break;
+    pass += 1;
+  }
+
+  render_job_finish(&job);
+
+  for (int i = 0; i < 3; ++i)
+    free(job.planes[i]);
+  trace_end(span);
+  return ok;
+}
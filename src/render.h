@@ -0,0 +1,131 @@
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include "bintree.h"
+#include "node.h"
+#include "symmetry.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+  uint8_t a;
+} RGBA32;
+
+typedef struct {
+  RGBA32 *pixels;
+  int width;
+  int height;
+  int stride; // pixels from the start of a row to the next, 0 for width
+} Framebuffer;
+
+static inline RGBA32 *framebuffer_row(const Framebuffer *fb, int y) {
+  return fb->pixels + (size_t)y * (fb->stride > 0 ? fb->stride : fb->width);
+}
+
+// Which part of the plane an image shows and which part of the image a
+// framebuffer holds. The image of width x height pixels maps the square from
+// center - scale to center + scale, stretched like the default [-1, 1] on
+// both axes, and the framebuffer holds its pixels from (x, y). Every pixel
+// gets the color it has in a render of the whole image, so tiles rendered
+// apart, in other processes or on other machines, stitch into the same
+// image.
+//
+// Zero width and height stand for the size of the framebuffer, zero scale for
+// 1; the zero viewport is the whole image of [-1, 1]^2.
+typedef struct {
+  int x, y;
+  int width, height;
+  float center_x, center_y;
+  float scale;
+} Render_Viewport;
+
+// vp with the defaults filled in for a framebuffer of width x height
+Render_Viewport viewport_resolve(const Render_Viewport *vp, int width,
+                                 int height);
+// Whether a resolved viewport covers the whole image
+bool viewport_whole(const Render_Viewport *vp, int width, int height);
+// Logs an error unless a framebuffer of width x height fits in the image of
+// a resolved viewport
+bool viewport_check(const Render_Viewport *vp, int width, int height);
+
+// Coordinates of a position in pixels of the image of a resolved viewport.
+// 0..<WIDTH -> -WIDTH..<WIDTH -> -1..<1, with the subtraction first: it is
+// exact for whole pixels, so around a zero center pixel width - x gets
+// exactly the negation of the coordinate of pixel x, which is what the
+// symmetric render mirrors.
+static inline float viewport_x(const Render_Viewport *vp, float x) {
+  return vp->center_x + (2.0f * x - vp->width) / vp->width * vp->scale;
+}
+
+static inline float viewport_y(const Render_Viewport *vp, float y) {
+  return vp->center_y + (2.0f * y - vp->height) / vp->height * vp->scale;
+}
+
+typedef enum {
+  BACKEND_EVAL,  // recursive eval() of the Node tree, one pixel at a time
+  BACKEND_STACK, // eval_iter() with an explicit stack, for very deep trees
+  BACKEND_BIN,   // bintree_eval() of the postorder encoding, see bintree.h
+  COUNT_BACKENDS,
+} Backend;
+
+typedef struct {
+  Backend backend;
+  int threads;    // 0 means one worker per CPU
+  bool log_stats; // log per-worker arena statistics after rendering
+  bool dither;    // ordered dithering when quantizing to 8 bits
+  float t;        // value of NK_T
+  // Adaptive anti-aliasing: pixels whose color differs visibly from a
+  // neighbour get up to aa_samples samples in total, spread over the pixel.
+  // 0 or 1 turns it off. aa_budget caps the extra samples of the whole image,
+  // 0 for no cap.
+  int aa_samples;
+  size_t aa_budget;
+  // Render only the part of the image the symmetries of f leave undetermined
+  // and mirror it into the rest, see symmetry.h. Not combined with
+  // anti-aliasing.
+  Symmetry_Mode symmetry;
+  // Part of the plane and of the image to render. A tile of an anti-aliased
+  // image cannot have an aa_budget, and symmetry only applies to viewports
+  // centered on the origin.
+  Render_Viewport viewport;
+  // Of the worker arenas, NULL for the one shared by the process
+  Region_Pool *pool;
+} Render_Options;
+
+const char *backend_name(Backend backend);
+bool backend_by_name(const char *name, Backend *backend);
+
+int cpu_count(void);
+
+// opts may be NULL for the defaults.
+bool render_pixels(Node *f, Framebuffer *fb, const Render_Options *opts);
+
+// Renders the records of t in place with bintree_eval(), whatever
+// opts->backend says, so that a tree mapped from a file needs no nodes. Gives
+// the pixels of render_pixels() on bintree_to_node(t), but for symmetry,
+// which needs the nodes and is not applied.
+bool render_bintree(const Bintree *t, Framebuffer *fb,
+                    const Render_Options *opts);
+
+// Side of the blocks of the first progressive pass, a power of two
+#define RENDER_PROGRESSIVE_STEP 4
+
+// Called after each pass with the framebuffer filled in so far. Returning
+// false stops the render there.
+typedef bool (*Render_Pass_Func)(const Framebuffer *fb, int pass, int step,
+                                 void *user);
+
+// Renders every 4th pixel of every 4th row, then every 2nd, then the rest,
+// each pass only evaluating the pixels the previous ones did not, so the
+// total work is one full render. After a pass each sample fills the block of
+// pixels up to the next sample. The last pass leaves fb exactly as
+// render_pixels() would without anti-aliasing and symmetry, which are not
+// applied: opts->aa_samples and opts->symmetry are ignored.
+bool render_progressive(Node *f, Framebuffer *fb, const Render_Options *opts,
+                        Render_Pass_Func on_pass, void *user);
+
+#endif // RENDER_H_
@@ -0,0 +1,122 @@
+#define NOB_STRIP_PREFIX
+
+#include "shard.h"
+#include "image.h"
+#include "nob.h"
+#include "render.h"
+#include "trace.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Rows of band i of count, the first ones one row taller than the others
+static void shard_band(int height, int count, int i, int *y0, int *rows) {
+  int base = height / count, extra = height % count;
+  *y0 = i * base + (i < extra ? i : extra);
+  *rows = base + (i < extra ? 1 : 0);
+}
+
+// Appends the rows of the band in path to w, checking that it holds exactly
+// rows rows of w->width pixels
+static bool shard_stitch(Png_Writer *w, const char *path, int rows,
+                         RGBA32 *buffer) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    nob_log(ERROR, "Could not open %s: %s", path, strerror(errno));
+    return false;
+  }
+  bool ok = true;
+  for (int y = 0; ok && y < rows; y += PNG_WRITER_ROWS) {
+    int count = rows - y < PNG_WRITER_ROWS ? rows - y : PNG_WRITER_ROWS;
+    size_t pixels = (size_t)count * w->width;
+    if (fread(buffer, sizeof(RGBA32), pixels, file) != pixels) {
+      nob_log(ERROR, "%s: expected %d rows of %d pixels", path, rows,
+              w->width);
+      ok = false;
+    } else {
+      ok = png_writer_rows(w, buffer, count, w->width);
+    }
+  }
+  if (ok && fgetc(file) != EOF) {
+    nob_log(ERROR, "%s: more than %d rows of %d pixels", path, rows, w->width);
+    ok = false;
+  }
+  fclose(file);
+  return ok;
+}
+
+bool render_sharded(const Shard_Options *opts) {
+  int shards = opts->shards;
+  if (shards <= 0 || shards > opts->height) {
+    nob_log(ERROR, "Cannot split %d rows into %d shards", opts->height,
+            shards);
+    return false;
+  }
+  int threads = opts->threads;
+  if (threads <= 0) {
+    threads = cpu_count() / shards;
+    if (threads < 1)
+      threads = 1;
+  }
+
+  const char **paths = malloc(shards * sizeof(*paths));
+  if (paths == NULL)
+    return false;
+  for (int i = 0; i < shards; ++i)
+    paths[i] = temp_sprintf("%s.band%d.raw", opts->output_path, i);
+
+  Trace_Span span = trace_begin("shard render");
+  Procs procs = {0};
+  Cmd cmd = {0};
+  bool ok = true;
+  for (int i = 0; ok && i < shards; ++i) {
+    int y0, rows;
+    shard_band(opts->height, shards, i, &y0, &rows);
+    cmd.count = 0;
+    cmd_append(&cmd, opts->program);
+    da_append_many(&cmd, opts->forward.items, opts->forward.count);
+    cmd_append(&cmd, "--size",
+               temp_sprintf("%d,%d", opts->width, opts->height), "--region",
+               temp_sprintf("0,%d,%d,%d", y0, opts->width, rows), "--threads",
+               temp_sprintf("%d", threads), "--raw", paths[i]);
+    Proc proc = cmd_run_async(cmd);
+    if (proc == INVALID_PROC)
+      ok = false;
+    else
+      da_append(&procs, proc);
+  }
+  // Started workers are waited for even when a later one failed to start
+  ok = procs_wait(procs) && ok;
+  trace_end(span);
+  cmd_free(cmd);
+  da_free(procs);
+  if (ok)
+    nob_log(INFO, "Rendered %d bands of %dx%d, %d threads each", shards,
+            opts->width, (opts->height + shards - 1) / shards, threads);
+
+  span = trace_begin("stitch");
+  RGBA32 *buffer =
+      ok ? malloc((size_t)PNG_WRITER_ROWS * opts->width * sizeof(RGBA32))
+         : NULL;
+  if (buffer) {
+    Png_Writer w;
+    ok = png_writer_open(&w, opts->output_path, opts->width, opts->height);
+    for (int i = 0; ok && i < shards; ++i) {
+      int y0, rows;
+      shard_band(opts->height, shards, i, &y0, &rows);
+      ok = shard_stitch(&w, paths[i], rows, buffer);
+    }
+    ok = png_writer_close(&w) && ok;
+  } else {
+    ok = false;
+  }
+  free(buffer);
+  trace_end(span);
+
+  for (int i = 0; i < shards; ++i)
+    if (remove(paths[i]) != 0 && errno != ENOENT)
+      nob_log(WARNING, "Could not remove %s: %s", paths[i], strerror(errno));
+  free(paths);
+  return ok;
+}
@@ -0,0 +1,30 @@
+#ifndef SHARD_H_
+#define SHARD_H_
+
+// Renders an image in horizontal bands, each in a process of its own:
+//
+//   ran-art --size 32768,32768 --shards 8 --expr poster.txt
+//
+// Every worker is this program run again on its band with --region and --raw,
+// so the bands are the rows the whole image would have (see Render_Viewport),
+// and writes the RGBA32 pixels of the band to a file next to the output. Once
+// they have all exited, the bands are read back a few rows at a time and
+// stitched into one PNG by a Png_Writer, so the coordinator never holds more
+// than a few rows of the image either. Each worker allocates, first touches
+// and renders its band on its own, with its own node arena.
+
+#include "nob.h"
+#include <stdbool.h>
+
+typedef struct {
+  const char *program; // argv[0] of the workers
+  Nob_Cmd forward;     // options given to every worker, e.g. --expr FILE
+  int shards;
+  int width, height;
+  int threads; // render workers per shard, 0 to share the CPUs out
+  const char *output_path;
+} Shard_Options;
+
+bool render_sharded(const Shard_Options *opts);
+
+#endif // SHARD_H_
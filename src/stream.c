@@ -0,0 +1,333 @@
+#define NOB_STRIP_PREFIX
+
+#include "stream.h"
+#include "nob.h"
+#include "trace.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+struct iovec {
+  void *iov_base;
+  size_t iov_len;
+};
+#else
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define STREAM_DEFAULT_QUEUE 8
+#define STREAM_MAX_IOV 64
+
+static const char *stream_format_names[COUNT_STREAM_FORMATS] = {
+    [STREAM_Y4M] = "y4m",
+    [STREAM_RAW] = "raw",
+};
+
+bool stream_format_by_name(const char *name, Stream_Format *format) {
+  for (Stream_Format f = 0; f < COUNT_STREAM_FORMATS; ++f) {
+    if (strcmp(stream_format_names[f], name) == 0) {
+      *format = f;
+      return true;
+    }
+  }
+  return false;
+}
+
+typedef struct {
+  uint8_t *data; // one frame, including the Y4M frame header
+  size_t size;
+} Stream_Slot;
+
+struct Stream {
+  int fd;
+  Stream_Format format;
+  int width, height;
+  size_t frame_size;
+
+  // Ring of slots: [head, head + count) are queued for the writer
+  Stream_Slot *slots;
+  int slots_count;
+  int head;
+  int count;
+  bool closing;
+  bool failed;
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  pthread_t writer;
+  bool writer_started; // pthread_t has no value that means no thread
+};
+
+static const char y4m_frame_header[] = "FRAME\n";
+#define Y4M_FRAME_HEADER_SIZE (sizeof(y4m_frame_header) - 1)
+
+// BT.601 limited range, in 8.8 fixed point:
+//   Y = (( 66 R + 129 G +  25 B + 128) >> 8) +  16
+//   U = ((-38 R -  74 G + 112 B + 128) >> 8) + 128
+//   V = ((112 R -  94 G -  18 B + 128) >> 8) + 128
+static inline uint8_t y4m_luma(RGBA32 p) {
+  return (uint8_t)(((66 * p.r + 129 * p.g + 25 * p.b + 128) >> 8) + 16);
+}
+
+static inline int y4m_u(RGBA32 p) {
+  return ((-38 * p.r - 74 * p.g + 112 * p.b + 128) >> 8) + 128;
+}
+
+static inline int y4m_v(RGBA32 p) {
+  return ((112 * p.r - 94 * p.g - 18 * p.b + 128) >> 8) + 128;
+}
+
+#ifdef __SSE2__
+// Four pixels through one row of the matrix above. madd gives the sums of
+// the (r, g) and (b, a) pairs of every pixel, the shuffles add them up.
+static inline __m128i y4m_channel4(__m128i lo, __m128i hi, __m128i coeffs,
+                                   int offset) {
+  __m128 plo = _mm_castsi128_ps(_mm_madd_epi16(lo, coeffs));
+  __m128 phi = _mm_castsi128_ps(_mm_madd_epi16(hi, coeffs));
+  __m128i even =
+      _mm_castps_si128(_mm_shuffle_ps(plo, phi, _MM_SHUFFLE(2, 0, 2, 0)));
+  __m128i odd =
+      _mm_castps_si128(_mm_shuffle_ps(plo, phi, _MM_SHUFFLE(3, 1, 3, 1)));
+  __m128i sum = _mm_add_epi32(_mm_add_epi32(even, odd), _mm_set1_epi32(128));
+  return _mm_add_epi32(_mm_srai_epi32(sum, 8), _mm_set1_epi32(offset));
+}
+
+static inline uint32_t y4m_pack4(__m128i v) {
+  __m128i packed = _mm_packs_epi32(v, v);
+  return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));
+}
+#endif
+
+// Full resolution Y, U and V of one row; U and V are averaged down later
+static void y4m_convert_row(const RGBA32 *src, int width, uint8_t *y,
+                            int16_t *u, int16_t *v) {
+  int x = 0;
+#ifdef __SSE2__
+  const __m128i cy = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+  const __m128i cu = _mm_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0);
+  const __m128i cv = _mm_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0);
+  const __m128i zero = _mm_setzero_si128();
+  for (; x + 4 <= width; x += 4) {
+    __m128i px = _mm_loadu_si128((const __m128i *)(src + x));
+    __m128i lo = _mm_unpacklo_epi8(px, zero);
+    __m128i hi = _mm_unpackhi_epi8(px, zero);
+    uint32_t luma = y4m_pack4(y4m_channel4(lo, hi, cy, 16));
+    memcpy(y + x, &luma, sizeof(luma));
+    __m128i us = y4m_channel4(lo, hi, cu, 128);
+    __m128i vs = y4m_channel4(lo, hi, cv, 128);
+    _mm_storel_epi64((__m128i *)(u + x), _mm_packs_epi32(us, us));
+    _mm_storel_epi64((__m128i *)(v + x), _mm_packs_epi32(vs, vs));
+  }
+#endif
+  for (; x < width; ++x) {
+    y[x] = y4m_luma(src[x]);
+    u[x] = (int16_t)y4m_u(src[x]);
+    v[x] = (int16_t)y4m_v(src[x]);
+  }
+}
+
+static void y4m_convert(const Framebuffer *fb, uint8_t *out) {
+  int w = fb->width, h = fb->height;
+  int cw = (w + 1) / 2, ch = (h + 1) / 2;
+  memcpy(out, y4m_frame_header, Y4M_FRAME_HEADER_SIZE);
+  uint8_t *yp = out + Y4M_FRAME_HEADER_SIZE;
+  uint8_t *up = yp + (size_t)w * h;
+  uint8_t *vp = up + (size_t)cw * ch;
+
+  // Two rows of full resolution chroma at a time, averaged 2x2
+  int16_t *u = malloc(sizeof(int16_t) * w * 2);
+  int16_t *v = malloc(sizeof(int16_t) * w * 2);
+  NOB_ASSERT(u != NULL && v != NULL);
+  for (int cy = 0; cy < ch; ++cy) {
+    int y0 = 2 * cy;
+    int y1 = y0 + 1 < h ? y0 + 1 : y0;
+    y4m_convert_row(fb->pixels + (size_t)y0 * w, w, yp + (size_t)y0 * w, u,
+                    v);
+    if (y1 != y0)
+      y4m_convert_row(fb->pixels + (size_t)y1 * w, w, yp + (size_t)y1 * w,
+                      u + w, v + w);
+    else {
+      memcpy(u + w, u, sizeof(int16_t) * w);
+      memcpy(v + w, v, sizeof(int16_t) * w);
+    }
+    for (int cx = 0; cx < cw; ++cx) {
+      int x0 = 2 * cx;
+      int x1 = x0 + 1 < w ? x0 + 1 : x0;
+      up[(size_t)cy * cw + cx] =
+          (uint8_t)((u[x0] + u[x1] + u[w + x0] + u[w + x1] + 2) >> 2);
+      vp[(size_t)cy * cw + cx] =
+          (uint8_t)((v[x0] + v[x1] + v[w + x0] + v[w + x1] + 2) >> 2);
+    }
+  }
+  free(u);
+  free(v);
+}
+
+// Writes all of iov, continuing after short writes to a pipe
+static bool stream_writev(int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+#ifdef _WIN32
+    ssize_t n = _write(fd, iov->iov_base, (unsigned)iov->iov_len);
+#else
+    ssize_t n = writev(fd, iov, iovcnt);
+#endif
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      nob_log(ERROR, "Could not write the stream: %s", strerror(errno));
+      return false;
+    }
+    while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return true;
+}
+
+static void *stream_writer(void *arg) {
+  Stream *s = arg;
+  trace_thread_name("stream writer");
+  pthread_mutex_lock(&s->mutex);
+  for (;;) {
+    while (s->count == 0 && !s->closing)
+      pthread_cond_wait(&s->not_empty, &s->mutex);
+    if (s->count == 0)
+      break;
+    // Everything queued so far goes out in one writev()
+    int taken = s->count < STREAM_MAX_IOV ? s->count : STREAM_MAX_IOV;
+    int head = s->head;
+    pthread_mutex_unlock(&s->mutex);
+
+    struct iovec iov[STREAM_MAX_IOV];
+    for (int i = 0; i < taken; ++i) {
+      Stream_Slot *slot = &s->slots[(head + i) % s->slots_count];
+      iov[i].iov_base = slot->data;
+      iov[i].iov_len = slot->size;
+    }
+    Trace_Span span = trace_begin("stream write");
+    bool ok = s->failed || stream_writev(s->fd, iov, taken);
+    trace_end_arg(span, "frames", taken);
+
+    pthread_mutex_lock(&s->mutex);
+    if (!ok)
+      s->failed = true;
+    s->head = (s->head + taken) % s->slots_count;
+    s->count -= taken;
+    pthread_cond_signal(&s->not_full);
+  }
+  pthread_mutex_unlock(&s->mutex);
+  return NULL;
+}
+
+Stream *stream_open(int fd, Stream_Format format, int width, int height,
+                    int fps, int queue_frames) {
+  NOB_ASSERT(format < COUNT_STREAM_FORMATS);
+  Stream *s = calloc(1, sizeof(*s));
+  NOB_ASSERT(s != NULL);
+  s->fd = fd;
+  s->format = format;
+  s->width = width;
+  s->height = height;
+  if (format == STREAM_Y4M) {
+    size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    s->frame_size = Y4M_FRAME_HEADER_SIZE + (size_t)width * height + 2 * chroma;
+  } else {
+    s->frame_size = (size_t)width * height * sizeof(RGBA32);
+  }
+
+  s->slots_count = queue_frames > 0 ? queue_frames : STREAM_DEFAULT_QUEUE;
+  s->slots = calloc(s->slots_count, sizeof(*s->slots));
+  NOB_ASSERT(s->slots != NULL);
+  for (int i = 0; i < s->slots_count; ++i) {
+    s->slots[i].data = malloc(s->frame_size);
+    NOB_ASSERT(s->slots[i].data != NULL);
+    s->slots[i].size = s->frame_size;
+  }
+  pthread_mutex_init(&s->mutex, NULL);
+  pthread_cond_init(&s->not_empty, NULL);
+  pthread_cond_init(&s->not_full, NULL);
+
+  if (format == STREAM_Y4M) {
+    char header[128];
+    int n = snprintf(header, sizeof(header),
+                     "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width,
+                     height, fps);
+    struct iovec iov = {.iov_base = header, .iov_len = (size_t)n};
+    if (!stream_writev(fd, &iov, 1)) {
+      stream_close(s);
+      return NULL;
+    }
+  }
+
+  if (pthread_create(&s->writer, NULL, stream_writer, s) != 0) {
+    nob_log(ERROR, "Could not create the stream writer");
+    stream_close(s);
+    return NULL;
+  }
+  s->writer_started = true;
+  return s;
+}
+
+bool stream_push(Stream *s, const Framebuffer *fb) {
+  NOB_ASSERT(fb->width == s->width && fb->height == s->height);
+  pthread_mutex_lock(&s->mutex);
+  while (s->count == s->slots_count && !s->failed)
+    pthread_cond_wait(&s->not_full, &s->mutex);
+  bool failed = s->failed;
+  int index = (s->head + s->count) % s->slots_count;
+  pthread_mutex_unlock(&s->mutex);
+  if (failed)
+    return false;
+
+  // Only this thread fills slots, and the writer doesn't touch the slot
+  // until it is counted below.
+  Trace_Span span = trace_begin("stream convert");
+  Stream_Slot *slot = &s->slots[index];
+  if (s->format == STREAM_Y4M)
+    y4m_convert(fb, slot->data);
+  else
+    memcpy(slot->data, fb->pixels, s->frame_size);
+  trace_end(span);
+
+  pthread_mutex_lock(&s->mutex);
+  s->count += 1;
+  pthread_cond_signal(&s->not_empty);
+  pthread_mutex_unlock(&s->mutex);
+  return true;
+}
+
+bool stream_close(Stream *s) {
+  pthread_mutex_lock(&s->mutex);
+  s->closing = true;
+  pthread_cond_signal(&s->not_empty);
+  pthread_mutex_unlock(&s->mutex);
+  if (s->writer_started)
+    pthread_join(s->writer, NULL);
+
+  bool ok = !s->failed;
+  for (int i = 0; i < s->slots_count; ++i)
+    free(s->slots[i].data);
+  free(s->slots);
+  pthread_mutex_destroy(&s->mutex);
+  pthread_cond_destroy(&s->not_empty);
+  pthread_cond_destroy(&s->not_full);
+  free(s);
+  return ok;
+}
@@ -0,0 +1,33 @@
+#ifndef STREAM_H_
+#define STREAM_H_
+
+// Streams frames to a file descriptor, usually stdout piped into an encoder:
+//
+//   ran-art --frames 120 --stream y4m | ffmpeg -i - out.mp4
+//
+// stream_push() converts a frame into a slot of a bounded queue and returns;
+// a writer thread drains the queue with one writev() for all the frames that
+// are ready. The renderer only waits when the queue is full, i.e. when the
+// consumer is slower than rendering for longer than the queue lasts.
+
+#include "render.h"
+#include <stdbool.h>
+
+typedef enum {
+  STREAM_Y4M, // YUV4MPEG2, 4:2:0 BT.601 limited range
+  STREAM_RAW, // the RGBA32 pixels, frame after frame
+  COUNT_STREAM_FORMATS,
+} Stream_Format;
+
+typedef struct Stream Stream;
+
+bool stream_format_by_name(const char *name, Stream_Format *format);
+
+// queue_frames of 0 picks the default. Returns NULL on failure.
+Stream *stream_open(int fd, Stream_Format format, int width, int height,
+                    int fps, int queue_frames);
+bool stream_push(Stream *s, const Framebuffer *fb);
+// Waits for the queued frames to be written. False if any write failed.
+bool stream_close(Stream *s);
+
+#endif // STREAM_H_
@@ -0,0 +1,221 @@
+#define NOB_STRIP_PREFIX
+
+#include "symmetry.h"
+#include "nob.h"
+#include <string.h>
+
+static const char *symmetry_mode_names[COUNT_SYMMETRY_MODES] = {
+    [SYMMETRY_OFF] = "off",
+    [SYMMETRY_PROVEN] = "proven",
+    [SYMMETRY_SAMPLED] = "sampled",
+};
+
+const char *symmetry_mode_name(Symmetry_Mode mode) {
+  NOB_ASSERT(mode < COUNT_SYMMETRY_MODES);
+  return symmetry_mode_names[mode];
+}
+
+bool symmetry_mode_by_name(const char *name, Symmetry_Mode *mode) {
+  for (Symmetry_Mode m = 0; m < COUNT_SYMMETRY_MODES; ++m) {
+    if (strcmp(symmetry_mode_names[m], name) == 0) {
+      *mode = m;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool symmetry_any(Symmetry s) { return s.mirror_x || s.mirror_y || s.swap; }
+
+// How a node changes when the variable is negated. CONST nodes do not
+// depend on it at all. EVEN and ODD nodes keep or flip their value, though
+// possibly not the sign of a zero, which only atan2 could tell apart.
+typedef enum {
+  PARITY_CONST,
+  PARITY_EVEN,
+  PARITY_ODD,
+  PARITY_NONE,
+} Parity;
+
+static bool parity_even(Parity p) {
+  return p == PARITY_CONST || p == PARITY_EVEN;
+}
+
+// add, min, max, gt and the branches of if: both operands even or both odd
+static Parity parity_join(Parity a, Parity b, bool odd_ok) {
+  if (a == PARITY_CONST && b == PARITY_CONST)
+    return PARITY_CONST;
+  if (parity_even(a) && parity_even(b))
+    return PARITY_EVEN;
+  if (odd_ok && a == PARITY_ODD && b == PARITY_ODD)
+    return PARITY_ODD;
+  return PARITY_NONE;
+}
+
+static Parity parity(Node *node, Node_Kind var) {
+  switch (node->kind) {
+  case NK_X:
+  case NK_Y:
+    return node->kind == var ? PARITY_ODD : PARITY_CONST;
+  case NK_T:
+  case NK_NUMBER:
+  case NK_BOOL:
+    return PARITY_CONST;
+  case NK_SIN:
+  case NK_COS:
+  case NK_EXP:
+  case NK_SQRT:
+  case NK_ABS: {
+    Parity arg = parity(node->as.unop.arg, var);
+    if (arg == PARITY_CONST || arg == PARITY_NONE)
+      return arg;
+    if (node->kind == NK_SIN)
+      return arg;
+    if (node->kind == NK_COS || node->kind == NK_ABS)
+      return PARITY_EVEN;
+    return arg == PARITY_EVEN ? PARITY_EVEN : PARITY_NONE;
+  }
+  case NK_MULT: {
+    Parity lhs = parity(node->as.binop.lhs, var);
+    Parity rhs = parity(node->as.binop.rhs, var);
+    if (lhs == PARITY_NONE || rhs == PARITY_NONE)
+      return PARITY_NONE;
+    if (lhs == PARITY_CONST && rhs == PARITY_CONST)
+      return PARITY_CONST;
+    return (lhs == PARITY_ODD) != (rhs == PARITY_ODD) ? PARITY_ODD
+                                                      : PARITY_EVEN;
+  }
+  case NK_MOD: {
+    // fmodf(-a, b) == -fmodf(a, b) and fmodf(a, -b) == fmodf(a, b)
+    Parity lhs = parity(node->as.binop.lhs, var);
+    Parity rhs = parity(node->as.binop.rhs, var);
+    if (lhs == PARITY_NONE || rhs == PARITY_NONE)
+      return PARITY_NONE;
+    if (lhs == PARITY_CONST && rhs == PARITY_CONST)
+      return PARITY_CONST;
+    return lhs == PARITY_ODD ? PARITY_ODD : PARITY_EVEN;
+  }
+  case NK_ADD:
+    return parity_join(parity(node->as.binop.lhs, var),
+                       parity(node->as.binop.rhs, var), true);
+  case NK_GT:
+  case NK_MIN:
+  case NK_MAX:
+    return parity_join(parity(node->as.binop.lhs, var),
+                       parity(node->as.binop.rhs, var), false);
+  case NK_ATAN2:
+    // atan2(+-0, x) for negative x is +-pi
+    if (parity(node->as.binop.lhs, var) == PARITY_CONST &&
+        parity(node->as.binop.rhs, var) == PARITY_CONST)
+      return PARITY_CONST;
+    return PARITY_NONE;
+  case NK_IF: {
+    Parity cond = parity(node->as.iff.cond, var);
+    if (!parity_even(cond))
+      return PARITY_NONE;
+    Parity branches = parity_join(parity(node->as.iff.then, var),
+                                  parity(node->as.iff.elze, var), true);
+    if (cond == PARITY_EVEN && branches == PARITY_CONST)
+      return PARITY_EVEN;
+    return branches;
+  }
+  case NK_TRIPLE: {
+    // Only the final color matters, which has to be even
+    Parity first = parity(node->as.triple.first, var);
+    Parity rest = parity_join(parity(node->as.triple.second, var),
+                              parity(node->as.triple.third, var), false);
+    return parity_join(first, rest, false);
+  }
+  }
+  NOB_UNREACHABLE("parity");
+}
+
+// Comparisons left before swapped_equal() gives up. Trying both orders of
+// commutative operands can take exponential time on trees that are almost
+// symmetric.
+#define SYMMETRY_SWAP_BUDGET 100000
+
+// Whether a is b with x and y exchanged
+static bool swapped_equal(Node *a, Node *b, size_t *budget) {
+  if (*budget == 0)
+    return false;
+  *budget -= 1;
+  if (a->kind == NK_X)
+    return b->kind == NK_Y;
+  if (a->kind == NK_Y)
+    return b->kind == NK_X;
+  if (a->kind != b->kind)
+    return false;
+  switch (a->kind) {
+  case NK_NUMBER:
+    return memcmp(&a->as.number, &b->as.number, sizeof(float)) == 0;
+  case NK_BOOL:
+    return a->as.boolean == b->as.boolean;
+  case NK_ADD:
+  case NK_MULT:
+  case NK_MIN:
+  case NK_MAX:
+    if (swapped_equal(a->as.binop.lhs, b->as.binop.rhs, budget) &&
+        swapped_equal(a->as.binop.rhs, b->as.binop.lhs, budget))
+      return true;
+    break;
+  default:
+    break;
+  }
+  Node *ac[3], *bc[3];
+  size_t n = node_children(a, ac);
+  node_children(b, bc);
+  for (size_t i = 0; i < n; ++i) {
+    if (!swapped_equal(ac[i], bc[i], budget))
+      return false;
+  }
+  return true;
+}
+
+Symmetry symmetry_prove(Node *f) {
+  size_t budget = SYMMETRY_SWAP_BUDGET;
+  return (Symmetry){
+      .mirror_x = parity_even(parity(f, NK_X)),
+      .mirror_y = parity_even(parity(f, NK_Y)),
+      .swap = swapped_equal(f, f, &budget),
+  };
+}
+
+static bool same_color(Color a, Color b) {
+  float pa[3] = {a.r, a.g, a.b};
+  float pb[3] = {b.r, b.g, b.b};
+  for (int i = 0; i < 3; ++i) {
+    if (pa[i] != pb[i] && !(pa[i] != pa[i] && pb[i] != pb[i]))
+      return false;
+  }
+  return true;
+}
+
+Symmetry symmetry_sample(Node *f, float t, int side) {
+  NOB_ASSERT(side > 1);
+  Symmetry s = {true, true, true};
+  Arena arena = {0};
+  Arena *saved = scratch_arena;
+  scratch_arena = &arena;
+  for (int j = 0; j < side && symmetry_any(s); ++j) {
+    for (int i = 0; i < side && symmetry_any(s); ++i) {
+      float x = (float)i / side * 2.0f - 1.0f;
+      float y = (float)j / side * 2.0f - 1.0f;
+      Color c, m;
+      if (!eval_func(f, x, y, t, &c)) {
+        s = (Symmetry){0};
+        break;
+      }
+      if (s.mirror_x)
+        s.mirror_x = eval_func(f, -x, y, t, &m) && same_color(c, m);
+      if (s.mirror_y)
+        s.mirror_y = eval_func(f, x, -y, t, &m) && same_color(c, m);
+      if (s.swap)
+        s.swap = eval_func(f, y, x, t, &m) && same_color(c, m);
+      arena_reset(&arena);
+    }
+  }
+  scratch_arena = saved;
+  arena_free(&arena);
+  return s;
+}
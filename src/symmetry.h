@@ -0,0 +1,43 @@
+#ifndef SYMMETRY_H_
+#define SYMMETRY_H_
+
+// Symmetries of an expression that let the renderer evaluate only part of
+// the image and copy the rest.
+//
+// symmetry_prove() works on the tree alone. Every number node is classified
+// as constant, even or odd under x -> -x (and separately y -> -y): x is odd,
+// mult of two odd operands is even, sin keeps the parity of its argument,
+// cos and abs make it even, and so on. Negating an operand negates the
+// result of these float operations exactly, so when the three color
+// components come out even, f(-x, y) is exactly f(x, y). For x <-> y the
+// tree is compared with itself with x and y exchanged, allowing the operands
+// of add, mult, min and max to be swapped.
+//
+// symmetry_sample() instead compares the colors of mirrored points on a grid,
+// which also catches symmetries the rules above miss, but is not a proof.
+
+#include "node.h"
+#include <stdbool.h>
+
+typedef struct {
+  bool mirror_x; // f(-x, y) == f(x, y)
+  bool mirror_y; // f(x, -y) == f(x, y)
+  bool swap;     // f(y, x) == f(x, y)
+} Symmetry;
+
+typedef enum {
+  SYMMETRY_OFF,
+  SYMMETRY_PROVEN,  // symmetry_prove()
+  SYMMETRY_SAMPLED, // symmetry_sample(), approximate
+  COUNT_SYMMETRY_MODES,
+} Symmetry_Mode;
+
+Symmetry symmetry_prove(Node *f);
+// Checks the symmetries on a grid of side points at time t
+Symmetry symmetry_sample(Node *f, float t, int side);
+
+bool symmetry_any(Symmetry s);
+const char *symmetry_mode_name(Symmetry_Mode mode);
+bool symmetry_mode_by_name(const char *name, Symmetry_Mode *mode);
+
+#endif // SYMMETRY_H_
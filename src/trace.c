@@ -0,0 +1,148 @@
+#define NOB_STRIP_PREFIX
+
+#include "trace.h"
+#include "nob.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+  const char *name;
+  const char *arg_name; // NULL when the event has no argument
+  int64_t arg;
+  int64_t start_us;
+  int64_t duration_us;
+  int tid;
+} Trace_Event;
+
+typedef struct {
+  Trace_Event *items;
+  size_t count;
+  size_t capacity;
+} Trace_Events;
+
+typedef struct {
+  int tid;
+  char *name;
+} Trace_Thread;
+
+typedef struct {
+  Trace_Thread *items;
+  size_t count;
+  size_t capacity;
+} Trace_Threads;
+
+static atomic_bool trace_enabled = false;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static const char *trace_path = NULL;
+static int64_t trace_epoch_us = 0;
+static Trace_Events trace_events = {0};
+static Trace_Threads trace_threads = {0};
+static atomic_int trace_next_tid = 0;
+static _Thread_local int trace_tid = -1;
+
+static int64_t trace_now_us(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int trace_current_tid(void) {
+  if (trace_tid < 0)
+    trace_tid = atomic_fetch_add(&trace_next_tid, 1);
+  return trace_tid;
+}
+
+bool trace_start(const char *path) {
+  trace_path = path;
+  trace_epoch_us = trace_now_us();
+  atomic_store(&trace_enabled, true);
+  trace_thread_name("main");
+  return true;
+}
+
+Trace_Span trace_begin(const char *name) {
+  Trace_Span span = {.name = name, .start_us = -1};
+  if (atomic_load_explicit(&trace_enabled, memory_order_relaxed))
+    span.start_us = trace_now_us() - trace_epoch_us;
+  return span;
+}
+
+void trace_end_arg(Trace_Span span, const char *arg_name, int64_t arg) {
+  if (span.start_us < 0)
+    return;
+  Trace_Event event = {
+      .name = span.name,
+      .arg_name = arg_name,
+      .arg = arg,
+      .start_us = span.start_us,
+      .duration_us = trace_now_us() - trace_epoch_us - span.start_us,
+      .tid = trace_current_tid(),
+  };
+  pthread_mutex_lock(&trace_mutex);
+  da_append(&trace_events, event);
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+void trace_end(Trace_Span span) { trace_end_arg(span, NULL, 0); }
+
+void trace_thread_name(const char *name) {
+  if (!atomic_load(&trace_enabled))
+    return;
+  Trace_Thread thread = {.tid = trace_current_tid(), .name = strdup(name)};
+  pthread_mutex_lock(&trace_mutex);
+  da_append(&trace_threads, thread);
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+bool trace_finish(void) {
+  if (!atomic_exchange(&trace_enabled, false))
+    return true;
+
+  FILE *f = fopen(trace_path, "w");
+  if (f == NULL) {
+    nob_log(ERROR, "Could not open %s: %s", trace_path, strerror(errno));
+    return false;
+  }
+
+  pthread_mutex_lock(&trace_mutex);
+  fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  bool first = true;
+  for (size_t i = 0; i < trace_threads.count; ++i) {
+    Trace_Thread *t = &trace_threads.items[i];
+    fprintf(f,
+            "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+            "\"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+            first ? "" : ",\n", t->tid, t->name);
+    first = false;
+    free(t->name);
+  }
+  for (size_t i = 0; i < trace_events.count; ++i) {
+    Trace_Event *e = &trace_events.items[i];
+    fprintf(f,
+            "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+            "\"ts\": %lld, \"dur\": %lld",
+            first ? "" : ",\n", e->name, e->tid, (long long)e->start_us,
+            (long long)e->duration_us);
+    if (e->arg_name)
+      fprintf(f, ", \"args\": {\"%s\": %lld}", e->arg_name, (long long)e->arg);
+    fprintf(f, "}");
+    first = false;
+  }
+  fprintf(f, "\n]}\n");
+  trace_events.count = 0;
+  trace_threads.count = 0;
+  pthread_mutex_unlock(&trace_mutex);
+
+  bool ok = ferror(f) == 0;
+  if (fclose(f) != 0)
+    ok = false;
+  if (!ok)
+    nob_log(ERROR, "Could not write %s", trace_path);
+  else
+    nob_log(INFO, "Trace saved to: %s", trace_path);
+  return ok;
+}
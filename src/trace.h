@@ -0,0 +1,35 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+// Opt-in timeline of where the time goes, written as a Chrome trace-event
+// JSON file (load it in chrome://tracing or ui.perfetto.dev).
+//
+//   trace_start("trace.json");
+//   Trace_Span span = trace_begin("render");
+//   ...
+//   trace_end(span);
+//   trace_finish();
+//
+// While tracing is not started trace_begin()/trace_end() only check a flag.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  const char *name; // must outlive the trace, usually a string literal
+  int64_t start_us; // -1 when tracing is off
+} Trace_Span;
+
+bool trace_start(const char *path);
+// Writes the recorded events to the file given to trace_start()
+bool trace_finish(void);
+
+Trace_Span trace_begin(const char *name);
+void trace_end(Trace_Span span);
+// Same as trace_end() with one integer argument shown in the event details
+void trace_end_arg(Trace_Span span, const char *arg_name, int64_t arg);
+
+// Names the calling thread in the timeline
+void trace_thread_name(const char *name);
+
+#endif // TRACE_H_